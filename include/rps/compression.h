@@ -0,0 +1,33 @@
+/**
+ * @file compression.h
+ * @brief Compression settings of package files.
+ */
+#ifndef _COMPRESSION_H
+#define _COMPRESSION_H
+
+#include <string>
+
+namespace rose
+{
+
+struct Compression {
+    enum class Codec { None, Bzip2, Gzip, Xz, Zstd, Lz4 };
+
+    Codec codec{Codec::Bzip2};
+    int level{0}; // 0 selects the default level of the codec
+
+    /**
+     * @brief Parse a compression setting.
+     * @param str Codec name with an optional level, e.g. "zstd" or "zstd:19".
+     */
+    static Compression fromString(const std::string &str);
+
+    std::string toString() const;
+
+    static Codec codecFromName(const std::string &name);
+    static std::string codecName(Codec codec);
+};
+
+} // namespace rose
+
+#endif /* _COMPRESSION_H */
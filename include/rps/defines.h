@@ -12,5 +12,6 @@
 #define MPK_PATH_MAX 4096 /* max lendth of a path including terminating 0 */
 
 #define MPK_PACKAGE_STORE "usr/packages"
+#define MPK_APPS_DIR "usr/apps"
 
 #endif /* _DEFINES_H */
@@ -5,28 +5,48 @@
 #define _FILE_H
 
 #include <openssl/sha.h>
-#include <string>
-#include <vector>
+#include <array>
+#include <cstdint>
+#include <string_view>
 
 #define MPK_FILEHASH_SIZE SHA256_DIGEST_LENGTH
 
 namespace rose
 {
 
+using FileHash = std::array<uint8_t, MPK_FILEHASH_SIZE>;
+
+/**
+ * A file of a package. The name refers to the string arena of the manifest the file belongs
+ * to, files are created with Manifest::addFile().
+ */
 class File
 {
   public:
     File();
+    File(std::string_view name);
     ~File();
 
-    std::string name() const;
-    void setName(const std::string &name);
-    const std::vector<uint8_t> &hash() const;
-    void setHash(const std::vector<uint8_t> &hash);
+    std::string_view name() const;
+
+    /**
+     * @brief The SHA-256 hash of the file content, only valid if hasHash() is true.
+     */
+    const FileHash &hash() const;
+    bool hasHash() const;
+    void setHash(const FileHash &hash);
+
+    /**
+     * @brief The permission bits of the file, 0 if the manifest does not record them.
+     */
+    uint32_t mode() const;
+    void setMode(uint32_t mode);
 
   private:
-    std::string mName;
-    std::vector<uint8_t> mHash;
+    std::string_view mName;
+    FileHash mHash{};
+    bool mHasHash{false};
+    uint32_t mMode{0};
 };
 
 } // namespace rose
@@ -0,0 +1,163 @@
+/**
+ * @file installer.h
+ * @brief Transactional installation of packages to the apps directory.
+ */
+#ifndef _INSTALLER_H
+#define _INSTALLER_H
+
+#include <rps/resolver.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace rose
+{
+
+struct InstallTransaction;
+
+/**
+ * Each package is installed to its own directory MPK_APPS_DIR/<name>. A transaction extracts the
+ * packages to a staging directory on the same file system, flushes the file system once and
+ * commits by writing a journal that is flushed with a single fdatasync(). Afterwards the package
+ * directories are switched with one atomic renameat2(RENAME_EXCHANGE) or rename() each and the
+ * old trees are deleted without further syncs. The database of the installed packages is staged
+ * and switched with the packages.
+ *
+ * After a power loss recover() completes a transaction whose journal is valid and discards the
+ * staged files of all others, so either all packages of a transaction are switched or none. The
+ * journal of the last transaction is kept, recovering it again does nothing, and the syncs of the
+ * next transaction make its switch durable before the journal is overwritten.
+ */
+class Installer
+{
+  public:
+    /**
+     * @param root The root of the file system the packages are installed to.
+     */
+    Installer(const std::filesystem::path &root = "/");
+
+    /**
+     * @brief The apps directory, root/MPK_APPS_DIR.
+     */
+    std::filesystem::path path() const;
+
+    /**
+     * @brief The database of the installed packages, see PackageDatabase.
+     */
+    std::filesystem::path databasePath() const;
+
+    /**
+     * @brief The installed revision of a package.
+     * @return the revision or 0 if the package is not installed
+     */
+    int32_t installedRevision(const std::string &name) const;
+
+    /**
+     * @brief Install or replace packages in one transaction.
+     *
+     * The packages pass a pipeline: while a package is extracted, the next one is verified and
+     * the one after is fetched. Packages whose revision is already installed are skipped, files
+     * that did not change are linked from the installed revision, see Package::upgrade(). If a
+     * package cannot be fetched, extracted or verified, or has a file that belongs to another
+     * package, nothing is installed.
+     * @param sources Paths or file:// URLs of the *.rps files.
+     * @return the number of installed packages
+     */
+    size_t install(const std::vector<std::string> &sources);
+
+    /**
+     * @brief Remove installed packages in one transaction.
+     * @return the number of removed packages
+     * @throws Exception if a package is not installed
+     */
+    size_t remove(const std::vector<std::string> &names);
+
+    /**
+     * @brief Install and remove packages in one transaction, e.g. the changes of
+     * Resolver::resolve().
+     *
+     * Revision 0 removes a package, other revisions are installed from the source and must match
+     * the name and revision of the package.
+     * @return the number of installed and removed packages
+     */
+    size_t apply(const std::vector<PackageRevision> &changes);
+
+    /**
+     * @brief Complete or discard a transaction that was interrupted, e.g. by a power loss.
+     *
+     * Must be called before the installed packages are used after a restart. install(),
+     * remove() and apply() recover before they start a new transaction.
+     * @return true if a committed transaction was completed
+     */
+    bool recover();
+
+    /**
+     * @brief Only install packages signed with the private key of this public key, see
+     * Package::verify().
+     * @param pub_key The public key file in PEM format, empty to accept unsigned packages.
+     */
+    void setPublicKey(const std::string &pub_key);
+
+    /**
+     * @brief Set a function that is called when the journal of a transaction is durable, before
+     * the package directories are switched.
+     *
+     * If the function throws, the transaction is not switched and left to recover(), just like
+     * after a power loss at this point.
+     */
+    void setCommitCallback(std::function<void()> callback);
+
+    /**
+     * @brief The number of sync calls of the last transaction.
+     */
+    size_t syncCount() const;
+
+  private:
+    bool recover(int dir_fd);
+
+    /**
+     * @brief Run a transaction, installs without name are not checked against the package.
+     */
+    size_t run(
+        const std::vector<PackageRevision> &installs, const std::vector<std::string> &removals);
+
+    /**
+     * @brief Fetch, verify and extract the packages to the staging directory of a transaction.
+     */
+    void stagePackages(
+        const std::vector<PackageRevision> &installs, InstallTransaction &transaction);
+
+    /**
+     * @brief Sync the staged files, write the journal and switch the package directories.
+     */
+    size_t commit(int dir_fd, const InstallTransaction &transaction);
+
+    /**
+     * @brief Write the database after the transaction to its staging directory.
+     */
+    void writeDatabase(const InstallTransaction &transaction) const;
+
+    void writeJournal(int journal_fd, const InstallTransaction &transaction);
+    bool readJournal(int dir_fd, InstallTransaction &transaction) const;
+
+    /**
+     * @brief Move the staged packages in place and the removed packages out, operations that
+     * were already done are skipped.
+     */
+    void switchPackages(const InstallTransaction &transaction) const;
+
+    std::filesystem::path stagingPath(const std::string &id) const;
+
+  private:
+    std::filesystem::path mPath;
+    std::function<void()> mCommitCallback;
+    std::string mPublicKey;
+    size_t mSyncCount{0};
+};
+
+} // namespace rose
+
+#endif /* _INSTALLER_H */
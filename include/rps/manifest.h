@@ -5,18 +5,24 @@
 #ifndef _MANIFEST_H
 #define _MANIFEST_H
 
+#include <rps/compression.h>
 #include <rps/file.h>
+#include <rps/stringarena.h>
 #include <rps/version.h>
-#include <jansson.h>
-#include <functional>
-#include <list>
-#include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace rose
 {
 
+class JsonReader;
+class ManifestView;
+
+/**
+ * The files are kept in a contiguous vector and their names in a string arena owned by the
+ * manifest, so a manifest with many files needs only a few allocations.
+ */
 class Manifest
 {
   public:
@@ -37,16 +43,42 @@ class Manifest
         VersionLabel,
         Description,
         License,
+        Compression,
         Files
     };
 
+    enum class Format { Json, Binary };
+
   public:
     Manifest();
+    Manifest(const Manifest &other);
+    Manifest(Manifest &&other) = default;
     virtual ~Manifest();
 
+    Manifest &operator=(const Manifest &other);
+    Manifest &operator=(Manifest &&other) = default;
+
+    /**
+     * @brief Read a manifest file in the JSON or the binary format.
+     */
     void readFromFile(std::string filename);
 
-    void writeManifestFile(std::string filename);
+    /**
+     * @brief Read a manifest in the JSON or the binary format from memory.
+     */
+    void readFromBuffer(const std::string &buffer);
+
+    void writeManifestFile(std::string filename, Format format = Format::Json);
+
+    /**
+     * @brief Serialize the manifest in the JSON format, as written by writeManifestFile().
+     */
+    std::string toJson() const;
+
+    /**
+     * @brief Serialize the manifest in the binary format, see ManifestView.
+     */
+    std::string toBinary() const;
 
     std::string packageName() const;
     void setPackageName(const std::string &packageName);
@@ -66,15 +98,15 @@ class Manifest
     int32_t apiMax() const;
     void setApiMax(const int32_t apiMax);
 
-    std::list<std::string> &locales();
+    std::vector<std::string> &locales();
 
     std::string targetArch() const;
     void setTargetArch(const std::string &targetArch);
 
-    void setLocales(const std::list<std::string> &locales);
+    void setLocales(const std::vector<std::string> &locales);
 
-    std::list<Dependency> dependencies() const;
-    void setDependencies(const std::list<Dependency> &dependencies);
+    const std::vector<Dependency> &dependencies() const;
+    void setDependencies(const std::vector<Dependency> &dependencies);
 
     std::string source() const;
     void setSource(const std::string &source);
@@ -94,29 +126,49 @@ class Manifest
     std::string license() const;
     void setLicense(const std::string &license);
 
-    std::list<File> &files();
-    void setFiles(const std::list<File> &files);
+    rose::Compression compression() const;
+    void setCompression(const rose::Compression &compression);
+
+    std::vector<File> &files();
+
+    /**
+     * @brief Append a file, the name is copied to the string arena of the manifest.
+     * @return the new file
+     */
+    File &addFile(std::string_view name);
+
+    /**
+     * @brief Replace the files by copies of files of another manifest.
+     *
+     * The files may also be those of this manifest or a filtered copy of them.
+     */
+    void setFiles(const std::vector<File> &files);
 
   private:
-    void handleTag(const std::string &tag, json_t value);
-
-    static std::string readStringTag(json_t *in);
-
-    static void readTagManifest(Manifest &mfst, json_t *in);
-    static void readTagName(Manifest &mfst, json_t *in);
-    static void readTagVersion(Manifest &mfst, json_t *in);
-    static void readTagAPI(Manifest &mfst, json_t *in);
-    static void readTagArch(Manifest &mfst, json_t *in);
-    static void readTagLocalization(Manifest &mfst, json_t *in);
-    static void readTagDepends(Manifest &mfst, json_t *in);
-    static void readTagSource(Manifest &mfst, json_t *in);
-    static void readTagVendor(Manifest &mfst, json_t *in);
-    static void readTagLabel(Manifest &mfst, json_t *in);
-    static void readTagVersionLabel(Manifest &mfst, json_t *in);
-    static void readTagDescription(Manifest &mfst, json_t *in);
-    static void readTagLicense(Manifest &mfst, json_t *in);
-    static void readTagFiles(Manifest &mfst, json_t *in);
-    static void readTagSignatures(Manifest &mfst, json_t *in);
+    void read(JsonReader &in);
+    void read(const ManifestView &view);
+    void read(const char *data, size_t size);
+
+    static Tag tagFromKey(std::string_view key);
+
+    static std::string readStringTag(JsonReader &in);
+
+    static void readTagManifest(Manifest &mfst, JsonReader &in);
+    static void readTagName(Manifest &mfst, JsonReader &in);
+    static void readTagVersion(Manifest &mfst, JsonReader &in);
+    static void readTagAPI(Manifest &mfst, JsonReader &in);
+    static void readTagArch(Manifest &mfst, JsonReader &in);
+    static void readTagLocalization(Manifest &mfst, JsonReader &in);
+    static void readTagDepends(Manifest &mfst, JsonReader &in);
+    static void readTagSource(Manifest &mfst, JsonReader &in);
+    static void readTagVendor(Manifest &mfst, JsonReader &in);
+    static void readTagLabel(Manifest &mfst, JsonReader &in);
+    static void readTagVersionLabel(Manifest &mfst, JsonReader &in);
+    static void readTagDescription(Manifest &mfst, JsonReader &in);
+    static void readTagLicense(Manifest &mfst, JsonReader &in);
+    static void readTagCompression(Manifest &mfst, JsonReader &in);
+    static void readTagFiles(Manifest &mfst, JsonReader &in);
+    static void readTagSignatures(Manifest &mfst, JsonReader &in);
 
   private:
     ManifestVersion mManifestVersion;
@@ -126,19 +178,17 @@ class Manifest
     int32_t mApiTarget;
     int32_t mApiMax;
     std::string mTargetArch;
-    std::list<std::string> mLocales;
-    std::list<Dependency> mDependencies;
+    std::vector<std::string> mLocales;
+    std::vector<Dependency> mDependencies;
     std::string mSource;
     std::string mVendor;
     std::string mPackageLabel; // human-readable package name
     std::string mVersionLabal; // version as shown to the user
     std::string mDescription;
     std::string mLicense;
-    std::list<File> mFiles;
-
-    static std::map<std::string, Tag> ManifestTags;
-    static std::list<std::string> ManifestTag;
-    static std::map<Tag, std::function<void(Manifest &, json_t *)>> ReadTagFunctions;
+    rose::Compression mCompression;
+    std::vector<File> mFiles;
+    StringArena mFileNames;
 };
 
 } // namespace rose
@@ -0,0 +1,113 @@
+/**
+ * @file manifestview.h
+ * @brief Read-only access to a manifest in the binary format without parsing it.
+ */
+#ifndef _MANIFESTVIEW_H
+#define _MANIFESTVIEW_H
+
+#include <rps/compression.h>
+#include <rps/file.h>
+#include <rps/version.h>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace rose
+{
+
+namespace ManifestFormat
+{
+struct Header;
+struct FileRecord;
+struct DependencyRecord;
+struct Interval;
+struct StringRef;
+} // namespace ManifestFormat
+
+/**
+ * A manifest written with Manifest::writeManifestFile() in the binary format, read in place
+ * from a buffer or a mapped file. open() only checks the header and the bounds of the sections,
+ * references into the string table are checked by the accessors. The buffer must stay valid and
+ * be aligned to 8 bytes, which is the case for mapped files and heap buffers.
+ */
+class ManifestView
+{
+  public:
+    class FileView
+    {
+      public:
+        std::string_view name() const;
+        bool hasHash() const;
+        const FileHash &hash() const;
+        uint32_t mode() const;
+
+      private:
+        friend class ManifestView;
+        FileView(const ManifestView *view, const ManifestFormat::FileRecord *file);
+
+        const ManifestView *mView;
+        const ManifestFormat::FileRecord *mFile;
+    };
+
+    ManifestView();
+
+    /**
+     * @brief Check whether a buffer starts with the magic of a binary manifest.
+     */
+    static bool isBinaryManifest(const void *data, size_t size);
+
+    /**
+     * @return false if the buffer is not a binary manifest of a supported version
+     */
+    bool open(const void *data, size_t size);
+
+    int32_t manifestVersion() const;
+    std::string_view packageName() const;
+    int32_t packageVersion() const;
+    int32_t apiMin() const;
+    int32_t apiTarget() const;
+    int32_t apiMax() const;
+    std::string_view targetArch() const;
+    std::string_view source() const;
+    std::string_view vendor() const;
+    std::string_view packageLabel() const;
+    std::string_view versionLabel() const;
+    std::string_view description() const;
+    std::string_view license() const;
+    Compression compression() const;
+
+    size_t localeCount() const;
+    std::string_view locale(size_t i) const;
+
+    size_t dependencyCount() const;
+    std::string_view dependencyName(size_t i) const;
+    size_t requiresCount(size_t i) const;
+    VersionInterval requiresInterval(size_t i, size_t j) const;
+    size_t conflictsCount(size_t i) const;
+    VersionInterval conflictsInterval(size_t i, size_t j) const;
+
+    size_t fileCount() const;
+
+    /**
+     * @brief The files in the order of the manifest.
+     */
+    FileView file(size_t i) const;
+
+    /**
+     * @brief Look up a file by name with a binary search in the index of the file names.
+     * @return false if there is no such file
+     */
+    bool findFile(std::string_view name, size_t &i) const;
+
+  private:
+    std::string_view string(const ManifestFormat::StringRef &ref) const;
+    VersionInterval interval(uint32_t index) const;
+
+  private:
+    const uint8_t *mData;
+    const ManifestFormat::Header *mHeader;
+};
+
+} // namespace rose
+
+#endif /* _MANIFESTVIEW_H */
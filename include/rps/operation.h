@@ -0,0 +1,119 @@
+/**
+ * @file operation.h
+ * @brief Progress and cancellation of package operations that run asynchronously.
+ */
+#ifndef _OPERATION_H
+#define _OPERATION_H
+
+#include <rps/exception.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rose
+{
+
+struct Progress {
+    uint64_t bytesDone;
+    /** 0 if unknown. */
+    uint64_t bytesTotal;
+    uint64_t entriesDone;
+    /** 0 if unknown. */
+    uint64_t entriesTotal;
+    /** Estimated seconds until the operation is done, negative if unknown. */
+    double eta;
+};
+
+using ProgressCallback = std::function<void(const Progress &)>;
+
+/**
+ * Runs a job, e.g. on a thread pool of the caller. The job does not throw.
+ */
+using Executor = std::function<void(std::function<void()>)>;
+
+/**
+ * Thrown by an operation that was cancelled.
+ */
+class OperationCancelled : public Exception
+{
+  public:
+    OperationCancelled() : Exception("operation cancelled") {}
+};
+
+/**
+ * The handle of an asynchronous package operation, see Package::extractAsync().
+ *
+ * The progress callback is called on the thread of the operation, at most once per
+ * ProgressInterval and once when the operation succeeded. Cancellation is cooperative, the
+ * operation stops at the next entry and removes the files and directories it created.
+ */
+class Operation
+{
+  public:
+    static constexpr std::chrono::milliseconds ProgressInterval{100};
+
+    /**
+     * @brief Ask the operation to stop, it fails with OperationCancelled.
+     */
+    void cancel();
+    bool cancelled() const;
+
+    Progress progress() const;
+
+    /**
+     * @brief Wait until the operation is done.
+     * @throws the error of the operation, OperationCancelled if it was cancelled
+     */
+    void wait() const;
+
+    /**
+     * @return a future that is ready when the operation is done
+     */
+    std::shared_future<void> future() const;
+
+  private:
+    friend class Package;
+
+    explicit Operation(ProgressCallback callback);
+
+    void start(uint64_t bytes_total, uint64_t entries_total);
+
+    /**
+     * @brief Set the progress and report it if the interval has passed.
+     * @throws OperationCancelled if the operation is cancelled
+     */
+    void update(uint64_t bytes_done, uint64_t entries_done);
+
+    /**
+     * @brief Remember a file or directory that does not exist yet, it is removed if the
+     * operation fails.
+     */
+    void addCreatedPath(const std::filesystem::path &path);
+
+    /**
+     * @brief Remove the created paths on an error, report the progress on success and complete
+     * the future.
+     */
+    void finish(std::exception_ptr error);
+
+  private:
+    ProgressCallback mCallback;
+    std::atomic<bool> mCancelled{false};
+    mutable std::mutex mMutex;
+    Progress mProgress{0, 0, 0, 0, -1};
+    std::chrono::steady_clock::time_point mStart;
+    std::chrono::steady_clock::time_point mLastReport;
+    std::vector<std::filesystem::path> mCreatedPaths;
+    std::promise<void> mPromise;
+    std::shared_future<void> mFuture;
+};
+
+} // namespace rose
+
+#endif /* _OPERATION_H */
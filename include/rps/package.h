@@ -5,12 +5,24 @@
 #ifndef _PACKAGE_H
 #define _PACKAGE_H
 #include <rps/manifest.h>
+#include <rps/operation.h>
+#include <rps/packageio.h>
+#include <sys/types.h>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
 
+struct archive;
+
 namespace rose
 {
 
+class PackageIndex;
+class Sha256;
+struct StagedFiles;
+
 class Package
 {
   public:
@@ -26,6 +38,45 @@ class Package
     void extract(const std::string &package_path = std::string(),
         const std::filesystem::path &destination = "");
 
+    /**
+     * @brief Read a package from a stream, e.g. a buffer or a socket, see extract().
+     *
+     * The package is read once from start to end, so it is not written to a file first.
+     */
+    void extract(PackageSource &source, const std::filesystem::path &destination);
+
+    /**
+     * @brief Extract a package on an executor, see extract().
+     *
+     * The progress is measured in bytes of the package file and in files of the manifest if it
+     * was read before. If the operation fails or is cancelled, the files and directories it
+     * created are removed. The Package must outlive the operation and runs one operation at a
+     * time.
+     * @param executor Runs the operation, e.g. on a thread pool shared by many packages.
+     */
+    std::shared_ptr<Operation> extractAsync(const std::string &package_path,
+        const std::filesystem::path &destination, const Executor &executor,
+        ProgressCallback callback = ProgressCallback());
+
+    /**
+     * @brief Read a single entry of a package file without extracting the package.
+     *
+     * With the index at the end of the package only the blocks containing the entry are
+     * decompressed. Packages without index are decompressed up to the entry.
+     * @param package_path Path of the *.rps file.
+     * @param name Path of the entry in the package, e.g. "manifest.json".
+     * @return the content of the entry
+     */
+    static std::string readEntry(const std::string &package_path, const std::string &name);
+
+    /**
+     * @brief Read the manifest of a package file without extracting the package.
+     * @param package_path Path of the *.rps file.
+     */
+    void readManifest(const std::string &package_path);
+
+    Manifest &manifest();
+
     /**
      * @brief Read a prackage from a source dir.
      * @param package_dir The directory with the package files.
@@ -34,22 +85,95 @@ class Package
 
     /**
      * @brief Sign a package.
-     * @param The private key to use.
+     *
+     * writePackge() signs the Merkle root of the manifest and its file hashes, see Signature, and
+     * stores the signature as entry "signature" after the manifest.
+     * @param priv_key The private key file in PEM format, Ed25519, ECDSA or RSA.
      */
     void signPackage(std::string priv_key);
 
     /**
      * @brief Verify the signature of a package.
-     * @param pub_key The public key file.
+     *
+     * Only the manifest and the signature are read, so the check costs one signature
+     * verification. A later extract() hashes each file against the verified manifest and stops at
+     * the first file that does not match. The package must have been read with readManifest()
+     * before.
+     * @param pub_key The public key file in PEM format.
+     * @throws Exception if the package is not signed or the signature does not match
      */
     void verify(std::string pub_key);
 
     /**
      * @brief Write a package file to the file system.
+     *
+     * The package is streamed to an unnamed file in the destination directory, which gets its
+     * name with linkat() and rename() when it is complete. An existing file is replaced
+     * atomically and nothing is staged outside of the destination.
      * @param dest_dir The directory to write the *.rpk file to.
      */
     void writePackge(std::filesystem::path dest_dir);
 
+    /**
+     * @brief Write a package to a stream instead of a file, e.g. to a buffer or a socket.
+     *
+     * The bytes are the same as those of the file writePackge() creates. The sink is closed
+     * after the last byte.
+     */
+    void writePackage(PackageSink &sink);
+
+    /**
+     * @brief Create the package file on an executor, see writePackge() and extractAsync().
+     *
+     * The progress is measured in bytes and files of the package directory.
+     */
+    std::shared_ptr<Operation> writePackageAsync(const std::filesystem::path &dest_dir,
+        const Executor &executor, ProgressCallback callback = ProgressCallback());
+
+    /**
+     * @brief Write a delta package that updates an installation of an older revision to this
+     * package.
+     *
+     * Files whose hash is also found in the base revision are left out. Files that exist in the
+     * base revision under the same name are stored as binary delta if that is smaller than the
+     * file, all others are stored completely. The manifest of this package is included as is.
+     * The package must have been read with readManifest() before.
+     * @param base_package Path of the *.rps file of the base revision.
+     * @param dest_dir The directory to write the delta package to.
+     * @return the path of the delta package
+     */
+    std::filesystem::path writeDelta(
+        const std::string &base_package, const std::filesystem::path &dest_dir);
+
+    /**
+     * @brief Create the new revision of a package from an extracted base revision and a delta
+     * package.
+     *
+     * All files are written to the destination under a temporary name and verified against the
+     * hashes of the new manifest.
+     * @param delta_path Path of the delta package, see writeDelta().
+     * @param base_dir Directory the base revision was extracted to.
+     * @param destination Directory the new revision is written to, must differ from base_dir.
+     */
+    void applyDelta(const std::string &delta_path, const std::filesystem::path &base_dir,
+        const std::filesystem::path &destination);
+
+    /**
+     * @brief Create the new revision of an installed package without rewriting unchanged files.
+     *
+     * The hashes of the installed manifest are compared with the manifest of the package. A file
+     * with the same content under the same name, or under another name if it moved, is
+     * hardlinked from the installed revision. Only new and changed files are extracted. The
+     * installed revision is not modified, so the destination can replace it atomically.
+     * @param package_path Path of the *.rps file.
+     * @param installed_dir Directory of the installed revision with manifest.json and data/.
+     * @param destination Directory the new revision is written to, must differ from
+     * installed_dir.
+     * @return the number of files that were extracted
+     */
+    size_t upgrade(const std::string &package_path, const std::filesystem::path &installed_dir,
+        const std::filesystem::path &destination);
+
     /**
      * @brief baseFilename
      * @return the base name of the package file
@@ -62,20 +186,138 @@ class Package
      */
     std::string filename() const;
 
+    /**
+     * @brief deltaFilename
+     * @param base_version Package version the delta applies to.
+     * @return the file name of a delta package from base_version to this package
+     */
+    std::string deltaFilename(int32_t base_version) const;
+
+    /**
+     * @brief Set the number of threads used for compression.
+     * @param threads Number of workers compressing independent blocks, 0 uses all available
+     * cores.
+     */
+    void setCompressionThreads(unsigned int threads);
+
+    /**
+     * @brief Set the number of threads writing the files of extract().
+     *
+     * The package is read by one thread, the files are created, written and get their mode and
+     * time on the workers. The data read ahead of the workers is limited, large files and
+     * entries like hard links are written by the reader.
+     * @param threads Number of workers, 1 extracts sequentially, 0 uses all available cores.
+     */
+    void setExtractThreads(unsigned int threads);
+
+    /**
+     * @brief Override the compression set in the manifest of the package.
+     * @param compression The codec and level to use.
+     */
+    void setCompression(const Compression &compression);
+
+    /**
+     * @brief Verify the files of a package while extracting it.
+     *
+     * Each file is hashed while it is written under a temporary name and only renamed to its
+     * final name if the hash matches the manifest. Files that fail are removed and extract()
+     * throws after the rest of the package has been extracted.
+     * @param verify true to enable verification
+     */
+    void setVerifyHashes(bool verify);
+
   private:
     /**
      * @brief Creates an *.rps file.
      */
-    void pack();
+    void pack(PackageSink &sink);
+
+    /**
+     * @brief Add a file to an archive that is opened for writing.
+     * @param sha If set, the content of the file is added to the hash.
+     * @return the permission bits of the entry, those of the file
+     * @throws Exception if the file cannot be read or the entry cannot be written
+     */
+    static mode_t addFile(struct archive *a, const std::string &source, const std::string &dest,
+        Sha256 *sha = nullptr, PackageIndex *index = nullptr);
 
     void unpack();
 
+    /**
+     * @brief Extract a package file or, if set, a package from a source.
+     */
+    void extractFrom(const std::string &package_path, PackageSource *source,
+        const std::filesystem::path &destination);
+
+    /**
+     * @brief Extract a package through libarchive.
+     */
+    void extractArchive(PackageSource &source, StagedFiles &staged, std::string &manifest_buffer);
+
+    /**
+     * @brief Extract an uncompressed package from a mapping of the file.
+     *
+     * The file data is not copied through user space buffers, see copyFileRange().
+     * @return false if the package is compressed or uses unsupported tar features
+     */
+    bool extractUncompressed(
+        const std::string &package_path, StagedFiles &staged, std::string &manifest_buffer);
+
+    /**
+     * @brief Add an entry to the files extracted under a temporary name if it is verified.
+     * @return true if the entry is staged
+     */
+    bool stageEntry(const std::string &pathname, bool regular_file, StagedFiles &staged);
+
+    /**
+     * @brief Check a file against the manifest of a verified signature.
+     * @return false if the signature is verified and the hash does not match
+     */
+    bool matchesVerifiedHash(const std::string &name, const FileHash &hash) const;
+
+    /**
+     * @brief Reject an entry that is not covered by a verified signature.
+     *
+     * Without a verified signature every entry is extracted.
+     * @return false if the entry is a manifest, the verified one is written instead
+     */
+    bool checkSignedEntry(const std::string &pathname, bool regular_file) const;
+
+    /**
+     * @brief The mode an entry is extracted with, the signed one if the signature is verified.
+     * @param mode The mode of the tar header.
+     */
+    mode_t entryMode(const std::string &pathname, mode_t mode) const;
+
+    /**
+     * @brief Run a job as the operation of this package.
+     */
+    std::shared_ptr<Operation> runAsync(
+        const Executor &executor, ProgressCallback callback, std::function<void()> job);
+
+    /**
+     * @brief Remember the first missing path of an extracted entry for the rollback of the
+     * operation.
+     */
+    void addCreatedPath(const std::filesystem::path &path);
+
   private:
     Manifest mManifest;
     std::filesystem::path mExtractedDir;
     std::filesystem::path mPackagePath;
     constexpr static std::string_view FileExtension{"rps"};
-    std::filesystem::path mWorkDir{"/tmp/rps"};
+    unsigned int mCompressionThreads{1};
+    unsigned int mExtractThreads{0};
+    bool mVerifyHashes{false};
+    // entries extract() leaves out, e.g. the files upgrade() links from the installed revision
+    std::set<std::string> mSkippedEntries;
+    std::string mSigningKey;
+    // the file hashes and modes of the manifest covered by a verified signature
+    bool mSignatureVerified{false};
+    std::map<std::string, FileHash, std::less<>> mVerifiedHashes;
+    std::map<std::string, mode_t, std::less<>> mVerifiedModes;
+    // the asynchronous operation that is running, progress and cancellation are checked per entry
+    std::shared_ptr<Operation> mOperation;
 };
 
 } // namespace rose
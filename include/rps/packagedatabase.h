@@ -0,0 +1,140 @@
+/**
+ * @file packagedatabase.h
+ * @brief Database of the packages installed on a device.
+ */
+#ifndef _PACKAGEDATABASE_H
+#define _PACKAGEDATABASE_H
+
+#include <rps/manifestview.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rose
+{
+
+class MappedFile;
+
+namespace PackageDatabaseFormat
+{
+struct Header;
+struct OwnerRecord;
+struct PackageRecord;
+struct StringRef;
+} // namespace PackageDatabaseFormat
+
+/**
+ * An installed package, valid as long as the database it was read from.
+ */
+struct InstalledPackage {
+    std::string_view name;
+    int32_t revision;
+    /** The package file or URL it was installed from. */
+    std::string_view source;
+    /** Seconds since the epoch. */
+    int64_t installTime;
+    ManifestView manifest;
+};
+
+/**
+ * A file claimed by two packages.
+ */
+struct FileConflict {
+    std::string path;
+    std::string package;
+    std::string owner;
+};
+
+/**
+ * The installed packages with their revision, origin and manifest in a single file that is
+ * mapped and read in place. The records are sorted by name and found with a binary search, the
+ * manifests are stored in the binary format and opened without parsing, see ManifestView. A
+ * table of the files of all packages sorted by path maps each file to its owner.
+ *
+ * The file is never modified, write() creates a new database that replaces the old one with a
+ * rename. The Installer does that as part of its transactions.
+ */
+class PackageDatabase
+{
+  public:
+    /**
+     * A package added to or replaced in the database.
+     */
+    struct Record {
+        std::string name;
+        int32_t revision;
+        std::string source;
+        int64_t installTime;
+        /** The manifest in the binary format, see Manifest::toBinary(). */
+        std::string manifest;
+    };
+
+    PackageDatabase();
+    ~PackageDatabase();
+
+    /**
+     * @return false if the file does not exist or is not a database of a supported version
+     */
+    bool open(const std::filesystem::path &path);
+
+    size_t packageCount() const;
+
+    /**
+     * @brief The packages sorted by name.
+     * @throws Exception if the record is corrupt
+     */
+    InstalledPackage package(size_t i) const;
+
+    /**
+     * @brief Look up a package by name.
+     * @return false if the package is not installed
+     */
+    bool find(std::string_view name, size_t &i) const;
+
+    /**
+     * @brief Look up the package a file belongs to with a binary search in the file table.
+     * @param path Path of the file as listed in the manifest.
+     * @param package Receives the index of the package, see package().
+     * @return false if no installed package has the file
+     */
+    bool findOwner(std::string_view path, size_t &package) const;
+
+    /**
+     * @brief Check that each file still has one owner after write() with the same changes.
+     *
+     * A file of a changed package conflicts if another changed package or an installed package
+     * that is neither changed nor removed has it.
+     * @param conflict Receives the first conflict.
+     * @return true if there is a conflict
+     */
+    bool findConflict(const std::vector<Record> &changed, const std::vector<std::string> &removed,
+        FileConflict &conflict) const;
+
+    /**
+     * @brief Write a copy of the database with packages added, replaced or removed.
+     *
+     * The path must not be the file this database is opened from.
+     * @param changed Packages to add or replace.
+     * @param removed Names of packages to remove.
+     */
+    void write(const std::filesystem::path &path, const std::vector<Record> &changed,
+        const std::vector<std::string> &removed) const;
+
+  private:
+    std::string_view string(const PackageDatabaseFormat::StringRef &ref) const;
+    const PackageDatabaseFormat::PackageRecord &record(size_t i) const;
+    const PackageDatabaseFormat::OwnerRecord &owner(size_t i) const;
+
+  private:
+    std::unique_ptr<MappedFile> mFile;
+    const uint8_t *mData;
+    const PackageDatabaseFormat::Header *mHeader;
+};
+
+} // namespace rose
+
+#endif /* _PACKAGEDATABASE_H */
@@ -0,0 +1,169 @@
+/**
+ * @file packageio.h
+ * @brief Streams packages are read from and written to.
+ */
+#ifndef _PACKAGEIO_H
+#define _PACKAGEIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace rose
+{
+
+/**
+ * A stream a package is read from, see Package::extract().
+ */
+class PackageSource
+{
+  public:
+    virtual ~PackageSource();
+
+    /**
+     * @brief Read the next bytes of the package.
+     * @return the number of bytes read, 0 at the end of the package
+     * @throws Exception on errors
+     */
+    virtual size_t read(void *buffer, size_t size) = 0;
+};
+
+/**
+ * A stream a package is written to, see Package::writePackage().
+ */
+class PackageSink
+{
+  public:
+    virtual ~PackageSink();
+
+    /**
+     * @brief Write all bytes.
+     * @throws Exception on errors
+     */
+    virtual void write(const void *data, size_t size) = 0;
+
+    /**
+     * @brief Called after the last write.
+     */
+    virtual void close();
+};
+
+/**
+ * Reads a package from a buffer that must be valid while it is read.
+ */
+class MemorySource : public PackageSource
+{
+  public:
+    MemorySource(const void *data, size_t size);
+
+    size_t read(void *buffer, size_t size) override;
+
+  private:
+    const uint8_t *mData;
+    size_t mSize;
+};
+
+/**
+ * Reads a package from a file descriptor, e.g. a pipe or a socket. The descriptor is not closed.
+ */
+class FdSource : public PackageSource
+{
+  public:
+    explicit FdSource(int fd);
+
+    size_t read(void *buffer, size_t size) override;
+
+  protected:
+    int mFd;
+};
+
+class FileSource : public FdSource
+{
+  public:
+    /**
+     * @throws Exception if the file cannot be opened
+     */
+    explicit FileSource(const std::filesystem::path &path);
+    ~FileSource();
+};
+
+/**
+ * Reads a package with a function that has the contract of PackageSource::read().
+ */
+class CallbackSource : public PackageSource
+{
+  public:
+    explicit CallbackSource(std::function<size_t(void *, size_t)> read);
+
+    size_t read(void *buffer, size_t size) override;
+
+  private:
+    std::function<size_t(void *, size_t)> mRead;
+};
+
+/**
+ * Collects a package in memory.
+ */
+class MemorySink : public PackageSink
+{
+  public:
+    void write(const void *data, size_t size) override;
+
+    const std::string &data() const;
+
+  private:
+    std::string mData;
+};
+
+/**
+ * Writes a package to a file descriptor, e.g. a pipe or a socket. The descriptor is not closed.
+ */
+class FdSink : public PackageSink
+{
+  public:
+    explicit FdSink(int fd);
+
+    void write(const void *data, size_t size) override;
+
+  protected:
+    int mFd;
+};
+
+class FileSink : public FdSink
+{
+  public:
+    /**
+     * @brief Create or truncate a file.
+     * @throws Exception if the file cannot be created
+     */
+    explicit FileSink(const std::filesystem::path &path);
+    ~FileSink();
+
+    /**
+     * @throws Exception if the file cannot be written
+     */
+    void close() override;
+
+  private:
+    std::filesystem::path mPath;
+};
+
+/**
+ * Writes a package with a function that has the contract of PackageSink::write().
+ */
+class CallbackSink : public PackageSink
+{
+  public:
+    explicit CallbackSink(std::function<void(const void *, size_t)> write);
+
+    void write(const void *data, size_t size) override;
+
+  private:
+    std::function<void(const void *, size_t)> mWrite;
+};
+
+} // namespace rose
+
+#endif /* _PACKAGEIO_H */
@@ -0,0 +1,103 @@
+/**
+ * @file packagestore.h
+ * @brief Content addressed storage of the files of installed packages.
+ */
+#ifndef _PACKAGESTORE_H
+#define _PACKAGESTORE_H
+
+#include <rps/manifest.h>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace rose
+{
+
+/**
+ * Each file of a package is stored once as object under MPK_PACKAGE_STORE/objects, named by the
+ * SHA-256 hash of its content and its mode. The files of installed packages are hardlinks to the
+ * objects, or reflinks or copies if the destination is on another file system. Files shared by
+ * packages or by revisions of a package are stored once, and installing a revision only writes
+ * the objects that are not in the store yet.
+ *
+ * The objects have the mode of the file in the manifest, 0644 for manifests without modes, so
+ * installed files get the same mode as with Package::extract(). Installed files share the inode
+ * with their object and must be replaced and not modified in place.
+ */
+class PackageStore
+{
+  public:
+    /**
+     * @param root The root of the file system the store belongs to.
+     */
+    PackageStore(const std::filesystem::path &root = "/");
+
+    /**
+     * @brief The directory of the store, root/MPK_PACKAGE_STORE.
+     */
+    std::filesystem::path path() const;
+
+    /**
+     * @brief The path of an object, objects/<first byte>/<remaining bytes>.<mode>, the hash in
+     * hex and the mode in octal.
+     */
+    std::filesystem::path objectPath(const FileHash &hash, uint32_t mode) const;
+
+    bool contains(const FileHash &hash, uint32_t mode) const;
+
+    /**
+     * @brief Install the files of a package by linking them to the objects of the store.
+     *
+     * Objects that are missing are added from the package and verified against the hash of the
+     * manifest, packages with index only decompress the blocks of the missing objects. Existing
+     * files at the destination are replaced atomically.
+     * @param package_path Path of the *.rps file.
+     * @param destination Directory receiving manifest.json and data/.
+     * @return the number of objects added to the store
+     */
+    size_t install(const std::string &package_path, const std::filesystem::path &destination);
+
+    /**
+     * @brief Remove the objects that are not linked by an installed file.
+     *
+     * Only files installed as hardlinks are seen, so this is only safe if the store and the
+     * installed packages share a file system.
+     * @return the number of removed objects
+     */
+    size_t collectGarbage();
+
+  private:
+    /**
+     * @brief The content and the mode of an installed file.
+     */
+    struct Object {
+        FileHash hash;
+        uint32_t mode;
+    };
+
+    /**
+     * @brief Create an object from data produced by a function, verified against the hash.
+     */
+    void addObject(const Object &object,
+        const std::function<void(const std::function<void(const uint8_t *, size_t)> &)> &produce);
+
+    /**
+     * @brief Create or replace a file by a link to an object.
+     */
+    void linkObject(const Object &object, const std::filesystem::path &dest) const;
+
+    /**
+     * @brief Add the objects of the files of a package.
+     * @param missing The missing objects by entry name.
+     */
+    void addObjects(const std::string &package_path, const std::map<std::string, Object> &missing);
+
+  private:
+    std::filesystem::path mPath;
+};
+
+} // namespace rose
+
+#endif /* _PACKAGESTORE_H */
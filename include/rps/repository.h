@@ -0,0 +1,63 @@
+/**
+ * @file repository.h
+ * @brief The revisions of packages available for installation.
+ */
+#ifndef _REPOSITORY_H
+#define _REPOSITORY_H
+
+#include <rps/manifest.h>
+#include <rps/version.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace rose
+{
+
+/**
+ * A repository keeps the dependencies and the source of each revision of each package. It is the
+ * input of the Resolver.
+ */
+class Repository
+{
+  public:
+    struct Revision {
+        int32_t revision;
+        std::vector<Dependency> dependencies;
+        std::string source;
+    };
+
+    /**
+     * @brief Add a revision of a package. An existing revision with the same number is replaced.
+     * @param revision The revision number, must be greater than 0.
+     * @param source The location the package can be copied from.
+     */
+    void add(const std::string &name, int32_t revision, std::vector<Dependency> dependencies,
+        const std::string &source = "");
+
+    /**
+     * @brief Add the revision described by a package manifest.
+     */
+    void add(const Manifest &manifest);
+
+    /**
+     * @brief The revisions of a package sorted by revision number, or nullptr for unknown packages.
+     */
+    const std::vector<Revision> *revisions(std::string_view name) const;
+
+    /**
+     * @brief A revision of a package, or nullptr if the revision is unknown.
+     */
+    const Revision *revision(std::string_view name, int32_t revision) const;
+
+    size_t packageCount() const;
+
+  private:
+    std::unordered_map<std::string, std::vector<Revision>> mPackages;
+};
+
+} // namespace rose
+
+#endif /* _REPOSITORY_H */
@@ -0,0 +1,76 @@
+/**
+ * @file resolver.h
+ * @brief Selection of consistent package revisions.
+ */
+#ifndef _RESOLVER_H
+#define _RESOLVER_H
+
+#include <rps/repository.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace rose
+{
+
+/**
+ * A package and a revision, revision 0 is the empty package, i.e. the package is not installed.
+ */
+struct PackageRevision {
+    std::string name;
+    int32_t revision;
+    std::string source;
+};
+
+/**
+ * The resolver selects one revision for each package, where revision 0 means the package is not
+ * installed, such that the requested revisions are selected and the requires and conflicts
+ * intervals of all selected revisions hold. A requires list that is empty does not restrict the
+ * revision of the other package, conflicts never apply to revision 0.
+ *
+ * Each revision of a package is a boolean variable and exactly one variable of a package is true.
+ * The dependencies are clauses "revision r of A is not selected or B is one of the allowed
+ * revisions", where the allowed revisions are found with a binary search per interval. Clauses
+ * are only created for the revisions the search reaches. They are solved by conflict driven
+ * clause learning, decisions follow the unsatisfied requirements of selected revisions and keep
+ * installed revisions if possible, otherwise the highest revision is chosen and packages nobody
+ * requires are not installed.
+ */
+class Resolver
+{
+  public:
+    explicit Resolver(const Repository &repository);
+
+    /**
+     * @brief Set the revision currently installed on the system.
+     *
+     * Installed revisions are kept unless a request or a dependency needs another revision.
+     * Revisions that are not part of the repository are ignored.
+     */
+    void setInstalled(const std::string &name, int32_t revision);
+
+    /**
+     * @brief Compute the changes that install the requested revisions.
+     * @param requests Packages and revisions, revision 0 removes a package.
+     * @return The packages to install or remove in the order of the getRevisions response:
+     * removals first, dependents before their dependencies, then installations with dependencies
+     * before their dependents. Packages that stay at the installed revision are not listed.
+     * @throws Exception if a request is unknown or the dependencies cannot be satisfied.
+     */
+    std::vector<PackageRevision> resolve(const std::vector<PackageRevision> &requests);
+
+    /**
+     * @brief The number of conflicts of the last resolve() call.
+     */
+    size_t conflicts() const;
+
+  private:
+    const Repository &mRepository;
+    std::map<std::string, int32_t> mInstalled;
+    size_t mConflicts{0};
+};
+
+} // namespace rose
+
+#endif /* _RESOLVER_H */
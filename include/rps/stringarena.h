@@ -0,0 +1,58 @@
+/**
+ * @file stringarena.h
+ * @brief Storage for many small strings in a few large blocks.
+ */
+#ifndef _STRINGARENA_H
+#define _STRINGARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace rose
+{
+
+/**
+ * Strings are copied back to back into blocks that are never moved or resized, so the returned
+ * views stay valid until the arena is cleared or destroyed. Moving the arena keeps the views
+ * valid, copying it does not.
+ */
+class StringArena
+{
+  public:
+    StringArena() = default;
+    /**
+     * @brief Take the blocks of another arena, which is left empty.
+     */
+    StringArena(StringArena &&other) noexcept;
+    StringArena &operator=(StringArena &&other) noexcept;
+
+    StringArena(const StringArena &) = delete;
+    StringArena &operator=(const StringArena &) = delete;
+
+    /**
+     * @brief Copy a string into the arena.
+     * @return a view of the copy, null terminated
+     */
+    std::string_view add(std::string_view s);
+
+    void clear();
+
+    /**
+     * @brief The number of bytes allocated for blocks.
+     */
+    size_t capacity() const;
+
+    static constexpr size_t BlockSize = 64 * 1024;
+
+  private:
+    std::vector<std::unique_ptr<char[]>> mBlocks;
+    size_t mCapacity{0};
+    char *mPos{nullptr};
+    size_t mAvailable{0};
+};
+
+} // namespace rose
+
+#endif /* _STRINGARENA_H */
@@ -0,0 +1,55 @@
+/**
+ * @file trace.h
+ * @brief Timing spans of the package operations and the verbosity of their messages.
+ */
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <string>
+
+namespace rose
+{
+
+/**
+ * The phases of extracting, packing and installing packages, e.g. open, header, decompress,
+ * write, hash and fsync, are recorded as spans with the bytes and entries they processed. While
+ * recording is disabled, which is the default, a span costs a single atomic load.
+ */
+class Trace
+{
+  public:
+    enum class Format {
+        /** The totals of each phase with their bytes and entries per second. */
+        Json,
+        /** The trace event format of chrome://tracing and Perfetto. */
+        Chrome
+    };
+
+    /**
+     * @brief Start or stop recording spans, the recorded spans are kept.
+     */
+    static void setEnabled(bool enabled);
+    static bool enabled();
+
+    /**
+     * @brief Write the recorded spans to a file.
+     * @throws Exception if the file cannot be written
+     */
+    static void write(const std::string &path, Format format);
+
+    /**
+     * @brief Discard the recorded spans.
+     */
+    static void clear();
+
+    /**
+     * @brief Set which messages are printed, 0 prints none, 1 one per operation and 2 also one
+     * per entry of a package or manifest.
+     */
+    static void setVerbosity(int level);
+    static int verbosity();
+};
+
+} // namespace rose
+
+#endif /* _TRACE_H */
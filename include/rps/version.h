@@ -7,8 +7,10 @@
 
 #include <stdint.h>
 #include <stdio.h>
-#include <list>
+#include <cstddef>
+#include <initializer_list>
 #include <string>
+#include <vector>
 
 namespace rose
 {
@@ -18,11 +20,83 @@ struct VersionInterval {
     int32_t end;
 };
 
+/**
+ * A set of revisions as sorted, disjoint and non-adjacent closed intervals. The starts and ends
+ * are kept in separate arrays, small sets are searched with SIMD compares of several intervals at
+ * once, larger sets with a binary search on the starts.
+ */
+class IntervalSet
+{
+  public:
+    class const_iterator
+    {
+      public:
+        const_iterator(const IntervalSet *set, size_t index) : mSet(set), mIndex(index) {}
+        VersionInterval operator*() const { return (*mSet)[mIndex]; }
+        const_iterator &operator++()
+        {
+            mIndex++;
+            return *this;
+        }
+        bool operator==(const const_iterator &other) const { return mIndex == other.mIndex; }
+        bool operator!=(const const_iterator &other) const { return mIndex != other.mIndex; }
+
+      private:
+        const IntervalSet *mSet;
+        size_t mIndex;
+    };
+
+    IntervalSet() = default;
+    IntervalSet(std::initializer_list<VersionInterval> intervals);
+
+    /**
+     * @brief Add an interval, overlapping and adjacent intervals are merged.
+     *
+     * Intervals with start > end are empty and ignored.
+     */
+    void add(const VersionInterval &interval);
+
+    bool contains(int32_t revision) const;
+
+    bool empty() const;
+
+    /**
+     * @brief The number of intervals after merging.
+     */
+    size_t size() const;
+
+    VersionInterval operator[](size_t i) const;
+    VersionInterval front() const;
+    VersionInterval back() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    IntervalSet unite(const IntervalSet &other) const;
+    IntervalSet intersect(const IntervalSet &other) const;
+
+    /**
+     * @brief All int32_t values that are not in the set.
+     */
+    IntervalSet complement() const;
+
+    bool operator==(const IntervalSet &other) const;
+    bool operator!=(const IntervalSet &other) const;
+
+  private:
+    /**
+     * @brief Append an interval that starts after all intervals of the set.
+     */
+    void append(int32_t start, int32_t end);
+
+  private:
+    std::vector<int32_t> mStarts;
+    std::vector<int32_t> mEnds;
+};
+
 struct Dependency {
     std::string name;
-    std::list<VersionInterval>
-    requires;
-    std::list<VersionInterval> conflicts;
+    IntervalSet requires;
+    IntervalSet conflicts;
 };
 
 } // namespace rose
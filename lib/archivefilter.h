@@ -0,0 +1,28 @@
+/**
+ * @file archivefilter.h
+ * @brief Mapping of compression settings to libarchive filters and libarchive error messages.
+ */
+#ifndef _ARCHIVEFILTER_H
+#define _ARCHIVEFILTER_H
+
+#include <rps/compression.h>
+#include <archive.h>
+#include <string>
+
+namespace rose
+{
+
+/**
+ * @brief Add the write filter and level of a compression setting to an archive.
+ * @return ARCHIVE_OK on success
+ */
+int addArchiveFilter(struct archive *a, const Compression &compression);
+
+/**
+ * @brief The error message of an archive, empty if libarchive has none.
+ */
+std::string archiveError(struct archive *a);
+
+} // namespace rose
+
+#endif /* _ARCHIVEFILTER_H */
@@ -0,0 +1,328 @@
+#include "sha256.h"
+#include "signature.h"
+#include <rps/manifest.h>
+#include <rps/package.h>
+#include <rps/packagedatabase.h>
+#include <rps/resolver.h>
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** Creates the JSON manifest of a package with the given number of files. */
+static std::string createManifest(int files)
+{
+    std::ostringstream out;
+    out << "{\"manifest\": \"1.0\", \"name\": \"bench\", \"version\": 1, \"files\": [";
+    for (int i = 0; i < files; i++) {
+        char hash[65];
+        for (int j = 0; j < 32; j++)
+            snprintf(hash + 2 * j, 3, "%02x", (i * 31 + j) & 0xff);
+        out << (i ? "," : "") << "{\"name\": \"usr/share/bench/dir" << i / 100 << "/file" << i
+            << ".dat\", \"hash\": \"" << hash << "\"}";
+    }
+    out << "]}";
+    return out.str();
+}
+
+static void BM_ManifestRead(benchmark::State &state)
+{
+    std::string buffer = createManifest(state.range(0));
+
+    for (auto _ : state) {
+        rose::Manifest m;
+        m.readFromBuffer(buffer);
+        benchmark::DoNotOptimize(m.files().size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ManifestRead)->Arg(1000)->Arg(50000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+static void BM_ManifestWrite(benchmark::State &state)
+{
+    auto path = std::filesystem::temp_directory_path() / "rps-bench-manifest";
+    rose::Manifest m;
+    m.readFromBuffer(createManifest(state.range(0)));
+    auto format = static_cast<rose::Manifest::Format>(state.range(1));
+
+    for (auto _ : state)
+        m.writeManifestFile(path.string(), format);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(format == rose::Manifest::Format::Json ? "json" : "binary");
+    std::filesystem::remove(path);
+}
+BENCHMARK(BM_ManifestWrite)
+    ->ArgsProduct({{1000, 100000},
+        {int(rose::Manifest::Format::Json), int(rose::Manifest::Format::Binary)}})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_ManifestTraverse(benchmark::State &state)
+{
+    std::string buffer = createManifest(state.range(0));
+
+    rose::Manifest m;
+    m.readFromBuffer(buffer);
+
+    for (auto _ : state) {
+        size_t sum = 0;
+        for (auto &f : m.files())
+            sum += f.name().size() + f.hash()[0];
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ManifestTraverse)->Arg(1000)->Arg(50000)->Unit(benchmark::kMicrosecond);
+
+/** Heap memory held by a parsed manifest. */
+static void BM_ManifestMemory(benchmark::State &state)
+{
+    std::string buffer = createManifest(state.range(0));
+
+    for (auto _ : state) {
+        size_t before = mallinfo2().uordblks;
+        rose::Manifest m;
+        m.readFromBuffer(buffer);
+        state.counters["heap_bytes"] = mallinfo2().uordblks - before;
+    }
+}
+BENCHMARK(BM_ManifestMemory)->Arg(50000)->Iterations(3)->Unit(benchmark::kMillisecond);
+
+/** Membership tests against a set of intervals, as done for each dependency check. */
+static void BM_IntervalContains(benchmark::State &state)
+{
+    rose::IntervalSet set;
+    for (int i = 0; i < state.range(0); i++)
+        set.add({i * 100, i * 100 + 49});
+
+    int32_t revision = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.contains(revision));
+        revision = (revision + 37) % (state.range(0) * 100);
+    }
+}
+BENCHMARK(BM_IntervalContains)->Arg(2)->Arg(8)->Arg(32)->Arg(1000);
+
+/**
+ * Creates a repository of packages with 10 revisions each. Every revision depends on three
+ * packages with lower index in a window around its own revision number and conflicts with the
+ * higher revisions of one of them, so selecting revision 10 everywhere is always a solution.
+ */
+static rose::Repository createRepository(int packages)
+{
+    rose::Repository repo;
+    uint32_t seed = 7;
+    for (int i = 0; i < packages; i++) {
+        for (int r = 1; r <= 10; r++) {
+            std::vector<rose::Dependency> dependencies;
+            for (int d = 0; i > 0 && d < 3; d++) {
+                seed = seed * 1103515245 + 12345;
+                rose::Dependency dependency;
+                dependency.name = "package" + std::to_string((seed >> 8) % i);
+                dependency.requires.add({std::max(1, r - 3), r + 2});
+                if (d == 0)
+                    dependency.conflicts.add({r + 3, 10});
+                dependencies.push_back(dependency);
+            }
+            repo.add("package" + std::to_string(i), r, dependencies);
+        }
+    }
+    return repo;
+}
+
+/** Install the newest revision of ten top level packages on a system with old revisions. */
+static void BM_Resolve(benchmark::State &state)
+{
+    const int packages = state.range(0);
+    rose::Repository repo = createRepository(packages);
+
+    rose::Resolver resolver(repo);
+    for (int i = 0; i < packages; i += 2)
+        resolver.setInstalled("package" + std::to_string(i), 3);
+
+    std::vector<rose::PackageRevision> requests;
+    for (int i = packages - 10; i < packages; i++)
+        requests.push_back({"package" + std::to_string(i), 10, ""});
+
+    size_t changes = 0;
+    for (auto _ : state)
+        changes = resolver.resolve(requests).size();
+    state.counters["changes"] = changes;
+    state.counters["conflicts"] = resolver.conflicts();
+}
+BENCHMARK(BM_Resolve)->Arg(10000)->Arg(50000)->Unit(benchmark::kMillisecond);
+
+static rose::PackageDatabase::Record createRecord(const std::string &name, int files)
+{
+    rose::Manifest m;
+    m.setPackageName(name);
+    m.setPackageVersion(1);
+    for (int i = 0; i < files; i++)
+        m.addFile("usr/share/" + name + "/dir" + std::to_string(i % 100) + "/file" +
+                  std::to_string(i));
+    return {name, 1, "", 0, m.toBinary()};
+}
+
+/** Check a package against the file table of 20 installed packages with 10000 files each. */
+static void BM_FileConflicts(benchmark::State &state)
+{
+    auto path = std::filesystem::temp_directory_path() / "rps-bench-database";
+    std::vector<rose::PackageDatabase::Record> installed;
+    for (int i = 0; i < 20; i++)
+        installed.push_back(createRecord("package" + std::to_string(i), 10000));
+    rose::PackageDatabase().write(path, installed, {});
+
+    rose::PackageDatabase database;
+    database.open(path);
+    std::vector<rose::PackageDatabase::Record> changed{createRecord("new", state.range(0))};
+
+    rose::FileConflict conflict;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(database.findConflict(changed, {}, conflict));
+    std::filesystem::remove(path);
+}
+BENCHMARK(BM_FileConflicts)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+static void BM_Sha256(benchmark::State &state)
+{
+    std::string data(state.range(0), 'x');
+
+    rose::Sha256 sha;
+    for (auto _ : state) {
+        sha.update(data.data(), data.size());
+        benchmark::DoNotOptimize(sha.finish());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Sha256)->Arg(256)->Arg(64 << 10)->Arg(16 << 20);
+
+/** The root that is signed, see Signature, over the hashes of a manifest. */
+static void BM_MerkleRoot(benchmark::State &state)
+{
+    rose::Manifest m;
+    m.readFromBuffer(createManifest(state.range(0)));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(rose::Signature::merkleRoot(m));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MerkleRoot)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+/** The shapes of the synthetic packages. */
+enum PackageShape { TinyFiles, HugeFiles, DeepTree };
+
+static const char *shapeName(int shape)
+{
+    static const char *names[] = {"tiny", "huge", "deep"};
+    return names[shape];
+}
+
+/**
+ * Creates the source directory of a package once per shape: 5000 files of 200 bytes, 3 files of
+ * 32 MiB, or 2000 files of 4 KiB in a tree 32 directories deep. The data compresses like text.
+ */
+static std::filesystem::path createPackageDir(int shape)
+{
+    auto dir = std::filesystem::temp_directory_path() / "rps-bench-packages" / shapeName(shape);
+    if (std::filesystem::exists(dir / "manifest.json"))
+        return dir;
+    std::filesystem::remove_all(dir);
+
+    struct {
+        int files;
+        size_t size;
+    } layout[] = {{5000, 200}, {3, 32 << 20}, {2000, 4096}};
+    auto [files, size] = layout[shape];
+
+    rose::Manifest m;
+    m.setPackageName(shapeName(shape));
+    m.setPackageVersion(1);
+    uint32_t seed = 42;
+    for (int i = 0; i < files; i++) {
+        std::string name = "usr/share/bench";
+        if (shape == DeepTree)
+            for (int d = 0; d < 32; d++)
+                name += "/d" + std::to_string((i >> (d % 8)) % 4);
+        else
+            name += "/dir" + std::to_string(i / 100);
+        name += "/file" + std::to_string(i);
+
+        std::filesystem::create_directories((dir / "data" / name).parent_path());
+        std::ofstream out(dir / "data" / name, std::ios::binary);
+        std::string data(size, ' ');
+        for (auto &c : data) {
+            seed = seed * 1103515245 + 12345;
+            c = 'a' + (seed >> 16) % 16;
+        }
+        out << data;
+        m.addFile(name);
+    }
+    m.writeManifestFile((dir / "manifest.json").string());
+    return dir;
+}
+
+static const char *codecs[] = {"none", "zstd"};
+
+static void BM_Pack(benchmark::State &state)
+{
+    auto source = createPackageDir(state.range(0));
+    auto out = std::filesystem::temp_directory_path() / "rps-bench-pack";
+    std::filesystem::create_directories(out);
+
+    uintmax_t bytes = 0;
+    for (auto _ : state) {
+        rose::Package pkg;
+        pkg.readPackageDir(source.string());
+        pkg.setCompression(rose::Compression::fromString(codecs[state.range(1)]));
+        pkg.setCompressionThreads(0);
+        pkg.writePackge(out);
+        bytes = std::filesystem::file_size(out / pkg.filename());
+    }
+    state.SetLabel(std::string(shapeName(state.range(0))) + "/" + codecs[state.range(1)]);
+    state.counters["package_bytes"] = bytes;
+    std::filesystem::remove_all(out);
+}
+BENCHMARK(BM_Pack)
+    ->ArgsProduct({{TinyFiles, HugeFiles, DeepTree}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+/** Extract a zstd package with 1 or all available threads, see Package::setExtractThreads(). */
+static void BM_Extract(benchmark::State &state)
+{
+    auto source = createPackageDir(state.range(0));
+    auto out = std::filesystem::temp_directory_path() / "rps-bench-extract";
+    std::filesystem::remove_all(out);
+    std::filesystem::create_directories(out);
+
+    rose::Package pkg;
+    pkg.readPackageDir(source.string());
+    pkg.setCompression(rose::Compression::fromString(codecs[state.range(1)]));
+    pkg.writePackge(out);
+    auto package_path = (out / pkg.filename()).string();
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(out / "extracted");
+        state.ResumeTiming();
+
+        rose::Package extracted;
+        extracted.setExtractThreads(state.range(2));
+        extracted.setVerifyHashes(true);
+        extracted.extract(package_path, out / "extracted");
+    }
+    state.SetLabel(std::string(shapeName(state.range(0))) + "/" + codecs[state.range(1)]);
+    state.SetBytesProcessed(state.iterations() * std::filesystem::file_size(package_path));
+    std::filesystem::remove_all(out);
+}
+BENCHMARK(BM_Extract)
+    ->ArgsProduct({{TinyFiles, HugeFiles, DeepTree}, {0, 1}, {1, 0}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
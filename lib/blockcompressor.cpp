@@ -0,0 +1,162 @@
+/**
+ * @file blockcompressor.cpp
+ */
+#include "blockcompressor.h"
+#include "archivefilter.h"
+#include <rps/exception.h>
+#include <algorithm>
+#include <cerrno>
+#include <string>
+#include <archive_entry.h>
+
+namespace rose
+{
+
+BlockCompressor::BlockCompressor(PackageSink &sink, const Compression &compression,
+    unsigned int threads, PackageIndex *index)
+    : mSink(sink), mCompression(compression), mPool(threads), mIndex(index)
+{
+    mBlock.reserve(BlockSize);
+}
+
+BlockCompressor::~BlockCompressor() {}
+
+int BlockCompressor::open(struct archive *a)
+{
+    return archive_write_open(a, this, nullptr, writeCallback, closeCallback);
+}
+
+la_ssize_t BlockCompressor::writeCallback(
+    struct archive *a, void *client_data, const void *buffer, size_t length)
+{
+    auto self = static_cast<BlockCompressor *>(client_data);
+    auto data = static_cast<const uint8_t *>(buffer);
+
+    try {
+        size_t remaining = length;
+        while (remaining > 0) {
+            size_t n = std::min(remaining, BlockSize - self->mBlock.size());
+            self->mBlock.insert(self->mBlock.end(), data, data + n);
+            data += n;
+            remaining -= n;
+
+            if (self->mBlock.size() == BlockSize)
+                self->submitBlock();
+        }
+
+        // bound the memory used by blocks in flight
+        while (self->mPending.size() > 2 * self->mPool.size())
+            self->writeResult();
+    } catch (const std::exception &e) {
+        archive_set_error(a, EIO, "%s", e.what());
+        return -1;
+    }
+
+    return length;
+}
+
+int BlockCompressor::closeCallback(struct archive *a, void *client_data)
+{
+    auto self = static_cast<BlockCompressor *>(client_data);
+
+    try {
+        if (!self->mBlock.empty())
+            self->submitBlock();
+
+        while (!self->mPending.empty())
+            self->writeResult();
+
+        if (self->mIndex)
+            self->writeData(self->mIndex->serialize());
+        self->mSink.close();
+    } catch (const std::exception &e) {
+        archive_set_error(a, EIO, "%s", e.what());
+        return ARCHIVE_FATAL;
+    }
+
+    return ARCHIVE_OK;
+}
+
+void BlockCompressor::submitBlock()
+{
+    auto block = std::make_shared<std::vector<uint8_t>>(std::move(mBlock));
+    auto job = [block, compression = mCompression]() { return compressBlock(*block, compression); };
+    mPending.emplace_back(mPool.submit(job), block->size());
+
+    mBlock = std::vector<uint8_t>();
+    mBlock.reserve(BlockSize);
+}
+
+void BlockCompressor::writeResult()
+{
+    std::vector<uint8_t> stream = mPending.front().first.get();
+    size_t uncompressed_size = mPending.front().second;
+    mPending.pop_front();
+
+    if (mIndex)
+        mIndex->addBlock(
+            {mCompressedOffset, stream.size(), mUncompressedOffset, uncompressed_size});
+    mCompressedOffset += stream.size();
+    mUncompressedOffset += uncompressed_size;
+
+    writeData(stream);
+}
+
+void BlockCompressor::writeData(const std::vector<uint8_t> &data)
+{
+    mSink.write(data.data(), data.size());
+}
+
+static la_ssize_t appendCallback(
+    struct archive *, void *client_data, const void *buffer, size_t length)
+{
+    auto out = static_cast<std::vector<uint8_t> *>(client_data);
+    auto data = static_cast<const uint8_t *>(buffer);
+    out->insert(out->end(), data, data + length);
+    return length;
+}
+
+std::vector<uint8_t> BlockCompressor::compressBlock(
+    const std::vector<uint8_t> &block, const Compression &compression)
+{
+    if (compression.codec == Compression::Codec::None)
+        return block;
+
+    std::vector<uint8_t> out;
+
+    struct archive *a = archive_write_new();
+    if (addArchiveFilter(a, compression) != ARCHIVE_OK) {
+        std::string error = archiveError(a);
+        archive_write_free(a);
+        throw Exception("cannot set compression " + compression.toString() + ": " + error);
+    }
+    archive_write_set_format_raw(a);
+    // no padding, the streams are concatenated
+    archive_write_set_bytes_per_block(a, 0);
+
+    if (archive_write_open(a, &out, nullptr, appendCallback, nullptr) != ARCHIVE_OK) {
+        std::string error = archiveError(a);
+        archive_write_free(a);
+        throw Exception("cannot open block compressor: " + error);
+    }
+
+    struct archive_entry *entry = archive_entry_new();
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_size(entry, block.size());
+
+    if (archive_write_header(a, entry) != ARCHIVE_OK ||
+        archive_write_data(a, block.data(), block.size()) < 0 ||
+        archive_write_close(a) != ARCHIVE_OK) {
+        std::string error = archiveError(a);
+        archive_entry_free(entry);
+        archive_write_free(a);
+        throw Exception("block compression failed: " + error);
+    }
+
+    archive_entry_free(entry);
+    archive_write_free(a);
+
+    return out;
+}
+
+} // namespace rose
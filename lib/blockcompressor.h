@@ -0,0 +1,74 @@
+/**
+ * @file blockcompressor.h
+ * @brief Parallel compression of an archive stream in independent blocks.
+ */
+#ifndef _BLOCKCOMPRESSOR_H
+#define _BLOCKCOMPRESSOR_H
+
+#include "packageindex.h"
+#include "threadpool.h"
+#include <rps/compression.h>
+#include <rps/packageio.h>
+#include <archive.h>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <vector>
+
+namespace rose
+{
+
+/**
+ * The uncompressed output of an archive is cut into blocks of BlockSize bytes. Each block is
+ * compressed as a complete stream of the selected codec on a worker thread and the streams are
+ * written to the sink in order. Concatenated streams are read back by libarchive like a single
+ * stream. Blocks of the codec "none" are written unchanged.
+ */
+class BlockCompressor
+{
+  public:
+    /**
+     * @param sink Receives the compressed blocks, it is closed with the archive.
+     * @param index If set, the blocks are added to the index and the index is appended to the
+     * sink after the last block.
+     */
+    BlockCompressor(PackageSink &sink, const Compression &compression, unsigned int threads,
+        PackageIndex *index = nullptr);
+    ~BlockCompressor();
+
+    /**
+     * @brief Use the compressor as output of an archive.
+     * @param a An archive with a format but without a filter set.
+     * @return ARCHIVE_OK on success
+     */
+    int open(struct archive *a);
+
+    static constexpr size_t BlockSize = 1024 * 1024;
+
+  private:
+    static la_ssize_t writeCallback(
+        struct archive *a, void *client_data, const void *buffer, size_t length);
+    static int closeCallback(struct archive *a, void *client_data);
+
+    void submitBlock();
+    void writeResult();
+    void writeData(const std::vector<uint8_t> &data);
+
+    static std::vector<uint8_t> compressBlock(
+        const std::vector<uint8_t> &block, const Compression &compression);
+
+  private:
+    PackageSink &mSink;
+    Compression mCompression;
+    ThreadPool mPool;
+    PackageIndex *mIndex;
+    std::vector<uint8_t> mBlock;
+    std::deque<std::pair<std::future<std::vector<uint8_t>>, size_t>> mPending;
+    uint64_t mUncompressedOffset{0};
+    uint64_t mCompressedOffset{0};
+};
+
+} // namespace rose
+
+#endif /* _BLOCKCOMPRESSOR_H */
@@ -0,0 +1,99 @@
+/**
+ * @file compression.cpp
+ */
+#include "rps/compression.h"
+#include "archivefilter.h"
+#include <rps/exception.h>
+#include <map>
+
+namespace rose
+{
+
+static const std::map<std::string, Compression::Codec> CodecNames{
+    {"none", Compression::Codec::None}, {"bzip2", Compression::Codec::Bzip2},
+    {"gzip", Compression::Codec::Gzip}, {"xz", Compression::Codec::Xz},
+    {"zstd", Compression::Codec::Zstd}, {"lz4", Compression::Codec::Lz4}};
+
+Compression Compression::fromString(const std::string &str)
+{
+    Compression c;
+
+    const auto colon_pos = str.find(':');
+    c.codec = codecFromName(str.substr(0, colon_pos));
+    if (colon_pos != std::string::npos) {
+        try {
+            c.level = std::stoi(str.substr(colon_pos + 1));
+        } catch (const std::exception &) {
+            throw Exception("invalid compression level: " + str);
+        }
+    }
+
+    return c;
+}
+
+std::string Compression::toString() const
+{
+    if (level == 0)
+        return codecName(codec);
+
+    return codecName(codec) + ":" + std::to_string(level);
+}
+
+Compression::Codec Compression::codecFromName(const std::string &name)
+{
+    auto it = CodecNames.find(name);
+    if (it == CodecNames.end())
+        throw Exception("unknown compression codec: " + name);
+
+    return it->second;
+}
+
+std::string Compression::codecName(Codec codec)
+{
+    for (auto &i : CodecNames) {
+        if (i.second == codec)
+            return i.first;
+    }
+
+    return std::string();
+}
+
+int addArchiveFilter(struct archive *a, const Compression &compression)
+{
+    int r = ARCHIVE_FATAL;
+
+    switch (compression.codec) {
+    case Compression::Codec::None:
+        r = archive_write_add_filter_none(a);
+        break;
+    case Compression::Codec::Bzip2:
+        r = archive_write_add_filter_bzip2(a);
+        break;
+    case Compression::Codec::Gzip:
+        r = archive_write_add_filter_gzip(a);
+        break;
+    case Compression::Codec::Xz:
+        r = archive_write_add_filter_xz(a);
+        break;
+    case Compression::Codec::Zstd:
+        r = archive_write_add_filter_zstd(a);
+        break;
+    case Compression::Codec::Lz4:
+        r = archive_write_add_filter_lz4(a);
+        break;
+    }
+
+    if (r != ARCHIVE_OK || compression.level == 0 || compression.codec == Compression::Codec::None)
+        return r;
+
+    return archive_write_set_filter_option(
+        a, nullptr, "compression-level", std::to_string(compression.level).c_str());
+}
+
+std::string archiveError(struct archive *a)
+{
+    const char *error = archive_error_string(a);
+    return error ? error : std::string();
+}
+
+} // namespace rose
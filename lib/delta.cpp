@@ -0,0 +1,171 @@
+/**
+ * @file delta.cpp
+ */
+#include "delta.h"
+#include <rps/exception.h>
+#include <cstring>
+#include <unordered_map>
+
+#define DELTA_MAGIC "RPSD"
+#define DELTA_VERSION 1
+#define DELTA_OP_COPY 0
+#define DELTA_OP_INSERT 1
+
+/** Size of the blocks of the old file that are indexed, also the shortest match. */
+#define DELTA_BLOCKSIZE 32
+
+namespace rose
+{
+
+static void putVarint(std::vector<uint8_t> &out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+static uint64_t getVarint(const uint8_t *&p, const uint8_t *end)
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p >= end)
+            throw Exception("truncated delta");
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+    throw Exception("invalid delta");
+}
+
+/** Polynomial rolling hash over DELTA_BLOCKSIZE bytes. */
+class RollingHash
+{
+  public:
+    RollingHash()
+    {
+        mOutFactor = 1;
+        for (int i = 0; i < DELTA_BLOCKSIZE - 1; i++)
+            mOutFactor *= Base;
+    }
+
+    uint64_t init(const uint8_t *p)
+    {
+        mHash = 0;
+        for (int i = 0; i < DELTA_BLOCKSIZE; i++)
+            mHash = mHash * Base + p[i];
+        return mHash;
+    }
+
+    uint64_t roll(uint8_t out, uint8_t in)
+    {
+        mHash = (mHash - out * mOutFactor) * Base + in;
+        return mHash;
+    }
+
+  private:
+    static constexpr uint64_t Base = 0x100000001b3ULL;
+    uint64_t mHash{0};
+    uint64_t mOutFactor;
+};
+
+static void emitInsert(std::vector<uint8_t> &out, const uint8_t *data, size_t length)
+{
+    if (length == 0)
+        return;
+    out.push_back(DELTA_OP_INSERT);
+    putVarint(out, length);
+    out.insert(out.end(), data, data + length);
+}
+
+std::vector<uint8_t> createDelta(
+    const uint8_t *old_data, size_t old_size, const uint8_t *new_data, size_t new_size)
+{
+    std::vector<uint8_t> out(DELTA_MAGIC, DELTA_MAGIC + 4);
+    out.push_back(DELTA_VERSION);
+
+    RollingHash hash;
+
+    // first occurence of each aligned block of the old file
+    std::unordered_map<uint64_t, size_t> blocks;
+    blocks.reserve(old_size / DELTA_BLOCKSIZE);
+    for (size_t i = 0; i + DELTA_BLOCKSIZE <= old_size; i += DELTA_BLOCKSIZE)
+        blocks.emplace(hash.init(old_data + i), i);
+
+    size_t literal_start = 0;
+    size_t pos = 0;
+    uint64_t h = new_size >= DELTA_BLOCKSIZE ? hash.init(new_data) : 0;
+
+    while (pos + DELTA_BLOCKSIZE <= new_size) {
+        auto it = blocks.find(h);
+        if (it != blocks.end() &&
+            memcmp(old_data + it->second, new_data + pos, DELTA_BLOCKSIZE) == 0) {
+            size_t old_pos = it->second;
+            size_t length = DELTA_BLOCKSIZE;
+
+            // extend the match in both directions
+            while (old_pos + length < old_size && pos + length < new_size &&
+                   old_data[old_pos + length] == new_data[pos + length])
+                length++;
+            while (old_pos > 0 && pos > literal_start &&
+                   old_data[old_pos - 1] == new_data[pos - 1]) {
+                old_pos--;
+                pos--;
+                length++;
+            }
+
+            emitInsert(out, new_data + literal_start, pos - literal_start);
+            out.push_back(DELTA_OP_COPY);
+            putVarint(out, old_pos);
+            putVarint(out, length);
+
+            pos += length;
+            literal_start = pos;
+            if (pos + DELTA_BLOCKSIZE <= new_size)
+                h = hash.init(new_data + pos);
+            continue;
+        }
+
+        if (pos + DELTA_BLOCKSIZE < new_size)
+            h = hash.roll(new_data[pos], new_data[pos + DELTA_BLOCKSIZE]);
+        pos++;
+    }
+
+    emitInsert(out, new_data + literal_start, new_size - literal_start);
+
+    return out;
+}
+
+void applyDelta(const uint8_t *old_data, size_t old_size, const uint8_t *delta, size_t delta_size,
+    const std::function<void(const uint8_t *, size_t)> &write)
+{
+    const uint8_t *p = delta;
+    const uint8_t *end = delta + delta_size;
+
+    if (delta_size < 5 || memcmp(p, DELTA_MAGIC, 4) != 0 || p[4] != DELTA_VERSION)
+        throw Exception("invalid delta");
+    p += 5;
+
+    while (p < end) {
+        uint8_t op = *p++;
+        if (op == DELTA_OP_COPY) {
+            uint64_t offset = getVarint(p, end);
+            uint64_t length = getVarint(p, end);
+            if (offset > old_size || length > old_size - offset)
+                throw Exception("delta does not match the old file");
+            write(old_data + offset, length);
+        } else if (op == DELTA_OP_INSERT) {
+            uint64_t length = getVarint(p, end);
+            if (length > uint64_t(end - p))
+                throw Exception("truncated delta");
+            write(p, length);
+            p += length;
+        } else {
+            throw Exception("invalid delta");
+        }
+    }
+}
+
+} // namespace rose
@@ -0,0 +1,41 @@
+/**
+ * @file delta.h
+ * @brief Binary differences between two revisions of a file.
+ *
+ * A delta is a sequence of instructions that rebuild the new file from the old one:
+ *
+ *     char[4] "RPSD", uint8 version
+ *     COPY:   uint8 0, varint offset in the old file, varint length
+ *     INSERT: uint8 1, varint length, data
+ *
+ * Matches are found with a rolling hash over the new file against a table of the hashes of all
+ * aligned blocks of the old file, which takes linear time and memory proportional to the size of
+ * the old file divided by the block size.
+ */
+#ifndef _DELTA_H
+#define _DELTA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace rose
+{
+
+/**
+ * @brief Calculate the delta from old to new.
+ */
+std::vector<uint8_t> createDelta(
+    const uint8_t *old_data, size_t old_size, const uint8_t *new_data, size_t new_size);
+
+/**
+ * @brief Rebuild a file from the old revision and a delta.
+ * @param write Called with consecutive parts of the new file.
+ */
+void applyDelta(const uint8_t *old_data, size_t old_size, const uint8_t *delta, size_t delta_size,
+    const std::function<void(const uint8_t *, size_t)> &write);
+
+} // namespace rose
+
+#endif /* _DELTA_H */
@@ -0,0 +1,74 @@
+/**
+ * @file entrywriter.cpp
+ */
+#include "entrywriter.h"
+#include <utility>
+
+namespace rose
+{
+
+EntryWriter::EntryWriter(unsigned int threads, size_t max_buffered) : mMaxBuffered(max_buffered)
+{
+    if (threads != 1)
+        mPool = std::make_unique<ThreadPool>(threads);
+}
+
+EntryWriter::~EntryWriter()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    waitIdle(lock);
+}
+
+void EntryWriter::waitIdle(std::unique_lock<std::mutex> &lock)
+{
+    mDone.wait(lock, [this]() { return mPending == 0; });
+}
+
+void EntryWriter::submit(size_t buffered, std::function<void()> job)
+{
+    if (!mPool) {
+        job();
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.wait(lock, [&]() {
+            return mPending == 0 || mError || mBuffered + buffered <= mMaxBuffered;
+        });
+        mBuffered += buffered;
+        mPending++;
+    }
+
+    mPool->submit([this, buffered, job = std::move(job)]() {
+        std::exception_ptr error;
+        try {
+            job();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (error && !mError)
+            mError = error;
+        mBuffered -= buffered;
+        mPending--;
+        mDone.notify_all();
+    });
+}
+
+bool EntryWriter::failed()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mError != nullptr;
+}
+
+void EntryWriter::wait()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    waitIdle(lock);
+    if (mError)
+        std::rethrow_exception(std::exchange(mError, nullptr));
+}
+
+} // namespace rose
@@ -0,0 +1,76 @@
+/**
+ * @file entrywriter.h
+ * @brief Concurrent writing of the extracted entries of a package.
+ */
+#ifndef _ENTRYWRITER_H
+#define _ENTRYWRITER_H
+
+#include "threadpool.h"
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace rose
+{
+
+/**
+ * Runs the jobs that create the files of a package on a pool of workers while the package is
+ * read, so the open, write, chmod and utimens calls of independent entries overlap. Each job may
+ * hold a buffer of entry data, submit() blocks while the buffers of the queued jobs exceed a
+ * limit.
+ */
+class EntryWriter
+{
+  public:
+    /**
+     * @param threads Number of workers, 1 runs the jobs in submit(), 0 uses all available cores.
+     * @param max_buffered Limit of the bytes held by queued jobs, a single larger job is queued
+     * when no other job is pending.
+     */
+    EntryWriter(unsigned int threads, size_t max_buffered);
+
+    /**
+     * @brief Wait for the queued jobs, their errors are ignored.
+     */
+    ~EntryWriter();
+
+    EntryWriter(const EntryWriter &) = delete;
+    EntryWriter &operator=(const EntryWriter &) = delete;
+
+    /**
+     * @brief Queue a job.
+     * @param buffered The bytes held by the job until it is done.
+     */
+    void submit(size_t buffered, std::function<void()> job);
+
+    /**
+     * @return true if a job failed, the reader can stop queueing jobs
+     */
+    bool failed();
+
+    /**
+     * @brief Wait for the queued jobs.
+     * @throws the exception of the first job that failed
+     */
+    void wait();
+
+  private:
+    void waitIdle(std::unique_lock<std::mutex> &lock);
+
+  private:
+    size_t mMaxBuffered;
+    size_t mBuffered{0};
+    size_t mPending{0};
+    std::exception_ptr mError;
+    std::mutex mMutex;
+    std::condition_variable mDone;
+    // destroyed first, the workers are joined while the mutex is valid
+    std::unique_ptr<ThreadPool> mPool;
+};
+
+} // namespace rose
+
+#endif /* _ENTRYWRITER_H */
@@ -18,14 +18,24 @@ namespace rose
 
 File::File() {}
 
+File::File(std::string_view name) : mName(name) {}
+
 File::~File() {}
 
-std::string File::name() const { return mName; }
+std::string_view File::name() const { return mName; }
+
+const FileHash &File::hash() const { return mHash; }
 
-void File::setName(const std::string &name) { mName = name; }
+bool File::hasHash() const { return mHasHash; }
+
+void File::setHash(const FileHash &hash)
+{
+    mHash = hash;
+    mHasHash = true;
+}
 
-const std::vector<uint8_t> &File::hash() const { return mHash; }
+uint32_t File::mode() const { return mMode; }
 
-void File::setHash(const std::vector<uint8_t> &hash) { mHash = hash; }
+void File::setMode(uint32_t mode) { mMode = mode & 07777; }
 
 } // namespace rose
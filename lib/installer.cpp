@@ -0,0 +1,533 @@
+/**
+ * @file installer.cpp
+ */
+#include "rps/installer.h"
+#include "sha256.h"
+#include "stringhelper.h"
+#include "threadpool.h"
+#include "tracespan.h"
+#include <rps/defines.h>
+#include <rps/exception.h>
+#include <rps/manifest.h>
+#include <rps/package.h>
+#include <rps/packagedatabase.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <set>
+#include <sstream>
+
+#define INSTALLER_DATABASE ".database"
+#define INSTALLER_JOURNAL ".journal"
+#define INSTALLER_STAGING ".staging"
+
+namespace rose
+{
+
+struct InstallTransaction {
+    enum class Type { Install, Remove };
+
+    struct Operation {
+        Type type;
+        std::string name;
+        int32_t revision;
+    };
+
+    std::string id;
+    std::vector<Operation> operations;
+    // the database records of the installed packages
+    std::vector<PackageDatabase::Record> records;
+};
+
+/**
+ * @brief Exclusive lock on the apps directory, serializes the transactions of all processes.
+ */
+class DirectoryLock
+{
+  public:
+    explicit DirectoryLock(const std::filesystem::path &path)
+    {
+        // a directory that cannot be created fails to open
+        std::error_code ec;
+        std::filesystem::create_directories(path, ec);
+        mFd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (mFd < 0 || flock(mFd, LOCK_EX) != 0) {
+            if (mFd >= 0)
+                ::close(mFd);
+            throw Exception("cannot lock directory: " + path.string());
+        }
+    }
+    ~DirectoryLock() { ::close(mFd); }
+
+    DirectoryLock(const DirectoryLock &) = delete;
+    DirectoryLock &operator=(const DirectoryLock &) = delete;
+
+    int fd() const { return mFd; }
+
+  private:
+    int mFd;
+};
+
+static void checkPackageName(const std::string &name)
+{
+    // names become directory names next to the journal and staging directory
+    if (name.empty() || name[0] == '.' || name.find_first_of("/ \t\n") != std::string::npos)
+        throw Exception("invalid package name: " + name);
+}
+
+static int32_t readRevision(const std::filesystem::path &package_dir)
+{
+    Manifest manifest;
+    try {
+        manifest.readFromFile((package_dir / "manifest.json").string());
+    } catch (...) {
+        return 0;
+    }
+    return manifest.packageVersion();
+}
+
+static std::string journalChecksum(const std::string &content)
+{
+    Sha256 sha;
+    sha.update(content.data(), content.size());
+    FileHash hash = sha.finish();
+
+    char hex[2 * MPK_FILEHASH_SIZE];
+    write_hexstr(hex, hash.data(), hash.size());
+    return std::string(hex, sizeof(hex));
+}
+
+/**
+ * @brief A package passing the fetch, verify and extract stages of the install pipeline.
+ */
+struct PipelinedPackage {
+    PackageRevision request;
+    std::string path;
+    Package package;
+    bool changed{false};
+};
+
+/**
+ * @brief Resolve the source of a package to a local file and read it into the page cache.
+ *
+ * Sources are paths or file:// URLs.
+ */
+static void fetchPackage(PipelinedPackage &p)
+{
+    TraceSpan span("fetch");
+    const std::string &source = p.request.source;
+    if (source.compare(0, 7, "file://") == 0)
+        p.path = source.substr(7);
+    else if (source.find("://") == std::string::npos)
+        p.path = source;
+    else
+        throw Exception("unsupported package source: " + source);
+
+    int fd = ::open(p.path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0)
+            ::close(fd);
+        throw Exception("cannot open package: " + source);
+    }
+    readahead(fd, 0, st.st_size);
+    ::close(fd);
+}
+
+static std::string newTransactionId()
+{
+    return std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+}
+
+static void renamePath(const std::filesystem::path &from, const std::filesystem::path &to)
+{
+    if (::rename(from.c_str(), to.c_str()) != 0)
+        throw Exception("cannot rename " + from.string() + " to " + to.string());
+}
+
+Installer::Installer(const std::filesystem::path &root) : mPath(root / MPK_APPS_DIR) {}
+
+std::filesystem::path Installer::path() const { return mPath; }
+
+std::filesystem::path Installer::databasePath() const { return mPath / INSTALLER_DATABASE; }
+
+int32_t Installer::installedRevision(const std::string &name) const
+{
+    PackageDatabase database;
+    size_t i;
+    if (!database.open(databasePath()))
+        return readRevision(mPath / name);
+    return database.find(name, i) ? database.package(i).revision : 0;
+}
+
+size_t Installer::install(const std::vector<std::string> &sources)
+{
+    std::vector<PackageRevision> installs;
+    for (auto &source : sources)
+        installs.push_back({std::string(), 0, source});
+    return run(installs, {});
+}
+
+size_t Installer::remove(const std::vector<std::string> &names) { return run({}, names); }
+
+size_t Installer::apply(const std::vector<PackageRevision> &changes)
+{
+    std::vector<PackageRevision> installs;
+    std::vector<std::string> removals;
+    for (auto &change : changes) {
+        if (change.revision == 0)
+            removals.push_back(change.name);
+        else
+            installs.push_back(change);
+    }
+    return run(installs, removals);
+}
+
+size_t Installer::run(
+    const std::vector<PackageRevision> &installs, const std::vector<std::string> &removals)
+{
+    DirectoryLock lock(mPath);
+    recover(lock.fd());
+    mSyncCount = 0;
+
+    InstallTransaction transaction;
+    transaction.id = newTransactionId();
+    auto staging = stagingPath(transaction.id);
+    std::error_code ec;
+    if (!std::filesystem::create_directories(staging, ec) && ec)
+        throw Exception("cannot create " + staging.string() + ": " + ec.message());
+
+    try {
+        for (auto &name : removals) {
+            checkPackageName(name);
+            int32_t revision = installedRevision(name);
+            if (revision == 0)
+                throw Exception("package is not installed: " + name);
+            transaction.operations.push_back({InstallTransaction::Type::Remove, name, revision});
+        }
+        stagePackages(installs, transaction);
+
+        // the new database is staged with the packages and switched with them
+        if (!transaction.operations.empty())
+            writeDatabase(transaction);
+    } catch (...) {
+        std::filesystem::remove_all(staging, ec);
+        throw;
+    }
+
+    return commit(lock.fd(), transaction);
+}
+
+void Installer::stagePackages(
+    const std::vector<PackageRevision> &installs, InstallTransaction &transaction)
+{
+    if (installs.empty())
+        return;
+
+    auto staging = stagingPath(transaction.id);
+    std::set<std::string> names;
+    for (auto &op : transaction.operations)
+        names.insert(op.name);
+
+    std::vector<PipelinedPackage> packages(installs.size());
+    for (size_t i = 0; i < installs.size(); i++)
+        packages[i].request = installs[i];
+
+    auto verify = [&](PipelinedPackage &p) {
+        TraceSpan span("verify");
+        p.package.readManifest(p.path);
+        if (!mPublicKey.empty())
+            p.package.verify(mPublicKey);
+        auto &manifest = p.package.manifest();
+        std::string name = manifest.packageName();
+        checkPackageName(name);
+        if (!p.request.name.empty() &&
+            (name != p.request.name || manifest.packageVersion() != p.request.revision))
+            throw Exception("package " + p.request.source + " is not revision " +
+                            std::to_string(p.request.revision) + " of " + p.request.name);
+        for (auto &f : manifest.files())
+            if (!f.hasHash())
+                throw Exception("package has no file hashes: " + p.request.source);
+        if (!names.insert(name).second)
+            throw Exception("package is changed twice: " + name);
+
+        // the switch tells a staged package from a replaced one by its revision
+        p.changed = manifest.packageVersion() != installedRevision(name);
+    };
+
+    auto extract = [&](PipelinedPackage &p) {
+        if (!p.changed)
+            return;
+        // files of the installed revision are linked instead of extracted again
+        TraceSpan span("stage");
+        std::string name = p.package.manifest().packageName();
+        p.package.setVerifyHashes(true);
+        p.package.upgrade(p.path, mPath / name, staging / name);
+    };
+
+    // package i is fetched in step i, verified in step i + 1 and extracted in step i + 2, so at
+    // most three packages are in flight
+    ThreadPool pool(2);
+    for (size_t step = 0; step < packages.size() + 2; step++) {
+        std::future<void> fetching, verifying;
+        if (step < packages.size())
+            fetching = pool.submit([&packages, step] { fetchPackage(packages[step]); });
+        if (step >= 1 && step - 1 < packages.size())
+            verifying = pool.submit([&packages, &verify, step] { verify(packages[step - 1]); });
+
+        // the futures reference the packages, they are waited for before an error is thrown
+        std::exception_ptr error;
+        try {
+            if (step >= 2)
+                extract(packages[step - 2]);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        for (auto *f : {&fetching, &verifying}) {
+            try {
+                if (f->valid())
+                    f->get();
+            } catch (...) {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    for (auto &p : packages) {
+        if (!p.changed)
+            continue;
+        auto &manifest = p.package.manifest();
+        transaction.operations.push_back({InstallTransaction::Type::Install,
+            manifest.packageName(), manifest.packageVersion()});
+        transaction.records.push_back({manifest.packageName(), manifest.packageVersion(),
+            p.request.source, std::time(nullptr), manifest.toBinary()});
+    }
+}
+
+void Installer::writeDatabase(const InstallTransaction &transaction) const
+{
+    auto staging = stagingPath(transaction.id);
+    PackageDatabase database;
+    std::vector<std::string> removed;
+
+    // packages installed before there was a database are indexed from their directories first,
+    // so their files are checked for conflicts like those of the database
+    if (!database.open(databasePath())) {
+        std::vector<PackageDatabase::Record> scanned;
+        std::error_code ec;
+        for (auto &e : std::filesystem::directory_iterator(mPath, ec)) {
+            std::string name = e.path().filename().string();
+            Manifest manifest;
+            try {
+                if (name[0] == '.' || !e.is_directory())
+                    continue;
+                manifest.readFromFile((e.path() / "manifest.json").string());
+            } catch (...) {
+                continue;
+            }
+            scanned.push_back({name, manifest.packageVersion(), "", 0, manifest.toBinary()});
+        }
+
+        auto scanned_path = staging / (INSTALLER_DATABASE ".scanned");
+        database.write(scanned_path, scanned, {});
+        if (!database.open(scanned_path))
+            throw Exception("cannot read package database: " + scanned_path.string());
+        std::filesystem::remove(scanned_path, ec);
+    }
+
+    for (auto &op : transaction.operations)
+        if (op.type == InstallTransaction::Type::Remove)
+            removed.push_back(op.name);
+
+    FileConflict conflict;
+    if (database.findConflict(transaction.records, removed, conflict))
+        throw Exception("file " + conflict.path + " of package " + conflict.package +
+                        " belongs to package " + conflict.owner);
+
+    database.write(staging / INSTALLER_DATABASE, transaction.records, removed);
+}
+
+bool Installer::recover()
+{
+    DirectoryLock lock(mPath);
+    return recover(lock.fd());
+}
+
+bool Installer::recover(int dir_fd)
+{
+    InstallTransaction transaction;
+    std::error_code ec;
+    bool committed = readJournal(dir_fd, transaction) &&
+                     std::filesystem::exists(stagingPath(transaction.id), ec);
+    if (committed)
+        switchPackages(transaction);
+
+    // the staging directory only holds replaced trees and transactions that never committed
+    std::filesystem::remove_all(mPath / INSTALLER_STAGING, ec);
+    if (ec)
+        throw Exception("cannot remove " + (mPath / INSTALLER_STAGING).string() + ": " +
+                        ec.message());
+    return committed;
+}
+
+size_t Installer::commit(int dir_fd, const InstallTransaction &transaction)
+{
+    auto staging = stagingPath(transaction.id);
+    std::error_code ec;
+    if (transaction.operations.empty()) {
+        std::filesystem::remove_all(staging, ec);
+        return 0;
+    }
+
+    // the journal is created before the sync, so that its directory entry is durable as well
+    int journal_fd = openat(dir_fd, INSTALLER_JOURNAL, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (journal_fd < 0)
+        throw Exception("cannot open journal in " + mPath.string());
+
+    // one syncfs() flushes all staged files, together with the switch of the last transaction
+    int synced;
+    {
+        TraceSpan span("fsync");
+        synced = syncfs(dir_fd);
+    }
+    if (synced != 0) {
+        ::close(journal_fd);
+        throw Exception("cannot sync " + mPath.string());
+    }
+    mSyncCount++;
+
+    try {
+        writeJournal(journal_fd, transaction);
+    } catch (...) {
+        ::close(journal_fd);
+        throw;
+    }
+    ::close(journal_fd);
+
+    if (mCommitCallback)
+        mCommitCallback();
+
+    switchPackages(transaction);
+    // the transaction is complete, what is left is removed by the next recover()
+    std::filesystem::remove_all(staging, ec);
+
+    return transaction.operations.size();
+}
+
+void Installer::writeJournal(int journal_fd, const InstallTransaction &transaction)
+{
+    std::string content = "rps-journal " + transaction.id + "\n";
+    for (auto &op : transaction.operations) {
+        content += op.type == InstallTransaction::Type::Install ? "install " : "remove ";
+        content += op.name + " " + std::to_string(op.revision) + "\n";
+    }
+    content += "commit " + journalChecksum(content) + "\n";
+
+    // a torn journal fails the checksum and the transaction is discarded
+    TraceSpan span("journal");
+    span.addBytes(content.size());
+    if (ftruncate(journal_fd, 0) != 0 ||
+        pwrite(journal_fd, content.data(), content.size(), 0) !=
+            static_cast<ssize_t>(content.size()) ||
+        fdatasync(journal_fd) != 0)
+        throw Exception("cannot write journal in " + mPath.string());
+    mSyncCount++;
+}
+
+bool Installer::readJournal(int dir_fd, InstallTransaction &transaction) const
+{
+    int fd = openat(dir_fd, INSTALLER_JOURNAL, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    std::string content;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        content.append(buffer, n);
+    ::close(fd);
+
+    size_t commit = content.rfind("commit ");
+    if (commit == std::string::npos ||
+        content.compare(commit + 7, std::string::npos,
+            journalChecksum(content.substr(0, commit)) + "\n") != 0)
+        return false;
+
+    std::istringstream in(content.substr(0, commit));
+    std::string keyword;
+    if (!(in >> keyword >> transaction.id) || keyword != "rps-journal")
+        return false;
+
+    InstallTransaction::Operation op;
+    while (in >> keyword >> op.name >> op.revision) {
+        op.type = keyword == "install" ? InstallTransaction::Type::Install
+                                       : InstallTransaction::Type::Remove;
+        transaction.operations.push_back(op);
+    }
+    return true;
+}
+
+void Installer::switchPackages(const InstallTransaction &transaction) const
+{
+    auto staging = stagingPath(transaction.id);
+
+    for (auto &op : transaction.operations) {
+        auto installed = mPath / op.name;
+
+        if (op.type == InstallTransaction::Type::Remove) {
+            if (readRevision(installed) == op.revision)
+                renamePath(installed, staging / op.name);
+            continue;
+        }
+
+        // after the exchange the staged directory holds the replaced revision
+        auto staged = staging / op.name;
+        if (readRevision(staged) != op.revision || readRevision(installed) == op.revision)
+            continue;
+
+        std::error_code ec;
+        if (!std::filesystem::exists(installed, ec)) {
+            renamePath(staged, installed);
+            continue;
+        }
+
+        if (renameat2(AT_FDCWD, staged.c_str(), AT_FDCWD, installed.c_str(), RENAME_EXCHANGE) ==
+            0)
+            continue;
+        if (errno != EINVAL && errno != ENOSYS)
+            throw Exception("cannot replace " + installed.string());
+
+        // without exchange support the package is missing between the renames, a power loss in
+        // between is completed by recover()
+        renamePath(installed, staging / (op.name + ".old"));
+        renamePath(staged, installed);
+    }
+
+    std::error_code ec;
+    if (std::filesystem::exists(staging / INSTALLER_DATABASE, ec))
+        renamePath(staging / INSTALLER_DATABASE, databasePath());
+}
+
+std::filesystem::path Installer::stagingPath(const std::string &id) const
+{
+    return mPath / INSTALLER_STAGING / id;
+}
+
+void Installer::setPublicKey(const std::string &pub_key) { mPublicKey = pub_key; }
+
+void Installer::setCommitCallback(std::function<void()> callback)
+{
+    mCommitCallback = std::move(callback);
+}
+
+size_t Installer::syncCount() const { return mSyncCount; }
+
+} // namespace rose
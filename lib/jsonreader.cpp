@@ -0,0 +1,289 @@
+/**
+ * @file jsonreader.cpp
+ */
+#include "jsonreader.h"
+#include <cstring>
+
+namespace rose
+{
+
+JsonReader::JsonReader(const char *data, size_t size) : mPos(data), mEnd(data + size) {}
+
+void JsonReader::skipWhitespace()
+{
+    while (mPos < mEnd && (*mPos == ' ' || *mPos == '\n' || *mPos == '\r' || *mPos == '\t'))
+        mPos++;
+}
+
+void JsonReader::expect(char c)
+{
+    skipWhitespace();
+    if (mPos >= mEnd || *mPos != c)
+        throw "invalid JSON: unexpected character";
+    mPos++;
+}
+
+JsonReader::Type JsonReader::peek()
+{
+    skipWhitespace();
+    if (mPos >= mEnd)
+        throw "invalid JSON: unexpected end";
+
+    switch (*mPos) {
+    case '{':
+        return Type::Object;
+    case '[':
+        return Type::Array;
+    case '"':
+        return Type::String;
+    case 't':
+        return Type::True;
+    case 'f':
+        return Type::False;
+    case 'n':
+        return Type::Null;
+    default:
+        if (*mPos == '-' || (*mPos >= '0' && *mPos <= '9'))
+            return Type::Number;
+        throw "invalid JSON: unexpected character";
+    }
+}
+
+void JsonReader::beginObject()
+{
+    expect('{');
+    mExpectSeparator = false;
+}
+
+bool JsonReader::nextMember(std::string_view &key)
+{
+    skipWhitespace();
+    if (mPos < mEnd && *mPos == '}') {
+        mPos++;
+        mExpectSeparator = true;
+        return false;
+    }
+    if (mExpectSeparator)
+        expect(',');
+
+    key = readString();
+    expect(':');
+    mExpectSeparator = false;
+    return true;
+}
+
+void JsonReader::beginArray()
+{
+    expect('[');
+    mExpectSeparator = false;
+}
+
+bool JsonReader::nextElement()
+{
+    skipWhitespace();
+    if (mPos < mEnd && *mPos == ']') {
+        mPos++;
+        mExpectSeparator = true;
+        return false;
+    }
+    if (mExpectSeparator)
+        expect(',');
+
+    mExpectSeparator = false;
+    return true;
+}
+
+std::string_view JsonReader::readString()
+{
+    expect('"');
+    mExpectSeparator = true;
+
+    // fast path: no escapes, the string is returned in place
+    const char *start = mPos;
+    while (mPos < mEnd && *mPos != '"' && *mPos != '\\') {
+        if (static_cast<unsigned char>(*mPos) < 0x20)
+            throw "invalid JSON: control character in string";
+        mPos++;
+    }
+    if (mPos >= mEnd)
+        throw "invalid JSON: unterminated string";
+    if (*mPos == '"')
+        return std::string_view(start, mPos++ - start);
+
+    mScratch.assign(start, mPos - start);
+    while (mPos < mEnd && *mPos != '"') {
+        char c = *mPos++;
+        if (static_cast<unsigned char>(c) < 0x20)
+            throw "invalid JSON: control character in string";
+        if (c != '\\') {
+            mScratch.push_back(c);
+            continue;
+        }
+
+        if (mPos >= mEnd)
+            break;
+        c = *mPos++;
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            mScratch.push_back(c);
+            break;
+        case 'b':
+            mScratch.push_back('\b');
+            break;
+        case 'f':
+            mScratch.push_back('\f');
+            break;
+        case 'n':
+            mScratch.push_back('\n');
+            break;
+        case 'r':
+            mScratch.push_back('\r');
+            break;
+        case 't':
+            mScratch.push_back('\t');
+            break;
+        case 'u': {
+            uint32_t cp = readHex4();
+            if (cp >= 0xd800 && cp < 0xdc00) {
+                // surrogate pair
+                if (mEnd - mPos < 2 || mPos[0] != '\\' || mPos[1] != 'u')
+                    throw "invalid JSON: invalid surrogate pair";
+                mPos += 2;
+                uint32_t low = readHex4();
+                if (low < 0xdc00 || low >= 0xe000)
+                    throw "invalid JSON: invalid surrogate pair";
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+            } else if (cp >= 0xdc00 && cp < 0xe000) {
+                throw "invalid JSON: invalid surrogate pair";
+            }
+            appendUtf8(cp);
+            break;
+        }
+        default:
+            throw "invalid JSON: invalid escape sequence";
+        }
+    }
+    if (mPos >= mEnd)
+        throw "invalid JSON: unterminated string";
+    mPos++;
+
+    return mScratch;
+}
+
+uint32_t JsonReader::readHex4()
+{
+    if (mEnd - mPos < 4)
+        throw "invalid JSON: invalid escape sequence";
+
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = *mPos++;
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v |= c - 'A' + 10;
+        else
+            throw "invalid JSON: invalid escape sequence";
+    }
+    return v;
+}
+
+void JsonReader::appendUtf8(uint32_t cp)
+{
+    if (cp < 0x80) {
+        mScratch.push_back(cp);
+    } else if (cp < 0x800) {
+        mScratch.push_back(0xc0 | (cp >> 6));
+        mScratch.push_back(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        mScratch.push_back(0xe0 | (cp >> 12));
+        mScratch.push_back(0x80 | ((cp >> 6) & 0x3f));
+        mScratch.push_back(0x80 | (cp & 0x3f));
+    } else {
+        mScratch.push_back(0xf0 | (cp >> 18));
+        mScratch.push_back(0x80 | ((cp >> 12) & 0x3f));
+        mScratch.push_back(0x80 | ((cp >> 6) & 0x3f));
+        mScratch.push_back(0x80 | (cp & 0x3f));
+    }
+}
+
+int64_t JsonReader::readInteger()
+{
+    if (peek() != Type::Number)
+        throw "invalid JSON: expected integer";
+    mExpectSeparator = true;
+
+    bool negative = *mPos == '-';
+    if (negative)
+        mPos++;
+
+    const char *start = mPos;
+    uint64_t v = 0;
+    while (mPos < mEnd && *mPos >= '0' && *mPos <= '9') {
+        if (v > (UINT64_MAX - 9) / 10)
+            throw "invalid JSON: integer out of range";
+        v = v * 10 + (*mPos++ - '0');
+    }
+    if (mPos == start || (mPos < mEnd && (*mPos == '.' || *mPos == 'e' || *mPos == 'E')))
+        throw "invalid JSON: expected integer";
+    if (v > uint64_t(INT64_MAX) + negative)
+        throw "invalid JSON: integer out of range";
+
+    return negative ? -static_cast<int64_t>(v - 1) - 1 : static_cast<int64_t>(v);
+}
+
+void JsonReader::skipValue() { skipValue(0); }
+
+void JsonReader::skipValue(int depth)
+{
+    if (depth > MaxDepth)
+        throw "invalid JSON: nesting too deep";
+
+    std::string_view key;
+    switch (peek()) {
+    case Type::Object:
+        beginObject();
+        while (nextMember(key))
+            skipValue(depth + 1);
+        break;
+    case Type::Array:
+        beginArray();
+        while (nextElement())
+            skipValue(depth + 1);
+        break;
+    case Type::String:
+        readString();
+        break;
+    case Type::Number:
+        while (mPos < mEnd && ((*mPos >= '0' && *mPos <= '9') || *mPos == '-' || *mPos == '+' ||
+                                  *mPos == '.' || *mPos == 'e' || *mPos == 'E'))
+            mPos++;
+        mExpectSeparator = true;
+        break;
+    case Type::True:
+    case Type::False:
+    case Type::Null: {
+        const char *word = *mPos == 't' ? "true" : *mPos == 'f' ? "false" : "null";
+        size_t length = strlen(word);
+        if (size_t(mEnd - mPos) < length || memcmp(mPos, word, length) != 0)
+            throw "invalid JSON: unexpected character";
+        mPos += length;
+        mExpectSeparator = true;
+        break;
+    }
+    }
+}
+
+void JsonReader::end()
+{
+    skipWhitespace();
+    if (mPos != mEnd)
+        throw "invalid JSON: data after the document";
+}
+
+} // namespace rose
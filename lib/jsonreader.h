@@ -0,0 +1,86 @@
+/**
+ * @file jsonreader.h
+ * @brief Pull parser for JSON documents in memory.
+ */
+#ifndef _JSONREADER_H
+#define _JSONREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace rose
+{
+
+/**
+ * Reads a JSON document value by value without building a tree. The caller walks the document
+ * with beginObject()/nextMember() and beginArray()/nextElement() and reads or skips each value.
+ * Strings without escapes are returned as views into the buffer, so reading a document does not
+ * allocate memory. Errors are thrown as string literals like the manifest parser does.
+ */
+class JsonReader
+{
+  public:
+    enum class Type { Object, Array, String, Number, True, False, Null };
+
+    JsonReader(const char *data, size_t size);
+
+    /**
+     * @brief The type of the next value.
+     */
+    Type peek();
+
+    void beginObject();
+
+    /**
+     * @brief Read the key of the next member of the current object.
+     * @return false at the end of the object
+     */
+    bool nextMember(std::string_view &key);
+
+    void beginArray();
+
+    /**
+     * @brief Move to the next element of the current array.
+     * @return false at the end of the array
+     */
+    bool nextElement();
+
+    /**
+     * @brief Read a string.
+     * @return the unescaped string, valid until the next string is read
+     */
+    std::string_view readString();
+
+    int64_t readInteger();
+
+    /**
+     * @brief Skip the next value including nested values.
+     */
+    void skipValue();
+
+    /**
+     * @brief Check that only whitespace follows the document.
+     */
+    void end();
+
+  private:
+    void skipWhitespace();
+    void expect(char c);
+    void skipValue(int depth);
+    uint32_t readHex4();
+    void appendUtf8(uint32_t codepoint);
+
+  private:
+    const char *mPos;
+    const char *mEnd;
+    bool mExpectSeparator{false};
+    std::string mScratch;
+
+    static constexpr int MaxDepth = 64;
+};
+
+} // namespace rose
+
+#endif /* _JSONREADER_H */
@@ -3,10 +3,17 @@
  */
 #include "rps/manifest.h"
 #include "rps/defines.h"
+#include "rps/manifestview.h"
+#include "jsonreader.h"
+#include "manifestformat.h"
+#include "mappedfile.h"
 #include "stringhelper.h"
+#include "tarreader.h"
+#include "tracespan.h"
 #include <jansson.h>
 #include <memory.h>
 #include <syslog.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -15,57 +22,266 @@
 namespace rose
 {
 
-std::map<std::string, Manifest::Tag> Manifest::ManifestTags{{"manifest", Manifest::Tag::Manifest},
-    {"name", Manifest::Tag::Name}, {"version", Manifest::Tag::Version}, {"api", Manifest::Tag::API},
-    {"arch", Manifest::Tag::Arch}, {"localization", Manifest::Tag::Localization},
-    {"depends", Manifest::Tag::Depends}, {"source", Manifest::Tag::Source},
-    {"vendor", Manifest::Tag::Vendor}, {"label", Manifest::Tag::Label},
-    {"version-label", Manifest::Tag::VersionLabel}, {"description", Manifest::Tag::Description},
-    {"license", Manifest::Tag::License}, {"files", Manifest::Tag::Files}};
-
-std::map<Manifest::Tag, std::function<void(Manifest &, json_t *)>> Manifest::ReadTagFunctions{
-    {Manifest::Tag::Manifest, Manifest::readTagManifest},
-    {Manifest::Tag::Name, Manifest::readTagName},
-    {Manifest::Tag::Version, Manifest::readTagVersion}, {Manifest::Tag::API, Manifest::readTagAPI},
-    {Manifest::Tag::Arch, Manifest::readTagArch},
-    {Manifest::Tag::Localization, Manifest::readTagLocalization},
-    {Manifest::Tag::Depends, Manifest::readTagDepends},
-    {Manifest::Tag::Source, Manifest::readTagSource},
-    {Manifest::Tag::Vendor, Manifest::readTagVendor},
-    {Manifest::Tag::Label, Manifest::readTagLabel},
-    {Manifest::Tag::VersionLabel, Manifest::readTagVersionLabel},
-    {Manifest::Tag::Description, Manifest::readTagDescription},
-    {Manifest::Tag::License, Manifest::readTagLicense},
-    {Manifest::Tag::Files, Manifest::readTagFiles}};
-
 Manifest::Manifest() {}
 
+Manifest::Manifest(const Manifest &other) { *this = other; }
+
 Manifest::~Manifest() {}
 
+Manifest &Manifest::operator=(const Manifest &other)
+{
+    if (this == &other)
+        return *this;
+
+    mManifestVersion = other.mManifestVersion;
+    mPackageName = other.mPackageName;
+    mPackageVersion = other.mPackageVersion;
+    mApiMin = other.mApiMin;
+    mApiTarget = other.mApiTarget;
+    mApiMax = other.mApiMax;
+    mTargetArch = other.mTargetArch;
+    mLocales = other.mLocales;
+    mDependencies = other.mDependencies;
+    mSource = other.mSource;
+    mVendor = other.mVendor;
+    mPackageLabel = other.mPackageLabel;
+    mVersionLabal = other.mVersionLabal;
+    mDescription = other.mDescription;
+    mLicense = other.mLicense;
+    mCompression = other.mCompression;
+
+    // the names refer to the arena of the other manifest
+    setFiles(other.mFiles);
+
+    return *this;
+}
+
 void Manifest::readFromFile(std::string filename)
 {
-    json_t *root = json_load_file(filename.c_str(), 0, NULL);
+    MappedFile file;
+    if (!file.open(filename))
+        throw "cannot read manifest";
+
+    read(reinterpret_cast<const char *>(file.data()), file.size());
+}
 
-    std::cout << "read manifest: " << filename << std::endl;
+void Manifest::readFromBuffer(const std::string &buffer) { read(buffer.data(), buffer.size()); }
 
-    if (!root)
-        throw "cannot read manifest";
+void Manifest::read(const char *data, size_t size)
+{
+    TraceSpan span("parse-manifest");
+    span.addBytes(size);
+
+    if (ManifestView::isBinaryManifest(data, size)) {
+        ManifestView view;
+        if (!view.open(data, size))
+            throw "invalid binary manifest";
+        read(view);
+    } else {
+        JsonReader reader(data, size);
+        read(reader);
+    }
+    span.addEntries(mFiles.size());
+}
+
+void Manifest::read(const ManifestView &view)
+{
+    if (view.manifestVersion() != static_cast<int32_t>(ManifestVersion::Version1_0))
+        throw "invalid manifest version";
+
+    mManifestVersion = ManifestVersion::Version1_0;
+    mPackageName = view.packageName();
+    mPackageVersion = view.packageVersion();
+    mApiMin = view.apiMin();
+    mApiTarget = view.apiTarget();
+    mApiMax = view.apiMax();
+    mTargetArch = view.targetArch();
+    mSource = view.source();
+    mVendor = view.vendor();
+    mPackageLabel = view.packageLabel();
+    mVersionLabal = view.versionLabel();
+    mDescription = view.description();
+    mLicense = view.license();
+    mCompression = view.compression();
+
+    mLocales.clear();
+    for (size_t i = 0; i < view.localeCount(); i++)
+        mLocales.emplace_back(view.locale(i));
+
+    mDependencies.clear();
+    for (size_t i = 0; i < view.dependencyCount(); i++) {
+        Dependency d;
+        d.name = view.dependencyName(i);
+        for (size_t j = 0; j < view.requiresCount(i); j++)
+            d.requires.add(view.requiresInterval(i, j));
+        for (size_t j = 0; j < view.conflictsCount(i); j++)
+            d.conflicts.add(view.conflictsInterval(i, j));
+        mDependencies.push_back(std::move(d));
+    }
+
+    mFiles.clear();
+    mFileNames.clear();
+    mFiles.reserve(view.fileCount());
+    for (size_t i = 0; i < view.fileCount(); i++) {
+        ManifestView::FileView f = view.file(i);
+        if (!isSafePath(f.name()))
+            throw "invalid file name";
+        File &file = addFile(f.name());
+        if (f.hasHash())
+            file.setHash(f.hash());
+        file.setMode(f.mode());
+    }
+}
 
-    const char *key;
-    json_t *value;
-    json_object_foreach(root, key, value)
-    {
-        Tag t = ManifestTags[key];
-        if (t == Tag::Undefined)
+void Manifest::read(JsonReader &in)
+{
+    if (in.peek() != JsonReader::Type::Object)
+        throw "cannot parse manifest";
+
+    std::string_view key;
+    in.beginObject();
+    while (in.nextMember(key)) {
+        switch (tagFromKey(key)) {
+        case Tag::Manifest:
+            readTagManifest(*this, in);
+            break;
+        case Tag::Name:
+            readTagName(*this, in);
+            break;
+        case Tag::Version:
+            readTagVersion(*this, in);
+            break;
+        case Tag::API:
+            readTagAPI(*this, in);
+            break;
+        case Tag::Arch:
+            readTagArch(*this, in);
+            break;
+        case Tag::Localization:
+            readTagLocalization(*this, in);
+            break;
+        case Tag::Depends:
+            readTagDepends(*this, in);
+            break;
+        case Tag::Source:
+            readTagSource(*this, in);
+            break;
+        case Tag::Vendor:
+            readTagVendor(*this, in);
+            break;
+        case Tag::Label:
+            readTagLabel(*this, in);
+            break;
+        case Tag::VersionLabel:
+            readTagVersionLabel(*this, in);
+            break;
+        case Tag::Description:
+            readTagDescription(*this, in);
+            break;
+        case Tag::License:
+            readTagLicense(*this, in);
+            break;
+        case Tag::Compression:
+            readTagCompression(*this, in);
+            break;
+        case Tag::Files:
+            readTagFiles(*this, in);
+            break;
+        case Tag::Undefined:
             throw "invalid key in manifest";
+        }
+    }
+    in.end();
+}
 
-        ReadTagFunctions[t](*this, value);
+Manifest::Tag Manifest::tagFromKey(std::string_view key)
+{
+    // the length selects at most two candidates
+    switch (key.size()) {
+    case 3:
+        if (key == "api")
+            return Tag::API;
+        break;
+    case 4:
+        if (key == "name")
+            return Tag::Name;
+        if (key == "arch")
+            return Tag::Arch;
+        break;
+    case 5:
+        if (key == "files")
+            return Tag::Files;
+        if (key == "label")
+            return Tag::Label;
+        break;
+    case 6:
+        if (key == "source")
+            return Tag::Source;
+        if (key == "vendor")
+            return Tag::Vendor;
+        break;
+    case 7:
+        if (key == "version")
+            return Tag::Version;
+        if (key == "depends")
+            return Tag::Depends;
+        if (key == "license")
+            return Tag::License;
+        break;
+    case 8:
+        if (key == "manifest")
+            return Tag::Manifest;
+        break;
+    case 11:
+        if (key == "description")
+            return Tag::Description;
+        if (key == "compression")
+            return Tag::Compression;
+        break;
+    case 12:
+        if (key == "localization")
+            return Tag::Localization;
+        break;
+    case 13:
+        if (key == "version-label")
+            return Tag::VersionLabel;
+        break;
     }
 
-    json_decref(root);
+    return Tag::Undefined;
+}
+
+/** Returns the intervals as an array of [start, end] pairs or NULL on error. */
+static json_t *writeVersionIntervals(const IntervalSet &intervals)
+{
+    json_t *array = json_array();
+    for (auto i : intervals) {
+        json_t *pair = json_array();
+        if (!array || json_array_append_new(array, pair) != 0 ||
+            json_array_append_new(pair, json_integer(i.start)) != 0 ||
+            json_array_append_new(pair, json_integer(i.end)) != 0) {
+            json_decref(array);
+            return NULL;
+        }
+    }
+    return array;
+}
+
+void Manifest::writeManifestFile(std::string filename, Format format)
+{
+    TraceSpan span("write-manifest");
+    span.addEntries(mFiles.size());
+
+    std::string buffer = format == Format::Binary ? toBinary() : toJson();
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f)
+        throw "cannot write manifest";
+    size_t n = fwrite(buffer.data(), 1, buffer.size(), f);
+    if (fclose(f) != 0 || n != buffer.size())
+        throw "cannot write manifest";
 }
 
-void Manifest::writeManifestFile(std::string filename)
+std::string Manifest::toJson() const
 {
     json_t *root;
 
@@ -153,7 +369,19 @@ void Manifest::writeManifestFile(std::string filename)
         throw "cannot add 'depends'";
     }
     for (auto &i : mDependencies) {
-        // TODO
+        json_t *dependency_item = json_object();
+        if (!dependency_item || json_array_append_new(depends_item, dependency_item) != 0) {
+            json_decref(root);
+            throw "cannot add dependency";
+        }
+        if (json_object_set_new(dependency_item, "name", json_string(i.name.c_str())) != 0 ||
+            json_object_set_new(dependency_item, "requires", writeVersionIntervals(i.requires)) !=
+                0 ||
+            json_object_set_new(
+                dependency_item, "conflicts", writeVersionIntervals(i.conflicts)) != 0) {
+            json_decref(root);
+            throw "cannot write dependency";
+        }
     }
 
     // source
@@ -198,6 +426,29 @@ void Manifest::writeManifestFile(std::string filename)
         throw "cannot write license";
     }
 
+    // compression
+
+    json_t *compression_item = json_object();
+    if (!compression_item) {
+        json_decref(root);
+        throw "json_object() failed";
+    }
+    if (json_object_set_new(compression_item, "codec",
+            json_string(Compression::codecName(mCompression.codec).c_str())) != 0) {
+        json_decref(compression_item);
+        json_decref(root);
+        throw "cannot write compression codec";
+    }
+    if (json_object_set_new(compression_item, "level", json_integer(mCompression.level)) != 0) {
+        json_decref(compression_item);
+        json_decref(root);
+        throw "cannot write compression level";
+    }
+    if (json_object_set_new(root, "compression", compression_item) != 0) {
+        json_decref(root);
+        throw "cannot add compression info";
+    }
+
     // files
     json_t *files_item = json_array();
     if (!files_item) {
@@ -220,257 +471,447 @@ void Manifest::writeManifestFile(std::string filename)
             json_decref(root);
             throw "cannot write files section";
         }
-        if (json_object_set_new(file_item, "name", json_string(i.name().c_str())) != 0) {
+        if (json_object_set_new(file_item, "name", json_string(i.name().data())) != 0) {
             json_decref(root);
             throw "cannot add file";
         }
-        std::cerr << "added file: " << i.name().c_str() << std::endl;
+        std::string hash_str;
+        if (i.hasHash()) {
+            hash_str.resize(2 * i.hash().size());
+            write_hexstr(hash_str.data(), i.hash().data(), i.hash().size());
+        }
+        if (json_object_set_new(file_item, "hash", json_string(hash_str.c_str())) != 0) {
+            json_decref(root);
+            throw "cannot add file hash";
+        }
+        if (i.mode() && json_object_set_new(file_item, "mode", json_integer(i.mode())) != 0) {
+            json_decref(root);
+            throw "cannot add file mode";
+        }
+        if (Trace::verbosity() >= 2)
+            std::cerr << "added file: " << i.name() << std::endl;
     }
 
-    if (json_dump_file(root, filename.c_str(), JSON_INDENT(4) | JSON_PRESERVE_ORDER) != 0) {
-        json_decref(root);
-        throw "json_dump_file failed";
+    char *dump = json_dumps(root, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    json_decref(root);
+    if (!dump)
+        throw "json_dumps failed";
+    std::string json(dump);
+    free(dump);
+    return json;
+}
+
+static size_t alignBinary(size_t offset)
+{
+    return (offset + MANIFEST_BINARY_ALIGN - 1) & ~size_t(MANIFEST_BINARY_ALIGN - 1);
+}
+
+std::string Manifest::toBinary() const
+{
+    std::string strings;
+    auto addString = [&strings](std::string_view str) {
+        ManifestFormat::StringRef ref{static_cast<uint32_t>(strings.size()),
+            static_cast<uint32_t>(str.size())};
+        strings.append(str);
+        strings.push_back('\0');
+        return ref;
+    };
+
+    ManifestFormat::Header header{};
+    memcpy(header.magic, MANIFEST_BINARY_MAGIC, sizeof(header.magic));
+    header.version = MANIFEST_BINARY_VERSION;
+    header.byteOrder = MANIFEST_BINARY_BYTE_ORDER;
+    header.manifestVersion = static_cast<int32_t>(mManifestVersion);
+    header.packageVersion = mPackageVersion;
+    header.apiMin = mApiMin;
+    header.apiTarget = mApiTarget;
+    header.apiMax = mApiMax;
+    header.codec = static_cast<uint32_t>(mCompression.codec);
+    header.level = mCompression.level;
+    header.strings[ManifestFormat::Name] = addString(mPackageName);
+    header.strings[ManifestFormat::Arch] = addString(mTargetArch);
+    header.strings[ManifestFormat::Source] = addString(mSource);
+    header.strings[ManifestFormat::Vendor] = addString(mVendor);
+    header.strings[ManifestFormat::Label] = addString(mPackageLabel);
+    header.strings[ManifestFormat::VersionLabel] = addString(mVersionLabal);
+    header.strings[ManifestFormat::Description] = addString(mDescription);
+    header.strings[ManifestFormat::License] = addString(mLicense);
+
+    std::vector<ManifestFormat::StringRef> locales;
+    for (auto &l : mLocales)
+        locales.push_back(addString(l));
+
+    std::vector<ManifestFormat::DependencyRecord> dependencies;
+    std::vector<ManifestFormat::Interval> intervals;
+    for (auto &d : mDependencies) {
+        ManifestFormat::DependencyRecord record{};
+        record.name = addString(d.name);
+        record.requiresIndex = intervals.size();
+        record.requiresCount = d.requires.size();
+        for (auto i : d.requires)
+            intervals.push_back({i.start, i.end});
+        record.conflictsIndex = intervals.size();
+        record.conflictsCount = d.conflicts.size();
+        for (auto i : d.conflicts)
+            intervals.push_back({i.start, i.end});
+        dependencies.push_back(record);
     }
 
-    json_decref(root);
+    std::vector<ManifestFormat::FileRecord> files(mFiles.size());
+    for (size_t i = 0; i < mFiles.size(); i++) {
+        files[i].name = addString(mFiles[i].name());
+        files[i].flags = mFiles[i].hasHash() ? ManifestFormat::HasHash : 0;
+        files[i].mode = mFiles[i].mode();
+        files[i].hash = mFiles[i].hash();
+    }
+
+    std::vector<uint32_t> file_index(mFiles.size());
+    for (size_t i = 0; i < file_index.size(); i++)
+        file_index[i] = i;
+    std::sort(file_index.begin(), file_index.end(),
+        [this](uint32_t a, uint32_t b) { return mFiles[a].name() < mFiles[b].name(); });
+
+    // the header is written last when all offsets are known
+    std::string out(sizeof(header), '\0');
+    auto append = [&out](const void *data, size_t size) {
+        out.resize(alignBinary(out.size()));
+        uint32_t offset = out.size();
+        out.append(static_cast<const char *>(data), size);
+        return offset;
+    };
+
+    header.localeCount = locales.size();
+    header.localesOffset =
+        append(locales.data(), locales.size() * sizeof(ManifestFormat::StringRef));
+    header.dependencyCount = dependencies.size();
+    header.dependenciesOffset =
+        append(dependencies.data(), dependencies.size() * sizeof(ManifestFormat::DependencyRecord));
+    header.intervalCount = intervals.size();
+    header.intervalsOffset =
+        append(intervals.data(), intervals.size() * sizeof(ManifestFormat::Interval));
+    header.fileCount = files.size();
+    header.filesOffset = append(files.data(), files.size() * sizeof(ManifestFormat::FileRecord));
+    header.fileIndexOffset = append(file_index.data(), file_index.size() * sizeof(uint32_t));
+    header.stringTableSize = strings.size();
+    header.stringTableOffset = append(strings.data(), strings.size());
+    out.resize(alignBinary(out.size()));
+
+    if (out.size() > UINT32_MAX)
+        throw "manifest too large";
+    header.size = out.size();
+    memcpy(out.data(), &header, sizeof(header));
+
+    return out;
 }
 
 std::string Manifest::packageName() const { return mPackageName; }
 
 void Manifest::setPackageName(const std::string &packageName) { mPackageName = packageName; }
 
-std::string Manifest::readStringTag(json_t *in)
+std::string Manifest::readStringTag(JsonReader &in)
 {
-    const char *s = json_string_value(in);
-    if (!s)
+    if (in.peek() != JsonReader::Type::String)
         throw "connot source section";
 
-    return std::string(s);
+    return std::string(in.readString());
 }
 
-void Manifest::readTagManifest(Manifest &mfst, json_t *in)
+void Manifest::readTagManifest(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag manifest" << std::endl;
-
-    const char *str = json_string_value(in);
-    if (!str)
+    if (in.peek() != JsonReader::Type::String)
         throw "connot read manifest version";
 
-    if (std::string(str) == "1.0") {
+    if (in.readString() == "1.0") {
         mfst.setManifestVersion(ManifestVersion::Version1_0);
     } else {
         throw "invalid manifest version";
     }
 }
 
-void Manifest::readTagName(Manifest &mfst, json_t *in)
+void Manifest::readTagName(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag name" << std::endl;
-
-    const char *str = json_string_value(in);
-    if (!str)
+    if (in.peek() != JsonReader::Type::String)
         throw "connot read package name";
 
-    mfst.setPackageName(str);
+    mfst.setPackageName(std::string(in.readString()));
 }
 
-void Manifest::readTagVersion(Manifest &mfst, json_t *in)
+void Manifest::readTagVersion(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag version" << std::endl;
-
-    if (json_typeof(in) != JSON_INTEGER)
+    if (in.peek() != JsonReader::Type::Number)
         throw "connot read version";
 
-    int v = json_integer_value(in);
-
-    mfst.setPackageVersion(v);
+    mfst.setPackageVersion(in.readInteger());
 }
 
-void Manifest::readTagAPI(Manifest &mfst, json_t *in)
+void Manifest::readTagAPI(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag API" << std::endl;
-
-    if (!in || json_typeof(in) != JSON_OBJECT)
+    if (in.peek() != JsonReader::Type::Object)
         throw "invalid arguments";
 
-    const char *key;
-    json_t *val;
-    json_object_foreach(in, key, val)
-    {
-        if (!key)
+    std::string_view key;
+    in.beginObject();
+    while (in.nextMember(key)) {
+        if (in.peek() != JsonReader::Type::Number)
             throw "invalid data in section 'api'";
-        int v = json_integer_value(val);
-
-        std::cout << key << ": " << v << std::endl;
+        int v = in.readInteger();
 
-        if (std::string("min") == key)
+        if (key == "min")
             mfst.setApiMin(v);
-        else if (std::string("max") == key)
+        else if (key == "max")
             mfst.setApiMax(v);
-        else if (std::string("target") == key)
+        else if (key == "target")
             mfst.setApiTarget(v);
         else
             throw "invalid data";
     }
 }
 
-void Manifest::readTagArch(Manifest &mfst, json_t *in)
+void Manifest::readTagArch(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag ABI" << std::endl;
-
-    if (json_typeof(in) != JSON_STRING)
+    if (in.peek() != JsonReader::Type::String)
         throw "connot read tag 'abi'";
 
-    const char *str = json_string_value(in);
-
-    mfst.setTargetArch(str);
+    mfst.setTargetArch(std::string(in.readString()));
 }
 
-void Manifest::readTagLocalization(Manifest &mfst, json_t *in)
+void Manifest::readTagLocalization(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag localization" << std::endl;
-
-    if (!in || json_typeof(in) != JSON_ARRAY)
+    if (in.peek() != JsonReader::Type::Array)
         throw "invalid arguments";
 
-    int i;
-    json_t *value;
-    json_array_foreach(in, i, value)
-    {
-        const char *str = json_string_value(value);
-        if (!str)
+    in.beginArray();
+    while (in.nextElement()) {
+        if (in.peek() != JsonReader::Type::String)
             throw "invalid data";
 
-        mfst.locales().push_back(std::string(str));
+        mfst.locales().emplace_back(in.readString());
     }
 }
 
-void Manifest::readTagDepends(Manifest &mfst, json_t *in)
+/**
+ * @brief Read a list of version intervals, e.g. [[3, 3], [12, 144]].
+ */
+static void readVersionIntervals(JsonReader &in, IntervalSet &intervals)
 {
-    std::cout << "read tag depends" << std::endl;
+    if (in.peek() != JsonReader::Type::Array)
+        throw "invalid version intervals in section 'depends'";
+
+    in.beginArray();
+    while (in.nextElement()) {
+        if (in.peek() != JsonReader::Type::Array)
+            throw "invalid version interval in section 'depends'";
+
+        VersionInterval interval;
+        in.beginArray();
+        if (!in.nextElement())
+            throw "invalid version interval in section 'depends'";
+        interval.start = in.readInteger();
+        if (!in.nextElement())
+            throw "invalid version interval in section 'depends'";
+        interval.end = in.readInteger();
+        if (in.nextElement() || interval.start > interval.end)
+            throw "invalid version interval in section 'depends'";
+
+        intervals.add(interval);
+    }
+}
 
-    if (!in || json_typeof(in) != JSON_ARRAY)
+void Manifest::readTagDepends(Manifest &mfst, JsonReader &in)
+{
+    if (in.peek() != JsonReader::Type::Array)
         throw "invalid arguments";
 
-    int i;
-    json_t *pkg;
-    json_array_foreach(in, i, pkg)
-    {
-        if (json_typeof(pkg) != JSON_OBJECT)
+    in.beginArray();
+    while (in.nextElement()) {
+        if (in.peek() != JsonReader::Type::Object)
             throw "invalid data in section 'depends'";
 
-        json_t *name = json_object_get(pkg, "name");
-        if (!name || json_typeof(name) != JSON_STRING)
-            throw "no package name for dependency";
-
-        const char *name_str = json_string_value(name);
-
-        std::cout << "depends: " << name_str << std::endl;
-
-        json_t *requires = json_object_get(pkg, "requires");
-        if (requires) {
-            // TODO: read versions
+        Dependency dependency;
+
+        std::string_view key;
+        in.beginObject();
+        while (in.nextMember(key)) {
+            if (key == "name") {
+                if (in.peek() != JsonReader::Type::String)
+                    throw "no package name for dependency";
+                dependency.name = in.readString();
+            } else if (key == "requires") {
+                readVersionIntervals(in, dependency.requires);
+            } else if (key == "conflicts") {
+                readVersionIntervals(in, dependency.conflicts);
+            } else {
+                in.skipValue();
+            }
         }
 
-        json_t *conflicts = json_object_get(pkg, "conflicts");
-        if (requires) {
-            // TODO: read versions
-        }
+        if (dependency.name.empty())
+            throw "no package name for dependency";
+
+        mfst.mDependencies.push_back(std::move(dependency));
     }
 }
 
-void Manifest::readTagSource(Manifest &mfst, json_t *in)
+void Manifest::readTagSource(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag source" << std::endl;
-
-    const char *str = json_string_value(in);
-    if (!str)
+    if (in.peek() != JsonReader::Type::String)
         throw "connot source section";
 
-    mfst.setSource(str);
+    mfst.setSource(std::string(in.readString()));
 }
 
-void Manifest::readTagVendor(Manifest &mfst, json_t *in)
+void Manifest::readTagVendor(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag vendor" << std::endl;
-
-    const char *str = json_string_value(in);
-    if (!str)
+    if (in.peek() != JsonReader::Type::String)
         throw "connot vendor section";
 
-    mfst.setVendor(str);
+    mfst.setVendor(std::string(in.readString()));
 }
 
-void Manifest::readTagLabel(Manifest &mfst, json_t *in)
+void Manifest::readTagLabel(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag label" << std::endl;
-
     mfst.setPackageLabel(readStringTag(in));
 }
 
-void Manifest::readTagVersionLabel(Manifest &mfst, json_t *in)
+void Manifest::readTagVersionLabel(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag version label" << std::endl;
-
     mfst.setVersionLabal(readStringTag(in));
 }
 
-void Manifest::readTagDescription(Manifest &mfst, json_t *in)
+void Manifest::readTagDescription(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag description" << std::endl;
-
     mfst.setDescription(readStringTag(in));
 }
 
-void Manifest::readTagLicense(Manifest &mfst, json_t *in)
+void Manifest::readTagLicense(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag license" << std::endl;
-
     mfst.setLicense(readStringTag(in));
 }
 
-void Manifest::readTagFiles(Manifest &mfst, json_t *in)
+void Manifest::readTagCompression(Manifest &mfst, JsonReader &in)
 {
-    std::cout << "read tag files" << std::endl;
+    if (in.peek() != JsonReader::Type::Object)
+        throw "invalid arguments";
+
+    rose::Compression c;
+    bool has_codec = false;
+
+    std::string_view key;
+    in.beginObject();
+    while (in.nextMember(key)) {
+        if (key == "codec") {
+            if (in.peek() != JsonReader::Type::String)
+                throw "no codec in section 'compression'";
+            c.codec = Compression::codecFromName(std::string(in.readString()));
+            has_codec = true;
+        } else if (key == "level") {
+            if (in.peek() != JsonReader::Type::Number)
+                throw "invalid level in section 'compression'";
+            c.level = in.readInteger();
+        } else {
+            in.skipValue();
+        }
+    }
+    if (!has_codec)
+        throw "no codec in section 'compression'";
+
+    mfst.setCompression(c);
+}
 
-    if (!in || json_typeof(in) != JSON_ARRAY)
+void Manifest::readTagFiles(Manifest &mfst, JsonReader &in)
+{
+    if (in.peek() != JsonReader::Type::Array)
         throw "invalid arguments";
 
-    int i;
-    json_t *pkg;
-    json_array_foreach(in, i, pkg)
-    {
-        if (json_typeof(pkg) != JSON_OBJECT)
-            throw "invalid data in section 'depends'";
+    in.beginArray();
+    while (in.nextElement()) {
+        if (in.peek() != JsonReader::Type::Object)
+            throw "invalid data in section 'files'";
+
+        File *f = nullptr;
+        FileHash hash;
+        bool has_hash = false;
+        int64_t mode = 0;
+
+        std::string_view key;
+        in.beginObject();
+        while (in.nextMember(key)) {
+            if (key == "name") {
+                if (in.peek() != JsonReader::Type::String)
+                    throw "no package name";
+                // the files must stay inside the data directory they are installed to
+                std::string_view name = in.readString();
+                if (!isSafePath(name))
+                    throw "invalid file name";
+                f = &mfst.addFile(name);
+            } else if (key == "hash") {
+                if (in.peek() != JsonReader::Type::String)
+                    throw "invalid file hash";
+
+                // an empty string is a file without hash
+                std::string_view hash_str = in.readString();
+                if (!hash_str.empty()) {
+                    if (hash_str.size() != 2 * hash.size())
+                        throw "invalid file hash";
+                    for (size_t i = 0; i < hash.size(); i++) {
+                        int b = hex2byte(hash_str.data() + 2 * i);
+                        if (b < 0)
+                            throw "invalid file hash";
+                        hash[i] = b;
+                    }
+                    has_hash = true;
+                }
+            } else if (key == "mode") {
+                if (in.peek() != JsonReader::Type::Number)
+                    throw "invalid file mode";
+                mode = in.readInteger();
+                if (mode < 0 || mode > 07777)
+                    throw "invalid file mode";
+            } else {
+                // TODO: type
+                in.skipValue();
+            }
+        }
 
-        json_t *file_name = json_object_get(pkg, "name");
-        if (!file_name || json_typeof(file_name) != JSON_STRING)
+        if (!f)
             throw "no package name";
+        if (has_hash)
+            f->setHash(hash);
+        f->setMode(static_cast<uint32_t>(mode));
+    }
 
-        File f;
-
-        const char *name_str = json_string_value(file_name);
-        f.setName(name_str);
+    // the number of files is not known in advance, release the spare capacity of the growth
+    mfst.files().shrink_to_fit();
+}
 
-        std::cout << "file: " << name_str << std::endl;
+rose::Compression Manifest::compression() const { return mCompression; }
 
-        json_t *file_type = json_object_get(pkg, "type");
-        if (file_type) {
-            // TODO
-        }
+void Manifest::setCompression(const rose::Compression &compression) { mCompression = compression; }
 
-        json_t *file_hash = json_object_get(pkg, "hash");
-        if (file_hash) {
-            // TODO
-        }
+std::vector<File> &Manifest::files() { return mFiles; }
 
-        mfst.files().push_back(f);
-    }
+File &Manifest::addFile(std::string_view name)
+{
+    mFiles.emplace_back(mFileNames.add(name));
+    return mFiles.back();
 }
 
-std::list<File> &Manifest::files() { return mFiles; }
+void Manifest::setFiles(const std::vector<File> &files)
+{
+    // the files may refer to the arena of this manifest, so they are copied before it is freed
+    std::vector<File> copies;
+    StringArena names;
+    copies.reserve(files.size());
+    for (auto &f : files) {
+        File &copy = copies.emplace_back(names.add(f.name()));
+        if (f.hasHash())
+            copy.setHash(f.hash());
+        copy.setMode(f.mode());
+    }
 
-void Manifest::setFiles(const std::list<File> &files) { mFiles = files; }
+    mFiles = std::move(copies);
+    mFileNames = std::move(names);
+}
 
 std::string Manifest::license() const { return mLicense; }
 
@@ -496,20 +937,20 @@ std::string Manifest::source() const { return mSource; }
 
 void Manifest::setSource(const std::string &source) { mSource = source; }
 
-std::list<Dependency> Manifest::dependencies() const { return mDependencies; }
+const std::vector<Dependency> &Manifest::dependencies() const { return mDependencies; }
 
-void Manifest::setDependencies(const std::list<Dependency> &dependencies)
+void Manifest::setDependencies(const std::vector<Dependency> &dependencies)
 {
     mDependencies = dependencies;
 }
 
-void Manifest::setLocales(const std::list<std::string> &locales) { mLocales = locales; }
+void Manifest::setLocales(const std::vector<std::string> &locales) { mLocales = locales; }
 
 std::string Manifest::targetArch() const { return mTargetArch; }
 
 void Manifest::setTargetArch(const std::string &targetArch) { mTargetArch = targetArch; }
 
-std::list<std::string> &Manifest::locales() { return mLocales; }
+std::vector<std::string> &Manifest::locales() { return mLocales; }
 
 int32_t Manifest::apiMax() const { return mApiMax; }
 
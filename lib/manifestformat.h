@@ -0,0 +1,108 @@
+/**
+ * @file manifestformat.h
+ * @brief Layout of the binary manifest format.
+ *
+ * All sections are arrays of fixed size records that are aligned to 8 bytes and referenced by
+ * offset from the start of the manifest. Strings are stored once in the string table at the end,
+ * each followed by a null byte. The values are stored in the byte order of the writer, which is
+ * recorded in the header and checked by the reader.
+ *
+ *     Header
+ *     StringRef        locales[localeCount]
+ *     DependencyRecord dependencies[dependencyCount]
+ *     Interval         intervals[intervalCount]
+ *     FileRecord       files[fileCount]
+ *     uint32           fileIndex[fileCount]     indices of the files sorted by name
+ *     char             strings[stringTableSize]
+ */
+#ifndef _MANIFESTFORMAT_H
+#define _MANIFESTFORMAT_H
+
+#include <rps/file.h>
+#include <cstdint>
+
+#define MANIFEST_BINARY_MAGIC "RPSMANIF"
+#define MANIFEST_BINARY_VERSION 1
+#define MANIFEST_BINARY_BYTE_ORDER 0x01020304
+#define MANIFEST_BINARY_ALIGN 8
+
+namespace rose
+{
+namespace ManifestFormat
+{
+
+struct StringRef {
+    uint32_t offset; // in the string table
+    uint32_t length; // without the null byte
+};
+
+enum StringField {
+    Name,
+    Arch,
+    Source,
+    Vendor,
+    Label,
+    VersionLabel,
+    Description,
+    License,
+    StringFieldCount
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t size;
+    int32_t manifestVersion;
+    int32_t packageVersion;
+    int32_t apiMin;
+    int32_t apiTarget;
+    int32_t apiMax;
+    uint32_t codec;
+    int32_t level;
+    StringRef strings[StringFieldCount];
+    uint32_t localeCount;
+    uint32_t localesOffset;
+    uint32_t dependencyCount;
+    uint32_t dependenciesOffset;
+    uint32_t intervalCount;
+    uint32_t intervalsOffset;
+    uint32_t fileCount;
+    uint32_t filesOffset;
+    uint32_t fileIndexOffset;
+    uint32_t stringTableOffset;
+    uint32_t stringTableSize;
+    uint32_t reserved;
+};
+
+struct Interval {
+    int32_t start;
+    int32_t end;
+};
+
+struct DependencyRecord {
+    StringRef name;
+    uint32_t requiresIndex; // first entry in intervals
+    uint32_t requiresCount;
+    uint32_t conflictsIndex;
+    uint32_t conflictsCount;
+};
+
+enum FileFlags { HasHash = 1 };
+
+struct FileRecord {
+    StringRef name;
+    uint32_t flags;
+    uint32_t mode; // permission bits, 0 if unknown
+    FileHash hash;
+};
+
+static_assert(sizeof(Header) == 160, "unexpected size of the binary manifest header");
+static_assert(
+    sizeof(DependencyRecord) % MANIFEST_BINARY_ALIGN == 0, "unaligned dependency records");
+static_assert(sizeof(FileRecord) == 48, "unexpected size of binary manifest file records");
+
+} // namespace ManifestFormat
+} // namespace rose
+
+#endif /* _MANIFESTFORMAT_H */
@@ -0,0 +1,205 @@
+/**
+ * @file manifestview.cpp
+ */
+#include "rps/manifestview.h"
+#include "manifestformat.h"
+#include <rps/exception.h>
+#include <cstring>
+
+namespace rose
+{
+
+using namespace ManifestFormat;
+
+ManifestView::FileView::FileView(const ManifestView *view, const FileRecord *file)
+    : mView(view), mFile(file)
+{
+}
+
+std::string_view ManifestView::FileView::name() const { return mView->string(mFile->name); }
+
+bool ManifestView::FileView::hasHash() const { return mFile->flags & HasHash; }
+
+const FileHash &ManifestView::FileView::hash() const { return mFile->hash; }
+
+uint32_t ManifestView::FileView::mode() const { return mFile->mode; }
+
+ManifestView::ManifestView() : mData(nullptr), mHeader(nullptr) {}
+
+bool ManifestView::isBinaryManifest(const void *data, size_t size)
+{
+    return size >= sizeof(Header) && memcmp(data, MANIFEST_BINARY_MAGIC, 8) == 0;
+}
+
+/** Check that an array of count records of size bytes lies inside the manifest. */
+static bool inBounds(uint32_t offset, uint64_t count, size_t size, uint32_t total)
+{
+    return offset % MANIFEST_BINARY_ALIGN == 0 && offset <= total &&
+           count * size <= total - offset;
+}
+
+bool ManifestView::open(const void *data, size_t size)
+{
+    if (!isBinaryManifest(data, size) ||
+        reinterpret_cast<uintptr_t>(data) % MANIFEST_BINARY_ALIGN != 0)
+        return false;
+
+    auto header = static_cast<const Header *>(data);
+    if (header->version != MANIFEST_BINARY_VERSION ||
+        header->byteOrder != MANIFEST_BINARY_BYTE_ORDER || header->size > size ||
+        header->size < sizeof(Header))
+        return false;
+
+    uint32_t total = header->size;
+    if (!inBounds(header->localesOffset, header->localeCount, sizeof(StringRef), total) ||
+        !inBounds(header->dependenciesOffset, header->dependencyCount, sizeof(DependencyRecord),
+            total) ||
+        !inBounds(header->intervalsOffset, header->intervalCount, sizeof(Interval), total) ||
+        !inBounds(header->filesOffset, header->fileCount, sizeof(FileRecord), total) ||
+        !inBounds(header->fileIndexOffset, header->fileCount, sizeof(uint32_t), total) ||
+        !inBounds(header->stringTableOffset, header->stringTableSize, 1, total))
+        return false;
+
+    mData = static_cast<const uint8_t *>(data);
+    mHeader = header;
+    return true;
+}
+
+std::string_view ManifestView::string(const StringRef &ref) const
+{
+    if (uint64_t(ref.offset) + ref.length >= mHeader->stringTableSize)
+        throw Exception("invalid string in binary manifest");
+
+    const char *s = reinterpret_cast<const char *>(mData + mHeader->stringTableOffset);
+    return std::string_view(s + ref.offset, ref.length);
+}
+
+VersionInterval ManifestView::interval(uint32_t index) const
+{
+    if (index >= mHeader->intervalCount)
+        throw Exception("invalid version interval in binary manifest");
+
+    auto intervals = reinterpret_cast<const Interval *>(mData + mHeader->intervalsOffset);
+    return {intervals[index].start, intervals[index].end};
+}
+
+int32_t ManifestView::manifestVersion() const { return mHeader->manifestVersion; }
+
+std::string_view ManifestView::packageName() const { return string(mHeader->strings[Name]); }
+
+int32_t ManifestView::packageVersion() const { return mHeader->packageVersion; }
+
+int32_t ManifestView::apiMin() const { return mHeader->apiMin; }
+
+int32_t ManifestView::apiTarget() const { return mHeader->apiTarget; }
+
+int32_t ManifestView::apiMax() const { return mHeader->apiMax; }
+
+std::string_view ManifestView::targetArch() const { return string(mHeader->strings[Arch]); }
+
+std::string_view ManifestView::source() const { return string(mHeader->strings[Source]); }
+
+std::string_view ManifestView::vendor() const { return string(mHeader->strings[Vendor]); }
+
+std::string_view ManifestView::packageLabel() const { return string(mHeader->strings[Label]); }
+
+std::string_view ManifestView::versionLabel() const
+{
+    return string(mHeader->strings[VersionLabel]);
+}
+
+std::string_view ManifestView::description() const
+{
+    return string(mHeader->strings[Description]);
+}
+
+std::string_view ManifestView::license() const { return string(mHeader->strings[License]); }
+
+Compression ManifestView::compression() const
+{
+    if (mHeader->codec > static_cast<uint32_t>(Compression::Codec::Lz4))
+        throw Exception("invalid codec in binary manifest");
+
+    Compression c;
+    c.codec = static_cast<Compression::Codec>(mHeader->codec);
+    c.level = mHeader->level;
+    return c;
+}
+
+size_t ManifestView::localeCount() const { return mHeader->localeCount; }
+
+std::string_view ManifestView::locale(size_t i) const
+{
+    return string(reinterpret_cast<const StringRef *>(mData + mHeader->localesOffset)[i]);
+}
+
+size_t ManifestView::dependencyCount() const { return mHeader->dependencyCount; }
+
+static const DependencyRecord &dependency(const uint8_t *data, const Header *header, size_t i)
+{
+    return reinterpret_cast<const DependencyRecord *>(data + header->dependenciesOffset)[i];
+}
+
+std::string_view ManifestView::dependencyName(size_t i) const
+{
+    return string(dependency(mData, mHeader, i).name);
+}
+
+size_t ManifestView::requiresCount(size_t i) const
+{
+    return dependency(mData, mHeader, i).requiresCount;
+}
+
+VersionInterval ManifestView::requiresInterval(size_t i, size_t j) const
+{
+    const DependencyRecord &d = dependency(mData, mHeader, i);
+    if (j >= d.requiresCount)
+        throw Exception("invalid version interval in binary manifest");
+    return interval(d.requiresIndex + j);
+}
+
+size_t ManifestView::conflictsCount(size_t i) const
+{
+    return dependency(mData, mHeader, i).conflictsCount;
+}
+
+VersionInterval ManifestView::conflictsInterval(size_t i, size_t j) const
+{
+    const DependencyRecord &d = dependency(mData, mHeader, i);
+    if (j >= d.conflictsCount)
+        throw Exception("invalid version interval in binary manifest");
+    return interval(d.conflictsIndex + j);
+}
+
+size_t ManifestView::fileCount() const { return mHeader->fileCount; }
+
+ManifestView::FileView ManifestView::file(size_t i) const
+{
+    return FileView(this, reinterpret_cast<const FileRecord *>(mData + mHeader->filesOffset) + i);
+}
+
+bool ManifestView::findFile(std::string_view name, size_t &i) const
+{
+    auto index = reinterpret_cast<const uint32_t *>(mData + mHeader->fileIndexOffset);
+
+    size_t lo = 0, hi = mHeader->fileCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index[mid] >= mHeader->fileCount)
+            throw Exception("invalid file index in binary manifest");
+
+        int c = name.compare(file(index[mid]).name());
+        if (c == 0) {
+            i = index[mid];
+            return true;
+        }
+        if (c < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return false;
+}
+
+} // namespace rose
@@ -0,0 +1,46 @@
+/**
+ * @file mappedfile.cpp
+ */
+#include "mappedfile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rose
+{
+
+MappedFile::MappedFile() : mFd(-1), mData(MAP_FAILED), mSize(0) {}
+
+MappedFile::~MappedFile()
+{
+    if (mData != MAP_FAILED)
+        munmap(mData, mSize);
+    if (mFd >= 0)
+        close(mFd);
+}
+
+bool MappedFile::open(const std::string &path, bool sequential)
+{
+    struct stat st;
+
+    mFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (mFd < 0 || fstat(mFd, &st) != 0 || st.st_size == 0)
+        return false;
+
+    mSize = st.st_size;
+    mData = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, mFd, 0);
+    if (mData == MAP_FAILED)
+        return false;
+
+    madvise(mData, mSize, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    return true;
+}
+
+int MappedFile::fd() const { return mFd; }
+
+const uint8_t *MappedFile::data() const { return static_cast<const uint8_t *>(mData); }
+
+size_t MappedFile::size() const { return mSize; }
+
+} // namespace rose
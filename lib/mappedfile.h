@@ -0,0 +1,43 @@
+/**
+ * @file mappedfile.h
+ * @brief Read-only memory mapping of a file.
+ */
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace rose
+{
+
+class MappedFile
+{
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * @brief Map a whole file.
+     * @param sequential Advise the kernel that the file is read front to back.
+     * @return false if the file cannot be opened or mapped, or is empty
+     */
+    bool open(const std::string &path, bool sequential = true);
+
+    int fd() const;
+    const uint8_t *data() const;
+    size_t size() const;
+
+  private:
+    int mFd;
+    void *mData;
+    size_t mSize;
+};
+
+} // namespace rose
+
+#endif /* _MAPPEDFILE_H */
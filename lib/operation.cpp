@@ -0,0 +1,103 @@
+/**
+ * @file operation.cpp
+ */
+#include "rps/operation.h"
+
+namespace rose
+{
+
+constexpr std::chrono::milliseconds Operation::ProgressInterval;
+
+Operation::Operation(ProgressCallback callback)
+    : mCallback(std::move(callback)), mStart(std::chrono::steady_clock::now()),
+      mLastReport(mStart - ProgressInterval), mFuture(mPromise.get_future().share())
+{
+}
+
+void Operation::cancel() { mCancelled = true; }
+
+bool Operation::cancelled() const { return mCancelled; }
+
+Progress Operation::progress() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mProgress;
+}
+
+void Operation::wait() const { mFuture.get(); }
+
+std::shared_future<void> Operation::future() const { return mFuture; }
+
+void Operation::start(uint64_t bytes_total, uint64_t entries_total)
+{
+    if (mCancelled)
+        throw OperationCancelled();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStart = std::chrono::steady_clock::now();
+    mProgress = Progress{0, bytes_total, 0, entries_total, -1};
+}
+
+void Operation::update(uint64_t bytes_done, uint64_t entries_done)
+{
+    if (mCancelled)
+        throw OperationCancelled();
+
+    auto now = std::chrono::steady_clock::now();
+    Progress progress;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mProgress.bytesDone = bytes_done;
+        mProgress.entriesDone = entries_done;
+
+        // the rate so far, by bytes if the total is known
+        double elapsed = std::chrono::duration<double>(now - mStart).count();
+        double done = mProgress.bytesTotal ? bytes_done : entries_done;
+        double total = mProgress.bytesTotal ? mProgress.bytesTotal : mProgress.entriesTotal;
+        mProgress.eta = done > 0 && total >= done ? elapsed * (total - done) / done : -1;
+
+        if (!mCallback || now - mLastReport < ProgressInterval)
+            return;
+        mLastReport = now;
+        progress = mProgress;
+    }
+    mCallback(progress);
+}
+
+void Operation::addCreatedPath(const std::filesystem::path &path)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCreatedPaths.push_back(path);
+}
+
+void Operation::finish(std::exception_ptr error)
+{
+    if (error) {
+        // later paths may lie inside earlier ones
+        std::error_code ec;
+        for (auto it = mCreatedPaths.rbegin(); it != mCreatedPaths.rend(); ++it)
+            std::filesystem::remove_all(*it, ec);
+        mPromise.set_exception(error);
+        return;
+    }
+
+    Progress progress;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mProgress.bytesTotal)
+            mProgress.bytesDone = mProgress.bytesTotal;
+        if (mProgress.entriesTotal)
+            mProgress.entriesDone = mProgress.entriesTotal;
+        mProgress.eta = 0;
+        progress = mProgress;
+    }
+    if (mCallback) {
+        try {
+            mCallback(progress);
+        } catch (...) {
+        }
+    }
+    mPromise.set_value();
+}
+
+} // namespace rose
@@ -2,15 +2,35 @@
  * @file package.cpp
  */
 #include "rps/package.h"
+#include "archivefilter.h"
+#include "blockcompressor.h"
+#include "delta.h"
+#include "entrywriter.h"
+#include "mappedfile.h"
+#include "packageindex.h"
+#include "sha256.h"
+#include "signature.h"
+#include "tarreader.h"
+#include "tracespan.h"
 #include <rps/exception.h>
 #include <archive.h>
+#include <jansson.h>
 #include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <cerrno>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <list>
+#include <map>
 #include <memory>
+#include <optional>
+#include <set>
 #include <vector>
 #include <archive_entry.h>
 
@@ -22,6 +42,350 @@
 namespace rose
 {
 
+/** Files extracted under a temporary name until their hash is verified. */
+struct StagedFile {
+    std::string name;
+    std::filesystem::path path;
+    std::optional<FileHash> hash;
+
+    std::filesystem::path tmpPath() const { return path.string() + ".rps-tmp"; }
+};
+
+/** Removes the temporary files of all entries that have not been committed. */
+struct StagedFiles : public std::list<StagedFile> {
+    ~StagedFiles()
+    {
+        for (auto &f : *this)
+            unlink(f.tmpPath().c_str());
+    }
+};
+
+/**
+ * @brief Move verified files to their final name and discard all others.
+ * @return the names of the discarded files
+ */
+static std::list<std::string> commitStagedFiles(StagedFiles &staged, Manifest &manifest)
+{
+    std::map<std::string_view, const File *> files;
+    for (auto &f : manifest.files())
+        files[f.name()] = &f;
+
+    std::list<std::string> failed;
+    for (auto &f : staged) {
+        auto it = files.find(f.name);
+        if (it != files.end() && f.hash && it->second->hasHash() && it->second->hash() == *f.hash &&
+            rename(f.tmpPath().c_str(), f.path.c_str()) == 0)
+            continue;
+
+        unlink(f.tmpPath().c_str());
+        failed.push_back(f.name);
+    }
+    staged.clear();
+
+    return failed;
+}
+
+/**
+ * @brief Find a file of the manifest that is neither staged nor skipped.
+ * @param skipped Entries that are not extracted, e.g. "data/<name>" of Package::upgrade().
+ * @return false if the package has all files
+ */
+static bool findMissingFile(const StagedFiles &staged, Manifest &manifest,
+    const std::set<std::string> &skipped, std::string &missing)
+{
+    std::set<std::string_view> names;
+    for (auto &f : staged)
+        names.insert(f.name);
+
+    for (auto &f : manifest.files()) {
+        if (names.count(f.name()) || skipped.count("data/" + std::string(f.name())))
+            continue;
+        missing = f.name();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Copy a range of a mapped file to a file descriptor.
+ *
+ * The data is copied inside the kernel with copy_file_range(), which shares the extents on file
+ * systems with reflink support, or with sendfile(). Only if both are not available the data is
+ * written from the mapping.
+ */
+static void copyFileRange(const MappedFile &in, uint64_t offset, uint64_t length, int out_fd)
+{
+    loff_t in_offset = offset;
+    while (length > 0) {
+        ssize_t n = copy_file_range(in.fd(), &in_offset, out_fd, nullptr, length, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        length -= n;
+    }
+
+    while (length > 0) {
+        off_t off = in_offset;
+        ssize_t n = sendfile(out_fd, in.fd(), &off, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        in_offset = off;
+        length -= n;
+    }
+
+    while (length > 0) {
+        ssize_t n = write(out_fd, in.data() + in_offset, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            throw Exception(std::string("write() failed: ") + strerror(errno));
+        in_offset += n;
+        length -= n;
+    }
+}
+
+static void writeAll(int fd, const void *data, size_t length)
+{
+    auto p = static_cast<const uint8_t *>(data);
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            throw Exception(std::string("write() failed: ") + strerror(errno));
+        p += n;
+        length -= n;
+    }
+}
+
+/** xz readers reject data after the last stream, so xz packages are written without index. */
+static bool hasIndex(const Compression &compression)
+{
+    return compression.codec != Compression::Codec::Xz;
+}
+
+static la_ssize_t sinkWrite(struct archive *a, void *client_data, const void *buffer, size_t size)
+{
+    try {
+        static_cast<PackageSink *>(client_data)->write(buffer, size);
+    } catch (const std::exception &e) {
+        archive_set_error(a, EIO, "%s", e.what());
+        return -1;
+    }
+    return static_cast<la_ssize_t>(size);
+}
+
+static int sinkClose(struct archive *a, void *client_data)
+{
+    try {
+        static_cast<PackageSink *>(client_data)->close();
+    } catch (const std::exception &e) {
+        archive_set_error(a, EIO, "%s", e.what());
+        return ARCHIVE_FATAL;
+    }
+    return ARCHIVE_OK;
+}
+
+/**
+ * @brief Open an archive that writes a package to a sink, which must outlive the archive.
+ * @param index If set, the blocks and entries are indexed, see hasIndex().
+ */
+static struct archive *openPackageFile(PackageSink &sink, const Compression &compression,
+    unsigned int threads, PackageIndex *index, std::unique_ptr<BlockCompressor> &compressor)
+{
+    struct archive *a = archive_write_new();
+    archive_write_set_format_pax_restricted(a);
+
+    int r;
+    if (!index && threads == 1) {
+        r = addArchiveFilter(a, compression);
+        // the sink gets the bytes as they are, like archive_write_open_filename() does
+        if (r == ARCHIVE_OK)
+            r = archive_write_set_bytes_in_last_block(a, 1);
+        if (r == ARCHIVE_OK)
+            r = archive_write_open(a, &sink, nullptr, sinkWrite, sinkClose);
+    } else {
+        compressor = std::make_unique<BlockCompressor>(sink, compression, threads, index);
+        r = compressor->open(a);
+    }
+    if (r != ARCHIVE_OK) {
+        std::string error = archiveError(a);
+        archive_write_free(a);
+        throw Exception("cannot create package file: " + error);
+    }
+
+    return a;
+}
+
+static void closePackageFile(struct archive *a)
+{
+    int r = archive_write_close(a);
+    if (r != ARCHIVE_OK) {
+        std::string error = archiveError(a);
+        archive_write_free(a);
+        throw Exception("cannot write package file: " + error);
+    }
+    archive_write_free(a);
+}
+
+/** The mode of entries added from buffers and of files of manifests without modes. */
+static constexpr mode_t DefaultEntryMode = 0644;
+
+static void writeEntryHeader(struct archive *a, const std::string &dest, uint64_t size,
+    PackageIndex *index, mode_t mode = DefaultEntryMode)
+{
+    struct archive_entry *entry = archive_entry_new();
+    archive_entry_set_pathname(entry, dest.c_str());
+    archive_entry_set_size(entry, size);
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, mode);
+    int r = archive_write_header(a, entry);
+    archive_entry_free(entry);
+    if (r < ARCHIVE_OK)
+        throw Exception("cannot write entry " + dest + ": " + archiveError(a));
+    // the header is passed on immediately, so the uncompressed position is the data offset
+    if (index)
+        index->addEntry({dest, static_cast<uint64_t>(archive_filter_bytes(a, 0)), size});
+}
+
+static void writeEntryData(struct archive *a, const std::string &dest, const void *data,
+    size_t size)
+{
+    if (size > 0 && archive_write_data(a, data, size) != static_cast<la_ssize_t>(size))
+        throw Exception("cannot write entry " + dest + ": " + archiveError(a));
+}
+
+static void addBuffer(struct archive *a, const std::string &dest, const void *data, size_t size,
+    PackageIndex *index)
+{
+    writeEntryHeader(a, dest, size, index);
+    writeEntryData(a, dest, data, size);
+}
+
+/** The limit of the entry data read ahead of the writers of extractArchive(). */
+static constexpr size_t MaxBufferedEntries = 64 * 1024 * 1024;
+
+/** Larger entries are streamed to disk by the reader instead of being buffered. */
+static constexpr size_t MaxBufferedEntry = 8 * 1024 * 1024;
+
+/** The size of the reads from a PackageSource. */
+static constexpr size_t SourceBufferSize = 64 * 1024;
+
+/**
+ * @brief Open the parent directory of a relative path below a directory.
+ *
+ * Missing directories are created and no symlinks are followed.
+ * @param leaf Receives the last component of the path.
+ * @return the file descriptor of the parent directory or -1
+ */
+static int openParentAt(int dir_fd, const std::string &path, std::string &leaf)
+{
+    int fd = dup(dir_fd);
+    size_t start = 0, end;
+    while (fd >= 0 && (end = path.find('/', start)) != std::string::npos) {
+        std::string component = path.substr(start, end - start);
+        start = end + 1;
+        if (component.empty() || component == ".")
+            continue;
+        mkdirat(fd, component.c_str(), 0755);
+        int next = openat(fd, component.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        ::close(fd);
+        fd = next;
+    }
+    leaf = path.substr(start);
+    return fd;
+}
+
+/**
+ * @brief Create an extracted file with the mode and modification time of its entry.
+ * @param write Writes the data to the file descriptor.
+ */
+static void createEntryFile(const std::filesystem::path &path, mode_t mode,
+    const struct timespec &mtime, const std::function<void(int)> &write)
+{
+    // an existing symlink is replaced, not followed
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW;
+    int fd = ::open(path.c_str(), flags, 0600);
+    if (fd < 0 && errno == ELOOP && unlink(path.c_str()) == 0)
+        fd = ::open(path.c_str(), flags, 0600);
+    if (fd < 0)
+        throw Exception("cannot create file: " + path.string());
+
+    try {
+        write(fd);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+
+    struct timespec times[2] = {mtime, mtime};
+    fchmod(fd, mode);
+    futimens(fd, times);
+    if (::close(fd) != 0)
+        throw Exception("cannot write file: " + path.string());
+}
+
+/** Regular files that need no features of archive_write_disk() beyond the mode and time. */
+static bool isBufferedEntry(struct archive_entry *entry)
+{
+    return archive_entry_filetype(entry) == AE_IFREG && !archive_entry_hardlink(entry) &&
+           archive_entry_size(entry) <= static_cast<int64_t>(MaxBufferedEntry) &&
+           !archive_entry_fflags_text(entry) &&
+           archive_entry_acl_count(
+               entry, ARCHIVE_ENTRY_ACL_TYPE_POSIX1E | ARCHIVE_ENTRY_ACL_TYPE_NFS4) == 0;
+}
+
+/**
+ * @brief Read the data of the current entry of an archive.
+ * @return false on a read error
+ */
+static bool readEntryData(struct archive *a, size_t size, std::string &data)
+{
+    data.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        la_ssize_t n = archive_read_data(a, data.data() + done, size - done);
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+        done += n;
+    }
+    data.resize(done);
+    return true;
+}
+
+/**
+ * @brief Write data to a new file and hash it.
+ * @return the hash of the data
+ */
+static FileHash writeHashedFile(const std::filesystem::path &path,
+    const std::function<void(const std::function<void(const uint8_t *, size_t)> &)> &produce)
+{
+    std::filesystem::create_directories(path.parent_path());
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw Exception("cannot create file: " + path.string());
+
+    Sha256 sha;
+    try {
+        produce([&](const uint8_t *data, size_t length) {
+            sha.update(data, length);
+            writeAll(fd, data, length);
+        });
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+
+    if (::close(fd) != 0)
+        throw Exception("cannot write file: " + path.string());
+    return sha.finish();
+}
+
 Package::Package() {}
 
 Package::Package(std::string package_file) : mPackagePath(package_file) { extract(package_file); }
@@ -30,14 +394,355 @@ Package::~Package() {}
 
 void Package::extract(const std::string &package_path, const std::filesystem::path &destination)
 {
+    if (mOperation) {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(package_path, ec);
+        uint64_t files = mPackagePath == package_path ? mManifest.files().size() : 0;
+        mOperation->start(ec ? 0 : size, files);
+    }
     if (!package_path.empty())
         mPackagePath = package_path;
 
+    extractFrom(package_path, nullptr, destination);
+}
+
+void Package::extract(PackageSource &source, const std::filesystem::path &destination)
+{
+    // the size of a stream is not known in advance
+    if (mOperation)
+        mOperation->start(0, 0);
+
+    extractFrom(std::string(), &source, destination);
+}
+
+void Package::extractFrom(const std::string &package_path, PackageSource *source,
+    const std::filesystem::path &destination)
+{
     std::filesystem::path dest_dir =
         destination.empty() ? std::filesystem::current_path() : destination;
     mExtractedDir = dest_dir;
-    std::cout << std::string("extract to: ") << dest_dir << std::endl;
+    if (Trace::verbosity() >= 1)
+        std::cout << std::string("extract to: ") << dest_dir << std::endl;
+
+    TraceSpan span("extract");
+    StagedFiles staged;
+    std::string manifest_buffer;
+
+    if (source) {
+        extractArchive(*source, staged, manifest_buffer);
+    } else if (!extractUncompressed(package_path, staged, manifest_buffer)) {
+        // an empty path reads the package from stdin like archive_read_open_filename() does
+        std::unique_ptr<PackageSource> file;
+        if (package_path.empty())
+            file = std::make_unique<FdSource>(STDIN_FILENO);
+        else
+            file = std::make_unique<FileSource>(package_path);
+        extractArchive(*file, staged, manifest_buffer);
+    }
+
+    if (mVerifyHashes) {
+        if (manifest_buffer.empty() && !mSignatureVerified)
+            throw Exception("package contains no manifest: " + package_path);
+
+        // with a verified signature the files are checked against the signed manifest
+        if (!mSignatureVerified) {
+            mManifest = Manifest();
+            mManifest.readFromBuffer(manifest_buffer);
+        }
+
+        // nothing is committed if a file of the manifest is not in the package
+        std::string missing;
+        if (findMissingFile(staged, mManifest, mSkippedEntries, missing))
+            throw Exception("file is missing in package: " + missing);
+
+        TraceSpan commit_span("commit");
+        commit_span.addEntries(staged.size());
+        std::list<std::string> failed = commitStagedFiles(staged, mManifest);
+        if (!failed.empty())
+            throw Exception("hash verification failed for file: " + failed.front());
+    }
+
+    // the manifests of the package are not extracted, the signed one is written instead
+    if (mSignatureVerified) {
+        try {
+            mManifest.writeManifestFile((dest_dir / "manifest.json").string());
+            mManifest.writeManifestFile(
+                (dest_dir / "manifest.bin").string(), Manifest::Format::Binary);
+        } catch (const char *error) {
+            throw Exception(std::string(error) + ": " + dest_dir.string());
+        }
+    }
+}
+
+size_t Package::upgrade(const std::string &package_path,
+    const std::filesystem::path &installed_dir, const std::filesystem::path &destination)
+{
+    // a manifest that was read before keeps a verified signature
+    if (mPackagePath != package_path)
+        readManifest(package_path);
+
+    Manifest installed;
+    try {
+        installed.readFromFile((installed_dir / "manifest.json").string());
+    } catch (const char *) {
+        // nothing to compare with, all files are extracted
+    }
+
+    std::map<FileHash, std::string_view> by_hash;
+    std::map<std::string_view, const File *> by_name;
+    for (auto &f : installed.files()) {
+        if (!f.hasHash())
+            continue;
+        by_hash.emplace(f.hash(), f.name());
+        by_name[f.name()] = &f;
+    }
+
+    // the files are linked relative to the data directories, the names of both manifests are
+    // checked when they are read
+    std::error_code ec;
+    std::filesystem::create_directories(destination / "data", ec);
+    int dest_fd = ::open((destination / "data").c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dest_fd < 0)
+        throw Exception("cannot create directory: " + (destination / "data").string());
+    int installed_fd = ::open((installed_dir / "data").c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    mSkippedEntries.clear();
+    for (auto &f : mManifest.files()) {
+        if (!f.hasHash() || installed_fd < 0)
+            continue;
+
+        // an unchanged file keeps its name, a moved file is found by its content
+        auto same_name = by_name.find(f.name());
+        auto same_hash = by_hash.find(f.hash());
+        std::string name;
+        if (same_name != by_name.end() && same_name->second->hash() == f.hash())
+            name = f.name();
+        else if (same_hash != by_hash.end())
+            name = same_hash->second;
+        else
+            continue;
+
+        // a file whose mode changed is extracted, the installed revision is not modified
+        struct stat st;
+        mode_t mode = f.mode() ? f.mode() : DefaultEntryMode;
+        if (fstatat(installed_fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISREG(st.st_mode) || (st.st_mode & 07777) != mode)
+            continue;
+
+        std::string leaf;
+        int parent_fd = openParentAt(dest_fd, std::string(f.name()), leaf);
+        if (parent_fd < 0)
+            continue;
+        unlinkat(parent_fd, leaf.c_str(), 0);
+        if (linkat(installed_fd, name.c_str(), parent_fd, leaf.c_str(), 0) == 0)
+            mSkippedEntries.insert("data/" + std::string(f.name()));
+        ::close(parent_fd);
+    }
+    if (installed_fd >= 0)
+        ::close(installed_fd);
+    ::close(dest_fd);
+
+    try {
+        extract(package_path, destination);
+    } catch (...) {
+        mSkippedEntries.clear();
+        throw;
+    }
+
+    size_t extracted = mManifest.files().size() - mSkippedEntries.size();
+    mSkippedEntries.clear();
+    return extracted;
+}
+
+std::shared_ptr<Operation> Package::extractAsync(const std::string &package_path,
+    const std::filesystem::path &destination, const Executor &executor, ProgressCallback callback)
+{
+    return runAsync(executor, std::move(callback),
+        [this, package_path, destination]() { extract(package_path, destination); });
+}
+
+std::shared_ptr<Operation> Package::writePackageAsync(
+    const std::filesystem::path &dest_dir, const Executor &executor, ProgressCallback callback)
+{
+    return runAsync(executor, std::move(callback), [this, dest_dir]() { writePackge(dest_dir); });
+}
+
+std::shared_ptr<Operation> Package::runAsync(
+    const Executor &executor, ProgressCallback callback, std::function<void()> job)
+{
+    std::shared_ptr<Operation> operation(new Operation(std::move(callback)));
+    executor([this, operation, job = std::move(job)]() {
+        mOperation = operation;
+        std::exception_ptr error;
+        try {
+            job();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        mOperation.reset();
+        operation->finish(error);
+    });
+    return operation;
+}
+
+void Package::addCreatedPath(const std::filesystem::path &path)
+{
+    // only what did not exist before is removed, the first missing directory with its content
+    std::error_code ec;
+    if (std::filesystem::exists(std::filesystem::symlink_status(path, ec)))
+        return;
+    std::filesystem::path first = path;
+    while (first.has_relative_path() && !std::filesystem::exists(first.parent_path(), ec))
+        first = first.parent_path();
+    mOperation->addCreatedPath(first);
+}
+
+bool Package::matchesVerifiedHash(const std::string &name, const FileHash &hash) const
+{
+    if (!mSignatureVerified)
+        return true;
+    auto it = mVerifiedHashes.find(name);
+    return it != mVerifiedHashes.end() && it->second == hash;
+}
+
+bool Package::checkSignedEntry(const std::string &pathname, bool regular_file) const
+{
+    if (!mSignatureVerified)
+        return true;
+    if (regular_file && (pathname == "manifest.json" || pathname == "manifest.bin"))
+        return false;
+    if (regular_file && pathname == "signature")
+        return true;
+    if (regular_file && pathname.compare(0, 5, "data/") == 0 &&
+        mVerifiedHashes.count(pathname.substr(5)))
+        return true;
+    throw Exception("entry is not in the signed manifest: " + pathname);
+}
+
+mode_t Package::entryMode(const std::string &pathname, mode_t mode) const
+{
+    if (!mSignatureVerified)
+        return mode;
+    auto it = pathname.compare(0, 5, "data/") == 0 ? mVerifiedModes.find(pathname.substr(5))
+                                                   : mVerifiedModes.end();
+    return it != mVerifiedModes.end() && it->second ? it->second : DefaultEntryMode;
+}
+
+bool Package::stageEntry(const std::string &pathname, bool regular_file, StagedFiles &staged)
+{
+    if (!mVerifyHashes || !regular_file || pathname.compare(0, 5, "data/") != 0)
+        return false;
+
+    staged.push_back({pathname.substr(5), mExtractedDir / pathname, {}});
+    return true;
+}
+
+bool Package::extractUncompressed(
+    const std::string &package_path, StagedFiles &staged, std::string &manifest_buffer)
+{
+    MappedFile package;
+    {
+        TraceSpan span("open");
+        if (!package.open(package_path))
+            return false;
+    }
+
+    std::vector<TarEntry> entries;
+    {
+        TraceSpan span("header");
+        if (!isTarArchive(package.data(), package.size()) ||
+            !readTarEntries(package.data(), package.size(), entries))
+            return false;
+        span.addEntries(entries.size());
+    }
+
+    // the data is not buffered, the writers copy it from the mapping
+    EntryWriter writer(mExtractThreads, 0);
+    uint64_t files = 0;
+    for (auto &e : entries) {
+        if (writer.failed())
+            break;
+        if (!checkSignedEntry(e.path, e.type == TarEntry::Type::File) ||
+            mSkippedEntries.count(e.path))
+            continue;
+        if (mOperation) {
+            addCreatedPath(mExtractedDir / e.path);
+            mOperation->update(e.offset, files);
+        }
+        files += e.path.compare(0, 5, "data/") == 0;
+        if (Trace::verbosity() >= 2)
+            std::cout << std::string("extract: ") << e.path << std::endl;
+
+        bool is_file = e.type == TarEntry::Type::File;
+        bool is_staged = stageEntry(e.path, is_file, staged);
+        std::filesystem::path dest = is_staged ? staged.back().tmpPath() : mExtractedDir / e.path;
+        std::filesystem::create_directories(dest.parent_path());
+
+        if (e.type == TarEntry::Type::Directory) {
+            std::filesystem::create_directories(dest);
+            chmod(dest.c_str(), e.mode);
+            continue;
+        }
+
+        if (e.type == TarEntry::Type::Symlink) {
+            unlink(dest.c_str());
+            if (symlink(e.linkPath.c_str(), dest.c_str()) != 0)
+                throw Exception("cannot create symlink: " + dest.string());
+            continue;
+        }
+
+        if (mVerifyHashes && e.path == "manifest.json")
+            manifest_buffer.assign(
+                reinterpret_cast<const char *>(package.data() + e.offset), e.size);
+
+        StagedFile *staged_file = is_staged ? &staged.back() : nullptr;
+        mode_t mode = entryMode(e.path, e.mode);
+        writer.submit(0, [this, &package, &e, dest, mode, staged_file]() {
+            if (staged_file) {
+                TraceSpan span("hash");
+                span.addBytes(e.size);
+                Sha256 sha;
+                sha.update(package.data() + e.offset, e.size);
+                staged_file->hash = sha.finish();
+                if (!matchesVerifiedHash(staged_file->name, *staged_file->hash))
+                    throw Exception("hash verification failed for file: " + staged_file->name);
+            }
+            TraceSpan span("write");
+            span.addBytes(e.size);
+            span.addEntries();
+            createEntryFile(dest, mode, {e.mtime, 0},
+                [&](int fd) { copyFileRange(package, e.offset, e.size, fd); });
+        });
+    }
+    writer.wait();
+
+    return true;
+}
+
+/**
+ * @brief The client data of an archive that reads a package from a source.
+ */
+struct SourceReader {
+    PackageSource &source;
+    std::vector<uint8_t> buffer;
+};
 
+static la_ssize_t sourceRead(struct archive *a, void *client_data, const void **buffer)
+{
+    auto reader = static_cast<SourceReader *>(client_data);
+    *buffer = reader->buffer.data();
+    try {
+        return static_cast<la_ssize_t>(
+            reader->source.read(reader->buffer.data(), reader->buffer.size()));
+    } catch (const std::exception &e) {
+        archive_set_error(a, EIO, "%s", e.what());
+        return -1;
+    }
+}
+
+void Package::extractArchive(
+    PackageSource &source, StagedFiles &staged, std::string &manifest_buffer)
+{
     const void *buf;
 
     int r;
@@ -54,40 +759,140 @@ void Package::extract(const std::string &package_path, const std::filesystem::pa
     archive_write_disk_set_options(ext, flags);
     archive_write_disk_set_standard_lookup(ext);
 
-    r = archive_read_open_filename(a, package_path.c_str(), 16384);
-    if (r != ARCHIVE_OK) {
+    // the message is taken from the failing archive before both are freed
+    auto fail = [&](struct archive *failed, const std::string &what) {
+        std::string error = what + archiveError(failed);
         archive_read_free(a);
         archive_write_free(ext);
-        throw Exception(
-            std::string("archive_read_open_filename() failed for file: ") + package_path);
+        throw Exception(error);
+    };
+
+    SourceReader reader{source, std::vector<uint8_t>(SourceBufferSize)};
+    {
+        TraceSpan span("open");
+        r = archive_read_open(a, &reader, nullptr, sourceRead, nullptr);
     }
+    if (r != ARCHIVE_OK)
+        fail(a, "archive_read_open() failed: ");
 
-    while (true) {
+    EntryWriter writer(mExtractThreads, MaxBufferedEntries);
+    uint64_t files = 0;
+    while (!writer.failed()) {
 
-        r = archive_read_next_header(a, &entry);
+        {
+            TraceSpan span("header");
+            span.addEntries();
+            r = archive_read_next_header(a, &entry);
+        }
         if (r == ARCHIVE_EOF) {
             break;
         }
-        if (r < ARCHIVE_OK) {
-            std::cerr << archive_error_string(ext) << std::endl;
-        }
+        if (r < ARCHIVE_OK)
+            fail(a, "archive_read_next_header() failed: ");
 
-        if (r < ARCHIVE_WARN) {
+        const std::string pathname = archive_entry_pathname(entry);
+        bool extracted;
+        try {
+            checkEntryPath(pathname);
+            if (archive_entry_symlink(entry))
+                checkLinkTarget(archive_entry_symlink(entry));
+            if (archive_entry_hardlink(entry))
+                checkEntryPath(archive_entry_hardlink(entry));
+            extracted = checkSignedEntry(pathname,
+                archive_entry_filetype(entry) == AE_IFREG && !archive_entry_hardlink(entry));
+        } catch (...) {
             archive_read_free(a);
             archive_write_free(ext);
-            throw Exception(
-                std::string("archive_read_next_header() failed:") + archive_error_string(a));
+            throw;
+        }
+        if (!extracted || mSkippedEntries.count(pathname))
+            continue;
+        if (mOperation) {
+            try {
+                addCreatedPath(mExtractedDir / pathname);
+                mOperation->update(archive_filter_bytes(a, -1), files);
+            } catch (...) {
+                archive_read_free(a);
+                archive_write_free(ext);
+                throw;
+            }
         }
+        files += pathname.compare(0, 5, "data/") == 0;
+        if (Trace::verbosity() >= 2)
+            std::cout << std::string("extract: ") << pathname << std::endl;
+
+        // with verification, files are written to a temporary name and hashed
+        std::unique_ptr<Sha256> sha;
+        bool is_manifest = mVerifyHashes && pathname == "manifest.json";
+        bool is_staged = stageEntry(pathname, archive_entry_filetype(entry) == AE_IFREG, staged);
+        std::filesystem::path dest = is_staged ? staged.back().tmpPath() : mExtractedDir / pathname;
+
+        // small files are read into a buffer and written by the workers while the reader goes on
+        if (isBufferedEntry(entry)) {
+            std::string data;
+            bool read;
+            {
+                TraceSpan span("decompress");
+                span.addBytes(archive_entry_size(entry));
+                read = readEntryData(a, archive_entry_size(entry), data);
+            }
+            if (!read)
+                fail(a, "archive_read_data() failed: ");
+            if (is_manifest)
+                manifest_buffer = data;
+            std::filesystem::create_directories(dest.parent_path());
 
-        std::cout << std::string("extract: ") << archive_entry_pathname(entry) << std::endl;
-        archive_entry_set_pathname(entry, (mExtractedDir / archive_entry_pathname(entry)).c_str());
+            StagedFile *staged_file = is_staged ? &staged.back() : nullptr;
+            mode_t mode = entryMode(pathname, archive_entry_perm(entry));
+            struct timespec mtime = {archive_entry_mtime(entry), archive_entry_mtime_nsec(entry)};
+            size_t size = data.size();
+            writer.submit(size, [this, dest, mode, mtime, staged_file, data = std::move(data)]() {
+                if (staged_file) {
+                    TraceSpan span("hash");
+                    span.addBytes(data.size());
+                    Sha256 file_sha;
+                    file_sha.update(data.data(), data.size());
+                    staged_file->hash = file_sha.finish();
+                    if (!matchesVerifiedHash(staged_file->name, *staged_file->hash))
+                        throw Exception("hash verification failed for file: " + staged_file->name);
+                }
+                TraceSpan span("write");
+                span.addBytes(data.size());
+                span.addEntries();
+                createEntryFile(
+                    dest, mode, mtime, [&](int fd) { writeAll(fd, data.data(), data.size()); });
+            });
+            continue;
+        }
 
+        // a hard link may refer to a file that is still written
+        if (archive_entry_hardlink(entry)) {
+            try {
+                writer.wait();
+            } catch (...) {
+                archive_read_free(a);
+                archive_write_free(ext);
+                throw;
+            }
+        }
+
+        if (is_staged)
+            sha = std::make_unique<Sha256>();
+        archive_entry_set_perm(entry, entryMode(pathname, archive_entry_perm(entry)));
+        archive_entry_set_pathname(entry, dest.c_str());
+        // hard links refer to other entries of the package, not to the working directory
+        if (archive_entry_hardlink(entry))
+            archive_entry_set_hardlink(
+                entry, (mExtractedDir / archive_entry_hardlink(entry)).c_str());
+
+        // decompression and writing of streamed entries are recorded as one span
+        TraceSpan span("stream");
+        if (archive_entry_size(entry) > 0)
+            span.addBytes(archive_entry_size(entry));
+        span.addEntries();
         r = archive_write_header(ext, entry);
         if (r < ARCHIVE_OK) {
-            archive_read_free(a);
-            archive_write_free(ext);
-            throw Exception(
-                std::string("archive_write_header() failed:") + archive_error_string(ext));
+            fail(ext, "archive_write_header() failed: ");
         } else if (archive_entry_size(entry) > 0) {
 
             size_t size;
@@ -96,35 +901,30 @@ void Package::extract(const std::string &package_path, const std::filesystem::pa
                 r = archive_read_data_block(a, &buf, &size, &offset);
                 if (r == ARCHIVE_EOF)
                     break;
-                if (r < ARCHIVE_WARN) {
-                    archive_read_free(a);
-                    archive_write_free(ext);
-                    throw Exception(std::string(archive_error_string(ext)));
-                }
-                if (r < ARCHIVE_OK) {
-                    std::cerr << archive_error_string(ext) << std::endl;
-                    break;
-                }
+                if (r < ARCHIVE_OK)
+                    fail(a, "archive_read_data_block() failed: ");
+
+                if (sha)
+                    sha->update(buf, size);
+                if (is_manifest)
+                    manifest_buffer.append(static_cast<const char *>(buf), size);
 
                 r = archive_write_data_block(ext, buf, size, offset);
-                if (r < ARCHIVE_WARN) {
-                    archive_read_free(a);
-                    archive_write_free(ext);
-                    throw Exception(std::string(archive_error_string(ext)));
-                }
-                if (r < ARCHIVE_OK) {
-                    std::cerr << archive_error_string(ext) << std::endl;
-                    break;
-                }
+                if (r < ARCHIVE_OK)
+                    fail(ext, "archive_write_data_block() failed: ");
             }
 
             r = archive_write_finish_entry(ext);
             if (r < ARCHIVE_OK)
-                std::cerr << archive_error_string(ext) << std::endl;
-            if (r < ARCHIVE_WARN) {
+                fail(ext, "archive_write_finish_entry() failed: ");
+        }
+
+        if (sha) {
+            staged.back().hash = sha->finish();
+            if (!matchesVerifiedHash(staged.back().name, *staged.back().hash)) {
                 archive_read_free(a);
                 archive_write_free(ext);
-                throw Exception(std::string(archive_error_string(ext)));
+                throw Exception("hash verification failed for file: " + staged.back().name);
             }
         }
     }
@@ -132,6 +932,321 @@ void Package::extract(const std::string &package_path, const std::filesystem::pa
     archive_read_free(a);
     archive_write_close(ext);
     archive_write_free(ext);
+    writer.wait();
+}
+
+std::string Package::readEntry(const std::string &package_path, const std::string &name)
+{
+    std::string content;
+
+    MappedFile package;
+    if (!package.open(package_path, false))
+        throw Exception("cannot open package: " + package_path);
+
+    PackageIndexReader index;
+    if (index.open(package.data(), package.size())) {
+        if (!index.read(name, content))
+            throw Exception("no entry '" + name + "' in package: " + package_path);
+        return content;
+    }
+
+    // packages without index are scanned up to the entry
+    struct archive *a = archive_read_new();
+    struct archive_entry *entry;
+    archive_read_support_filter_all(a);
+    archive_read_support_format_all(a);
+
+    if (archive_read_open_memory(a, package.data(), package.size()) != ARCHIVE_OK) {
+        archive_read_free(a);
+        throw Exception("cannot read package: " + package_path);
+    }
+
+    int r;
+    while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+        if (name != archive_entry_pathname(entry))
+            continue;
+
+        char buf[16384];
+        la_ssize_t n;
+        while ((n = archive_read_data(a, buf, sizeof(buf))) > 0)
+            content.append(buf, n);
+
+        archive_read_free(a);
+        if (n < 0)
+            throw Exception("cannot read entry '" + name + "' of package: " + package_path);
+        return content;
+    }
+
+    archive_read_free(a);
+    throw Exception("no entry '" + name + "' in package: " + package_path);
+}
+
+void Package::readManifest(const std::string &package_path)
+{
+    TraceSpan span("read-manifest");
+    mManifest = Manifest();
+    mSignatureVerified = false;
+    mVerifiedHashes.clear();
+    mVerifiedModes.clear();
+    // packages created before the binary manifest only contain manifest.json
+    std::string manifest_buffer;
+    try {
+        manifest_buffer = readEntry(package_path, "manifest.bin");
+    } catch (const Exception &) {
+        manifest_buffer = readEntry(package_path, "manifest.json");
+    }
+    mManifest.readFromBuffer(manifest_buffer);
+    mPackagePath = package_path;
+}
+
+Manifest &Package::manifest() { return mManifest; }
+
+std::filesystem::path Package::writeDelta(
+    const std::string &base_package, const std::filesystem::path &dest_dir)
+{
+    if (mPackagePath.empty())
+        throw Exception("package manifest is not read");
+
+    Package base;
+    base.readManifest(base_package);
+    if (base.manifest().packageName() != mManifest.packageName())
+        throw Exception("base package is not a revision of " + mManifest.packageName());
+
+    std::set<std::string_view> base_names;
+    std::set<FileHash> base_hashes;
+    for (auto &f : base.manifest().files()) {
+        base_names.insert(f.name());
+        if (f.hasHash())
+            base_hashes.insert(f.hash());
+    }
+
+    for (auto &f : mManifest.files())
+        if (!f.hasHash())
+            throw Exception("package has no file hashes: " + mPackagePath.string());
+
+    std::filesystem::path delta_path = dest_dir / deltaFilename(base.manifest().packageVersion());
+
+    const Compression compression = mManifest.compression();
+    PackageIndex index(compression.codec);
+    PackageIndex *pindex = hasIndex(compression) ? &index : nullptr;
+
+    FileSink sink(delta_path);
+    std::unique_ptr<BlockCompressor> compressor;
+    struct archive *a = openPackageFile(sink, compression, mCompressionThreads, pindex, compressor);
+
+    // identifies the base revision
+    json_t *info = json_object();
+    json_object_set_new(info, "base-name", json_string(base.manifest().packageName().c_str()));
+    json_object_set_new(info, "base-version", json_integer(base.manifest().packageVersion()));
+    char *info_buffer = json_dumps(info, 0);
+    json_decref(info);
+    std::string info_str(info_buffer);
+    free(info_buffer);
+
+    try {
+        addBuffer(a, "delta.json", info_str.data(), info_str.size(), pindex);
+        for (auto &f : mManifest.files()) {
+            // unchanged and renamed files are taken from the base revision
+            if (base_hashes.count(f.hash()))
+                continue;
+
+            const std::string name(f.name());
+            std::string content = readEntry(mPackagePath, "data/" + name);
+
+            if (base_names.count(f.name())) {
+                std::string old_content = readEntry(base_package, "data/" + name);
+                std::vector<uint8_t> delta =
+                    createDelta(reinterpret_cast<const uint8_t *>(old_content.data()),
+                        old_content.size(), reinterpret_cast<const uint8_t *>(content.data()),
+                        content.size());
+                if (delta.size() < content.size()) {
+                    addBuffer(a, "delta/" + name, delta.data(), delta.size(), pindex);
+                    continue;
+                }
+            }
+
+            addBuffer(a, "data/" + name, content.data(), content.size(), pindex);
+        }
+
+        std::string manifest_buffer = readEntry(mPackagePath, "manifest.json");
+        addBuffer(a, "manifest.json", manifest_buffer.data(), manifest_buffer.size(), pindex);
+        std::string binary_manifest = mManifest.toBinary();
+        addBuffer(a, "manifest.bin", binary_manifest.data(), binary_manifest.size(), pindex);
+
+        // the signature of the new revision also covers the result of applyDelta()
+        std::string signature;
+        try {
+            signature = readEntry(mPackagePath, "signature");
+        } catch (const Exception &) {
+        }
+        if (!signature.empty())
+            addBuffer(a, "signature", signature.data(), signature.size(), pindex);
+    } catch (...) {
+        archive_write_free(a);
+        throw;
+    }
+
+    closePackageFile(a);
+
+    return delta_path;
+}
+
+void Package::applyDelta(const std::string &delta_path, const std::filesystem::path &base_dir,
+    const std::filesystem::path &destination)
+{
+    Manifest base;
+    base.readFromFile((base_dir / "manifest.json").string());
+
+    std::string info_buffer = readEntry(delta_path, "delta.json");
+    json_error_t error;
+    json_t *info = json_loadb(info_buffer.data(), info_buffer.size(), 0, &error);
+    if (!info)
+        throw Exception("invalid delta package: " + delta_path);
+    json_t *base_name = json_object_get(info, "base-name");
+    json_t *base_version = json_object_get(info, "base-version");
+    bool matches = json_is_string(base_name) && json_is_integer(base_version) &&
+                   base.packageName() == json_string_value(base_name) &&
+                   base.packageVersion() == json_integer_value(base_version);
+    json_decref(info);
+    if (!matches)
+        throw Exception("delta package does not apply to " + base_dir.string());
+
+    std::string manifest_buffer = readEntry(delta_path, "manifest.json");
+    mManifest = Manifest();
+    mManifest.readFromBuffer(manifest_buffer);
+    mPackagePath = delta_path;
+    mExtractedDir = destination;
+
+    StagedFiles staged;
+    std::set<std::string> written;
+
+    struct archive *a = archive_read_new();
+    struct archive_entry *entry;
+    archive_read_support_filter_all(a);
+    archive_read_support_format_all(a);
+
+    if (archive_read_open_filename(a, delta_path.c_str(), 16384) != ARCHIVE_OK) {
+        archive_read_free(a);
+        throw Exception("cannot read package: " + delta_path);
+    }
+
+    auto readData = [&](const std::function<void(const uint8_t *, size_t)> &write) {
+        char buf[16384];
+        la_ssize_t n;
+        while ((n = archive_read_data(a, buf, sizeof(buf))) > 0)
+            write(reinterpret_cast<const uint8_t *>(buf), n);
+        if (n < 0)
+            throw Exception("cannot read delta package: " + archiveError(a));
+    };
+
+    try {
+        int r;
+        while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+            const std::string pathname = archive_entry_pathname(entry);
+            if (archive_entry_filetype(entry) != AE_IFREG)
+                continue;
+            // nothing is written outside the destination, not even a temporary file
+            checkEntryPath(pathname);
+
+            if (pathname.compare(0, 5, "data/") == 0) {
+                std::string name = pathname.substr(5);
+                staged.push_back({name, destination / "data" / name, {}});
+                staged.back().hash = writeHashedFile(staged.back().tmpPath(), readData);
+                written.insert(name);
+            } else if (pathname.compare(0, 6, "delta/") == 0) {
+                std::string name = pathname.substr(6);
+                std::vector<uint8_t> delta;
+                readData([&](const uint8_t *data, size_t length) {
+                    delta.insert(delta.end(), data, data + length);
+                });
+
+                std::filesystem::path old_path = base_dir / "data" / name;
+                MappedFile old_file;
+                bool mapped = old_file.open(old_path.string());
+                if (!mapped && !std::filesystem::is_regular_file(old_path))
+                    throw Exception("base file is missing: " + old_path.string());
+
+                staged.push_back({name, destination / "data" / name, {}});
+                staged.back().hash = writeHashedFile(staged.back().tmpPath(),
+                    [&](const std::function<void(const uint8_t *, size_t)> &write) {
+                        rose::applyDelta(mapped ? old_file.data() : nullptr,
+                            mapped ? old_file.size() : 0, delta.data(), delta.size(), write);
+                    });
+                written.insert(name);
+            }
+        }
+        if (r != ARCHIVE_EOF)
+            throw Exception("cannot read delta package: " + archiveError(a));
+    } catch (...) {
+        archive_read_free(a);
+        throw;
+    }
+    archive_read_free(a);
+
+    // files not in the delta package are copied from the base revision with the same hash
+    std::map<FileHash, std::string> base_files;
+    for (auto &f : base.files())
+        if (f.hasHash())
+            base_files.emplace(f.hash(), f.name());
+
+    for (auto &f : mManifest.files()) {
+        const std::string name(f.name());
+        if (written.count(name))
+            continue;
+
+        auto it = base_files.find(f.hash());
+        if (!f.hasHash() || it == base_files.end())
+            throw Exception("file is neither in the delta nor in the base package: " + name);
+
+        std::filesystem::path old_path = base_dir / "data" / it->second;
+        MappedFile old_file;
+        bool mapped = old_file.open(old_path.string());
+        if (!mapped && !std::filesystem::is_regular_file(old_path))
+            throw Exception("base file is missing: " + old_path.string());
+
+        staged.push_back({name, destination / "data" / name, {}});
+        StagedFile &staged_file = staged.back();
+        std::filesystem::create_directories(staged_file.path.parent_path());
+
+        Sha256 sha;
+        if (mapped)
+            sha.update(old_file.data(), old_file.size());
+        staged_file.hash = sha.finish();
+
+        int fd = ::open(staged_file.tmpPath().c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw Exception("cannot create file: " + staged_file.tmpPath().string());
+        try {
+            if (mapped)
+                copyFileRange(old_file, 0, old_file.size(), fd);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        if (::close(fd) != 0)
+            throw Exception("cannot write file: " + staged_file.tmpPath().string());
+    }
+
+    // the files get the modes of the new manifest like extracted files
+    std::map<std::string_view, mode_t> modes;
+    for (auto &f : mManifest.files())
+        modes[f.name()] = f.mode() ? f.mode() : DefaultEntryMode;
+    for (auto &f : staged) {
+        auto it = modes.find(f.name);
+        if (it != modes.end() && chmod(f.tmpPath().c_str(), it->second) != 0)
+            throw Exception("cannot set mode of file: " + f.tmpPath().string());
+    }
+
+    std::list<std::string> failed = commitStagedFiles(staged, mManifest);
+    if (!failed.empty())
+        throw Exception("hash verification failed for file: " + failed.front());
+
+    writeHashedFile(destination / "manifest.json",
+        [&](const std::function<void(const uint8_t *, size_t)> &write) {
+            write(reinterpret_cast<const uint8_t *>(manifest_buffer.data()),
+                manifest_buffer.size());
+        });
 }
 
 void Package::readPackageDir(std::string package_dir)
@@ -145,28 +1260,84 @@ void Package::readPackageDir(std::string package_dir)
     mExtractedDir = package_dir;
 }
 
-void Package::signPackage(std::string priv_key) {}
+void Package::signPackage(std::string priv_key) { mSigningKey = priv_key; }
 
-void Package::verify(std::string pub_key) {}
+void Package::verify(std::string pub_key)
+{
+    if (mPackagePath.empty())
+        throw Exception("package manifest is not read");
+
+    std::string signature;
+    try {
+        signature = readEntry(mPackagePath, "signature");
+    } catch (const Exception &) {
+        throw Exception("package is not signed: " + mPackagePath.string());
+    }
+    if (!Signature::verify(Signature::merkleRoot(mManifest), signature, pub_key))
+        throw Exception("invalid signature of package: " + mPackagePath.string());
+
+    mVerifiedHashes.clear();
+    mVerifiedModes.clear();
+    for (auto &f : mManifest.files()) {
+        mVerifiedHashes[std::string(f.name())] = f.hash();
+        mVerifiedModes[std::string(f.name())] = f.mode();
+    }
+    mSignatureVerified = true;
+    mVerifyHashes = true;
+}
 
 void Package::writePackge(std::filesystem::path dest_dir)
 {
     if (mManifest.packageName().empty())
         throw Exception("package metatdata is not set");
 
-    // create package workdir or delete old data
-    std::filesystem::path package_tmp_dir = mWorkDir / mManifest.packageName();
-    if (std::filesystem::exists(package_tmp_dir))
-        std::filesystem::remove_all(package_tmp_dir);
+    // the package is written to an unnamed file in the destination and gets its name when it
+    // is complete, file systems without O_TMPFILE get a hidden temporary name instead
+    std::filesystem::path tmp_path =
+        dest_dir / ("." + filename() + "." + std::to_string(getpid()));
+    bool named = false;
+    int fd = ::open(dest_dir.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd < 0 && (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL)) {
+        fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        named = true;
+    }
+    if (fd < 0)
+        throw Exception("cannot create package file in: " + dest_dir.string());
 
-    std::filesystem::create_directories(package_tmp_dir);
+    try {
+        FdSink sink(fd);
+        writePackage(sink);
 
-    mManifest.writeManifestFile(package_tmp_dir.string() + "/manifest.json");
+        if (!named) {
+            std::string fd_path = "/proc/self/fd/" + std::to_string(fd);
+            unlink(tmp_path.c_str());
+            if (linkat(AT_FDCWD, fd_path.c_str(), AT_FDCWD, tmp_path.c_str(),
+                    AT_SYMLINK_FOLLOW) != 0)
+                throw Exception("cannot link package file: " + tmp_path.string());
+            named = true;
+        }
+        // the rename replaces an older package file atomically
+        if (::rename(tmp_path.c_str(), (dest_dir / filename()).c_str()) != 0)
+            throw Exception("cannot rename package file to " + (dest_dir / filename()).string() +
+                            ": " + strerror(errno));
+    } catch (...) {
+        ::close(fd);
+        if (named)
+            unlink(tmp_path.c_str());
+        throw;
+    }
 
-    // pack + compress
-    pack();
+    if (::close(fd) != 0)
+        throw Exception("cannot write package file: " + (dest_dir / filename()).string());
+}
 
-    std::filesystem::rename(mWorkDir.append(filename()), dest_dir.append(filename()));
+void Package::writePackage(PackageSink &sink)
+{
+    if (mManifest.packageName().empty())
+        throw Exception("package metatdata is not set");
+
+    // pack + compress, this also adds the manifest
+    pack(sink);
 }
 
 std::string Package::baseFilename() const
@@ -177,43 +1348,135 @@ std::string Package::baseFilename() const
 
 std::string Package::filename() const { return baseFilename() + "." + std::string(FileExtension); }
 
-void Package::pack()
+std::string Package::deltaFilename(int32_t base_version) const
 {
-    struct archive *a;
-    char buf[8192];
+    return baseFilename() + "-from-" + std::to_string(base_version) + "." +
+           std::string(FileExtension);
+}
 
-    std::filesystem::path tbz2_path = mWorkDir / filename();
+void Package::setCompressionThreads(unsigned int threads) { mCompressionThreads = threads; }
 
-    a = archive_write_new();
-    archive_write_add_filter_bzip2(a);
-    archive_write_set_format_pax_restricted(a);
-    archive_write_open_filename(a, tbz2_path.c_str());
+void Package::setExtractThreads(unsigned int threads) { mExtractThreads = threads; }
 
+void Package::setVerifyHashes(bool verify) { mVerifyHashes = verify; }
+
+void Package::setCompression(const Compression &compression)
+{
+    mManifest.setCompression(compression);
+}
+
+mode_t Package::addFile(struct archive *a, const std::string &source, const std::string &dest,
+    Sha256 *sha, PackageIndex *index)
+{
+    char buf[8192];
     struct stat st;
-    struct archive_entry *entry;
 
-    for (auto &f : mManifest.files()) {
-        std::string source = mExtractedDir.string() + std::string("/data/") + f.name();
-        std::string dest = std::string("data/") + f.name();
-        stat(source.c_str(), &st);
-        entry = archive_entry_new();
-        archive_entry_set_pathname(entry, dest.c_str());
-        archive_entry_set_size(entry, st.st_size);
-        archive_entry_set_filetype(entry, AE_IFREG);
-        archive_entry_set_perm(entry, 0644);
-        archive_write_header(a, entry);
-        int fd = open(source.c_str(), O_RDONLY);
-        int len = read(fd, buf, sizeof(buf));
-        while (len > 0) {
-            archive_write_data(a, buf, len);
-            len = read(fd, buf, sizeof(buf));
+    int fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::string error = strerror(errno);
+        if (fd >= 0)
+            close(fd);
+        throw Exception("cannot read file " + source + ": " + error);
+    }
+
+    TraceSpan span("compress");
+    span.addBytes(st.st_size);
+    span.addEntries();
+    mode_t mode = st.st_mode & 07777;
+    try {
+        writeEntryHeader(a, dest, st.st_size, index, mode);
+        off_t total = 0;
+        ssize_t len;
+        while ((len = read(fd, buf, sizeof(buf))) != 0) {
+            if (len < 0 && errno == EINTR)
+                continue;
+            if (len < 0)
+                throw Exception("cannot read file " + source + ": " + strerror(errno));
+            if (sha)
+                sha->update(buf, len);
+            writeEntryData(a, dest, buf, len);
+            total += len;
         }
+        // the header has the size of the file when it was opened
+        if (total != st.st_size)
+            throw Exception("file changed while it was packed: " + source);
+    } catch (...) {
         close(fd);
-        archive_entry_free(entry);
+        throw;
     }
+    close(fd);
+    return mode;
+}
 
-    archive_write_close(a);
-    archive_write_free(a);
+void Package::pack(PackageSink &sink)
+{
+    const Compression compression = mManifest.compression();
+    const bool indexed = hasIndex(compression);
+    PackageIndex index(compression.codec);
+
+    // the progress of an operation is measured in bytes of the source files
+    std::vector<uint64_t> sizes;
+    if (mOperation) {
+        uint64_t total = 0;
+        for (auto &f : mManifest.files()) {
+            std::error_code ec;
+            auto size = std::filesystem::file_size(mExtractedDir / "data" / f.name(), ec);
+            sizes.push_back(ec ? 0 : size);
+            total += sizes.back();
+        }
+        mOperation->start(total, sizes.size());
+    }
+
+    std::unique_ptr<BlockCompressor> compressor;
+    struct archive *a = openPackageFile(
+        sink, compression, mCompressionThreads, indexed ? &index : nullptr, compressor);
+
+    try {
+        // the data is hashed while it is streamed into the archive
+        TraceSpan span("pack");
+        Sha256 sha;
+        uint64_t done = 0;
+        for (auto &f : mManifest.files()) {
+            const std::string name(f.name());
+            // the manifest records the mode, so files linked instead of extracted get it too
+            f.setMode(addFile(a, mExtractedDir.string() + "/data/" + name, "data/" + name, &sha,
+                indexed ? &index : nullptr));
+            f.setHash(sha.finish());
+
+            if (mOperation) {
+                size_t i = &f - mManifest.files().data();
+                done += sizes[i];
+                mOperation->update(done, i + 1);
+            }
+        }
+        span.addEntries(mManifest.files().size());
+
+        // the manifest includes the hashes and follows the data, the binary manifest is read in
+        // place by readManifest(), both are serialized in memory
+        std::string manifest_buffer, binary_manifest;
+        {
+            TraceSpan manifest_span("write-manifest");
+            manifest_span.addEntries(mManifest.files().size());
+            manifest_buffer = mManifest.toJson();
+            binary_manifest = mManifest.toBinary();
+        }
+        addBuffer(a, "manifest.json", manifest_buffer.data(), manifest_buffer.size(),
+            indexed ? &index : nullptr);
+        addBuffer(a, "manifest.bin", binary_manifest.data(), binary_manifest.size(),
+            indexed ? &index : nullptr);
+
+        // the signature covers the hashes, so it is created last
+        if (!mSigningKey.empty()) {
+            std::string signature = Signature::sign(Signature::merkleRoot(mManifest), mSigningKey);
+            addBuffer(
+                a, "signature", signature.data(), signature.size(), indexed ? &index : nullptr);
+        }
+    } catch (...) {
+        archive_write_free(a);
+        throw;
+    }
+
+    closePackageFile(a);
 }
 
 void Package::unpack() {}
@@ -0,0 +1,301 @@
+/**
+ * @file packagedatabase.cpp
+ */
+#include "rps/packagedatabase.h"
+#include "mappedfile.h"
+#include "packagedatabaseformat.h"
+#include <rps/exception.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace rose
+{
+
+using namespace PackageDatabaseFormat;
+
+/** Check that an array of count records of size bytes lies inside the database. */
+static bool inBounds(uint32_t offset, uint64_t count, size_t size, uint32_t total)
+{
+    return offset % PACKAGEDB_ALIGN == 0 && offset <= total && count * size <= total - offset;
+}
+
+/**
+ * @brief The binary manifest of a record, copied to a buffer aligned for ManifestView.
+ */
+class RecordManifest
+{
+  public:
+    explicit RecordManifest(const PackageDatabase::Record &record)
+        : mBuffer((record.manifest.size() + 7) / 8)
+    {
+        memcpy(mBuffer.data(), record.manifest.data(), record.manifest.size());
+        if (!mView.open(mBuffer.data(), record.manifest.size()))
+            throw Exception("invalid manifest of package " + record.name);
+    }
+
+    const ManifestView &view() const { return mView; }
+
+  private:
+    std::vector<uint64_t> mBuffer;
+    ManifestView mView;
+};
+
+static void align(std::string &buffer)
+{
+    buffer.resize((buffer.size() + PACKAGEDB_ALIGN - 1) / PACKAGEDB_ALIGN * PACKAGEDB_ALIGN);
+}
+
+PackageDatabase::PackageDatabase() : mData(nullptr), mHeader(nullptr) {}
+
+PackageDatabase::~PackageDatabase() {}
+
+bool PackageDatabase::open(const std::filesystem::path &path)
+{
+    mData = nullptr;
+    mHeader = nullptr;
+    mFile = std::make_unique<MappedFile>();
+    if (!mFile->open(path.string(), false) || mFile->size() < sizeof(Header) ||
+        memcmp(mFile->data(), PACKAGEDB_MAGIC, 8) != 0)
+        return false;
+
+    auto header = reinterpret_cast<const Header *>(mFile->data());
+    if (header->version != PACKAGEDB_VERSION || header->byteOrder != PACKAGEDB_BYTE_ORDER ||
+        header->size > mFile->size() || header->size < sizeof(Header) ||
+        !inBounds(header->packagesOffset, header->packageCount, sizeof(PackageRecord),
+            header->size) ||
+        !inBounds(header->ownersOffset, header->ownerCount, sizeof(OwnerRecord), header->size) ||
+        !inBounds(header->stringTableOffset, header->stringTableSize, 1, header->size))
+        return false;
+
+    mData = mFile->data();
+    mHeader = header;
+    return true;
+}
+
+size_t PackageDatabase::packageCount() const { return mHeader ? mHeader->packageCount : 0; }
+
+const PackageRecord &PackageDatabase::record(size_t i) const
+{
+    return reinterpret_cast<const PackageRecord *>(mData + mHeader->packagesOffset)[i];
+}
+
+const OwnerRecord &PackageDatabase::owner(size_t i) const
+{
+    return reinterpret_cast<const OwnerRecord *>(mData + mHeader->ownersOffset)[i];
+}
+
+std::string_view PackageDatabase::string(const StringRef &ref) const
+{
+    if (uint64_t(ref.offset) + ref.length >= mHeader->stringTableSize)
+        throw Exception("invalid string in package database");
+
+    const char *s = reinterpret_cast<const char *>(mData + mHeader->stringTableOffset);
+    return std::string_view(s + ref.offset, ref.length);
+}
+
+InstalledPackage PackageDatabase::package(size_t i) const
+{
+    auto &r = record(i);
+    InstalledPackage package{string(r.name), r.revision, string(r.source), r.installTime, {}};
+    if (!inBounds(r.manifestOffset, r.manifestSize, 1, mHeader->size) ||
+        !package.manifest.open(mData + r.manifestOffset, r.manifestSize))
+        throw Exception("invalid manifest of package " + std::string(package.name) +
+                        " in package database");
+    return package;
+}
+
+bool PackageDatabase::find(std::string_view name, size_t &i) const
+{
+    size_t first = 0, last = packageCount();
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        if (string(record(middle).name) < name)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    if (first == packageCount() || string(record(first).name) != name)
+        return false;
+    i = first;
+    return true;
+}
+
+bool PackageDatabase::findOwner(std::string_view path, size_t &package) const
+{
+    if (!mHeader)
+        return false;
+
+    size_t first = 0, last = mHeader->ownerCount;
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        if (string(owner(middle).path) < path)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    if (first == mHeader->ownerCount || string(owner(first).path) != path)
+        return false;
+    package = owner(first).package;
+    if (package >= packageCount())
+        throw Exception("invalid owner of " + std::string(path) + " in package database");
+    return true;
+}
+
+bool PackageDatabase::findConflict(const std::vector<Record> &changed,
+    const std::vector<std::string> &removed, FileConflict &conflict) const
+{
+    std::set<std::string_view> replaced(removed.begin(), removed.end());
+    for (auto &r : changed)
+        replaced.insert(r.name);
+
+    std::unordered_map<std::string_view, std::string_view> owners;
+    std::list<RecordManifest> manifests;
+    for (auto &r : changed) {
+        auto &manifest = manifests.emplace_back(r).view();
+        for (size_t f = 0; f < manifest.fileCount(); f++) {
+            std::string_view path = manifest.file(f).name();
+
+            // the files of packages that are replaced or removed are free
+            size_t package;
+            std::string_view owner;
+            auto it = owners.emplace(path, r.name).first;
+            if (it->second != r.name)
+                owner = it->second;
+            else if (findOwner(path, package) && !replaced.count(string(record(package).name)))
+                owner = string(record(package).name);
+            else
+                continue;
+
+            conflict = FileConflict{std::string(path), r.name, std::string(owner)};
+            return true;
+        }
+    }
+    return false;
+}
+
+void PackageDatabase::write(const std::filesystem::path &path, const std::vector<Record> &changed,
+    const std::vector<std::string> &removed) const
+{
+    // the records of the new database by name, unchanged ones are copied from this one
+    std::map<std::string_view, Record> records;
+    std::set<std::string_view> dropped;
+    for (auto &r : changed)
+        dropped.insert(r.name);
+
+    for (size_t i = 0; i < packageCount(); i++) {
+        InstalledPackage p = package(i);
+        if (dropped.count(p.name))
+            continue;
+        auto &r = record(i);
+        records[p.name] = Record{std::string(p.name), p.revision, std::string(p.source),
+            p.installTime,
+            std::string(reinterpret_cast<const char *>(mData + r.manifestOffset), r.manifestSize)};
+    }
+    for (auto &r : changed)
+        records[r.name] = r;
+    for (auto &name : removed)
+        records.erase(name);
+
+    std::map<std::string_view, uint32_t> indices;
+    for (auto &entry : records)
+        indices.emplace(entry.first, static_cast<uint32_t>(indices.size()));
+
+    // the owners of copied packages are still sorted, those of changed packages are merged in
+    struct Owner {
+        std::string_view path;
+        uint32_t package;
+    };
+    std::vector<Owner> owners;
+    for (size_t i = 0; mHeader && i < mHeader->ownerCount; i++) {
+        if (owner(i).package >= packageCount())
+            throw Exception("invalid owner record in package database");
+        std::string_view name = string(record(owner(i).package).name);
+        auto it = indices.find(name);
+        if (it != indices.end() && !dropped.count(name))
+            owners.push_back({string(owner(i).path), it->second});
+    }
+    size_t copied = owners.size();
+
+    std::list<RecordManifest> manifests;
+    for (auto &entry : records) {
+        if (!dropped.count(entry.first))
+            continue;
+        auto &manifest = manifests.emplace_back(entry.second).view();
+        for (size_t f = 0; f < manifest.fileCount(); f++)
+            owners.push_back({manifest.file(f).name(), indices[entry.first]});
+    }
+
+    auto byPath = [](const Owner &a, const Owner &b) { return a.path < b.path; };
+    std::sort(owners.begin() + copied, owners.end(), byPath);
+    std::inplace_merge(owners.begin(), owners.begin() + copied, owners.end(), byPath);
+
+    std::string strings;
+    auto addString = [&strings](const std::string &s) {
+        StringRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(s.size())};
+        strings.append(s);
+        strings.push_back('\0');
+        return ref;
+    };
+
+    std::vector<OwnerRecord> owner_records;
+    for (auto &o : owners)
+        owner_records.push_back({addString(std::string(o.path)), o.package, 0});
+
+    std::vector<PackageRecord> packages;
+    std::string manifest_data;
+    size_t owners_offset = sizeof(Header) + records.size() * sizeof(PackageRecord);
+    size_t manifests_offset = owners_offset + owner_records.size() * sizeof(OwnerRecord);
+    for (auto &entry : records) {
+        auto &r = entry.second;
+        PackageRecord p{};
+        p.name = addString(r.name);
+        p.source = addString(r.source);
+        p.revision = r.revision;
+        p.installTime = r.installTime;
+        p.manifestOffset = static_cast<uint32_t>(manifests_offset + manifest_data.size());
+        p.manifestSize = static_cast<uint32_t>(r.manifest.size());
+        packages.push_back(p);
+
+        manifest_data.append(r.manifest);
+        align(manifest_data);
+    }
+
+    Header header{};
+    memcpy(header.magic, PACKAGEDB_MAGIC, 8);
+    header.version = PACKAGEDB_VERSION;
+    header.byteOrder = PACKAGEDB_BYTE_ORDER;
+    header.packageCount = static_cast<uint32_t>(packages.size());
+    header.packagesOffset = sizeof(Header);
+    header.ownerCount = static_cast<uint32_t>(owner_records.size());
+    header.ownersOffset = static_cast<uint32_t>(owners_offset);
+    header.stringTableOffset = static_cast<uint32_t>(manifests_offset + manifest_data.size());
+    header.stringTableSize = static_cast<uint32_t>(strings.size());
+    header.size = header.stringTableOffset + header.stringTableSize;
+
+    std::string buffer(reinterpret_cast<const char *>(&header), sizeof(header));
+    buffer.append(reinterpret_cast<const char *>(packages.data()),
+        packages.size() * sizeof(PackageRecord));
+    buffer.append(reinterpret_cast<const char *>(owner_records.data()),
+        owner_records.size() * sizeof(OwnerRecord));
+    buffer.append(manifest_data);
+    buffer.append(strings);
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw Exception("cannot create package database: " + path.string());
+    ssize_t n = ::write(fd, buffer.data(), buffer.size());
+    if (::close(fd) != 0 || n != static_cast<ssize_t>(buffer.size())) {
+        unlink(path.c_str());
+        throw Exception("cannot write package database: " + path.string());
+    }
+}
+
+} // namespace rose
@@ -0,0 +1,73 @@
+/**
+ * @file packagedatabaseformat.h
+ * @brief Layout of the file of the installed-package database.
+ *
+ * Like the binary manifest, all sections are aligned to 8 bytes, referenced by offset from the
+ * start of the file and stored in the byte order of the writer. The package records are sorted
+ * by name, each references the binary manifest of the package. The owner records map the files
+ * of all packages to their package and are sorted by path.
+ *
+ *     Header
+ *     PackageRecord packages[packageCount]
+ *     OwnerRecord   owners[ownerCount]
+ *     uint8         manifests[]              binary manifests, each aligned to 8 bytes
+ *     char          strings[stringTableSize]
+ */
+#ifndef _PACKAGEDATABASEFORMAT_H
+#define _PACKAGEDATABASEFORMAT_H
+
+#include <cstdint>
+
+#define PACKAGEDB_MAGIC "RPSPKGDB"
+#define PACKAGEDB_VERSION 2
+#define PACKAGEDB_BYTE_ORDER 0x01020304
+#define PACKAGEDB_ALIGN 8
+
+namespace rose
+{
+namespace PackageDatabaseFormat
+{
+
+struct StringRef {
+    uint32_t offset; // in the string table
+    uint32_t length; // without the null byte
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t size;
+    uint32_t packageCount;
+    uint32_t packagesOffset;
+    uint32_t ownerCount;
+    uint32_t ownersOffset;
+    uint32_t stringTableOffset;
+    uint32_t stringTableSize;
+    uint32_t reserved;
+};
+
+struct PackageRecord {
+    StringRef name;
+    StringRef source;
+    int32_t revision;
+    uint32_t manifestOffset;
+    uint32_t manifestSize;
+    uint32_t reserved;
+    int64_t installTime;
+};
+
+struct OwnerRecord {
+    StringRef path;
+    uint32_t package; // index in packages
+    uint32_t reserved;
+};
+
+static_assert(sizeof(Header) == 48, "unexpected size of the package database header");
+static_assert(sizeof(PackageRecord) == 40, "unexpected size of package database records");
+static_assert(sizeof(OwnerRecord) == 16, "unexpected size of package database owner records");
+
+} // namespace PackageDatabaseFormat
+} // namespace rose
+
+#endif /* _PACKAGEDATABASEFORMAT_H */
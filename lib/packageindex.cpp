@@ -0,0 +1,271 @@
+/**
+ * @file packageindex.cpp
+ */
+#include "packageindex.h"
+#include "archivefilter.h"
+#include <rps/exception.h>
+#include <archive.h>
+#include <algorithm>
+#include <cstring>
+#include <archive_entry.h>
+
+#define INDEX_FRAME_MAGIC 0x184D2A5E
+#define INDEX_MAGIC "RPSINDEX"
+#define INDEX_HEADER_SIZE 32
+#define INDEX_BLOCK_SIZE 32
+#define INDEX_ENTRY_SIZE 24
+#define INDEX_FOOTER_SIZE 16
+
+namespace rose
+{
+
+static void put32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(v >> (8 * i));
+}
+
+static void put64(std::vector<uint8_t> &out, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        out.push_back(v >> (8 * i));
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+PackageIndex::PackageIndex(Compression::Codec codec) : mCodec(codec) {}
+
+void PackageIndex::addBlock(const Block &block) { mBlocks.push_back(block); }
+
+void PackageIndex::addEntry(const Entry &entry) { mEntries.push_back(entry); }
+
+std::vector<uint8_t> PackageIndex::serialize() const
+{
+    std::vector<const Entry *> entries;
+    for (auto &e : mEntries)
+        entries.push_back(&e);
+    std::sort(entries.begin(), entries.end(),
+        [](const Entry *a, const Entry *b) { return a->name < b->name; });
+
+    uint64_t names_size = 0;
+    for (auto e : entries)
+        names_size += e->name.size();
+
+    uint64_t index_size = INDEX_HEADER_SIZE + mBlocks.size() * INDEX_BLOCK_SIZE +
+                          entries.size() * INDEX_ENTRY_SIZE + names_size;
+    if (index_size + INDEX_FOOTER_SIZE > UINT32_MAX)
+        throw Exception("package index too large");
+
+    std::vector<uint8_t> out;
+    out.reserve(8 + index_size + INDEX_FOOTER_SIZE);
+
+    put32(out, INDEX_FRAME_MAGIC);
+    put32(out, index_size + INDEX_FOOTER_SIZE);
+
+    out.insert(out.end(), INDEX_MAGIC, INDEX_MAGIC + 8);
+    put32(out, Version);
+    put32(out, static_cast<uint32_t>(mCodec));
+    put64(out, mBlocks.size());
+    put64(out, entries.size());
+
+    for (auto &b : mBlocks) {
+        put64(out, b.compressedOffset);
+        put64(out, b.compressedSize);
+        put64(out, b.uncompressedOffset);
+        put64(out, b.uncompressedSize);
+    }
+
+    uint32_t name_offset = 0;
+    for (auto e : entries) {
+        put64(out, e->offset);
+        put64(out, e->size);
+        put32(out, name_offset);
+        put32(out, e->name.size());
+        name_offset += e->name.size();
+    }
+
+    for (auto e : entries)
+        out.insert(out.end(), e->name.begin(), e->name.end());
+
+    put64(out, index_size);
+    out.insert(out.end(), INDEX_MAGIC, INDEX_MAGIC + 8);
+
+    return out;
+}
+
+bool PackageIndexReader::open(const uint8_t *package, size_t size)
+{
+    if (size < 8 + INDEX_HEADER_SIZE + INDEX_FOOTER_SIZE)
+        return false;
+
+    const uint8_t *footer = package + size - INDEX_FOOTER_SIZE;
+    if (memcmp(footer + 8, INDEX_MAGIC, 8) != 0)
+        return false;
+
+    uint64_t index_size = get64(footer);
+    if (index_size < INDEX_HEADER_SIZE || index_size > size - INDEX_FOOTER_SIZE - 8)
+        return false;
+
+    const uint8_t *header = footer - index_size;
+    if (get32(header - 8) != INDEX_FRAME_MAGIC || memcmp(header, INDEX_MAGIC, 8) != 0 ||
+        get32(header + 8) != PackageIndex::Version)
+        return false;
+
+    uint32_t codec = get32(header + 12);
+    if (codec > static_cast<uint32_t>(Compression::Codec::Lz4))
+        return false;
+
+    mBlockCount = get64(header + 16);
+    mEntryCount = get64(header + 24);
+    if (mBlockCount > index_size / INDEX_BLOCK_SIZE ||
+        mEntryCount > index_size / INDEX_ENTRY_SIZE ||
+        INDEX_HEADER_SIZE + mBlockCount * INDEX_BLOCK_SIZE + mEntryCount * INDEX_ENTRY_SIZE >
+            index_size)
+        return false;
+
+    mPackage = package;
+    mCodec = static_cast<Compression::Codec>(codec);
+    mBlocks = header + INDEX_HEADER_SIZE;
+    mEntries = mBlocks + mBlockCount * INDEX_BLOCK_SIZE;
+    mNames = mEntries + mEntryCount * INDEX_ENTRY_SIZE;
+    mNamesSize = header + index_size - mNames;
+
+    // the data described by the index lies before the index
+    mDataSize = header - 8 - package;
+
+    return true;
+}
+
+Compression::Codec PackageIndexReader::codec() const { return mCodec; }
+
+bool PackageIndexReader::read(const std::string &name, std::string &content) const
+{
+    // binary search in the entries sorted by name
+    uint64_t lo = 0, hi = mEntryCount;
+    const uint8_t *entry = nullptr;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        const uint8_t *e = mEntries + mid * INDEX_ENTRY_SIZE;
+        uint32_t name_offset = get32(e + 16);
+        uint32_t name_length = get32(e + 20);
+        if (uint64_t(name_offset) + name_length > mNamesSize)
+            throw Exception("invalid package index");
+
+        const char *entry_name = reinterpret_cast<const char *>(mNames + name_offset);
+        int c = name.compare(0, std::string::npos, entry_name, name_length);
+        if (c == 0) {
+            entry = e;
+            break;
+        }
+        if (c < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    if (!entry)
+        return false;
+
+    uint64_t offset = get64(entry);
+    uint64_t size = get64(entry + 8);
+
+    content.clear();
+
+    if (mCodec == Compression::Codec::None) {
+        if (offset > mDataSize || size > mDataSize - offset)
+            throw Exception("invalid package index");
+        content.assign(reinterpret_cast<const char *>(mPackage + offset), size);
+        return true;
+    }
+
+    // last block that starts at or before the entry data
+    lo = 0;
+    hi = mBlockCount;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (block(mid).uncompressedOffset <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0 && size > 0)
+        throw Exception("invalid package index");
+
+    for (uint64_t i = lo - 1; content.size() < size; i++) {
+        if (i >= mBlockCount)
+            throw Exception("invalid package index");
+
+        PackageIndex::Block b = block(i);
+        uint64_t pos = offset + content.size();
+        if (pos < b.uncompressedOffset || pos - b.uncompressedOffset > b.uncompressedSize)
+            throw Exception("invalid package index");
+
+        uint64_t skip = pos - b.uncompressedOffset;
+        if (skip == b.uncompressedSize)
+            continue;
+        uint64_t length = std::min(size - content.size(), b.uncompressedSize - skip);
+        readBlock(b, skip, length, content);
+    }
+
+    return true;
+}
+
+PackageIndex::Block PackageIndexReader::block(uint64_t i) const
+{
+    const uint8_t *p = mBlocks + i * INDEX_BLOCK_SIZE;
+    return {get64(p), get64(p + 8), get64(p + 16), get64(p + 24)};
+}
+
+void PackageIndexReader::readBlock(
+    const PackageIndex::Block &b, uint64_t skip, uint64_t length, std::string &content) const
+{
+    if (b.compressedOffset > mDataSize || b.compressedSize > mDataSize - b.compressedOffset)
+        throw Exception("invalid package index");
+
+    struct archive *a = archive_read_new();
+    struct archive_entry *entry;
+    archive_read_support_filter_all(a);
+    archive_read_support_format_raw(a);
+
+    if (archive_read_open_memory(a, mPackage + b.compressedOffset, b.compressedSize) !=
+            ARCHIVE_OK ||
+        archive_read_next_header(a, &entry) != ARCHIVE_OK) {
+        std::string error = archiveError(a);
+        archive_read_free(a);
+        throw Exception("cannot read package block: " + error);
+    }
+
+    // decompress up to the end of the requested range
+    char buf[16384];
+    uint64_t pos = 0;
+    while (pos < skip + length) {
+        la_ssize_t n = archive_read_data(a, buf, sizeof(buf));
+        if (n <= 0) {
+            archive_read_free(a);
+            throw Exception("package block is truncated");
+        }
+
+        uint64_t start = std::max(pos, skip);
+        uint64_t end = std::min(pos + n, skip + length);
+        if (start < end)
+            content.append(buf + (start - pos), end - start);
+        pos += n;
+    }
+
+    archive_read_free(a);
+}
+
+} // namespace rose
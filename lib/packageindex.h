@@ -0,0 +1,113 @@
+/**
+ * @file packageindex.h
+ * @brief Index for random access to the entries of a package file.
+ *
+ * The index is appended to a package after the last compressed stream. It lists the compressed
+ * blocks written by the BlockCompressor and the data offset of each entry in the uncompressed
+ * archive, so a single entry can be read by decompressing only the blocks that contain it.
+ *
+ * Layout, all numbers little endian:
+ *
+ *     uint32 frame magic 0x184D2A5E, uint32 frame size   (skippable frame of zstd and lz4)
+ *     header:  char[8] "RPSINDEX", uint32 version, uint32 codec,
+ *              uint64 block count, uint64 entry count
+ *     blocks:  uint64 compressed offset, uint64 compressed size,
+ *              uint64 uncompressed offset, uint64 uncompressed size
+ *     entries: uint64 data offset, uint64 size, uint32 name offset, uint32 name length
+ *              (sorted by name)
+ *     names
+ *     footer:  uint64 size of header to names, char[8] "RPSINDEX"
+ *
+ * The frame header makes the index a skippable frame for zstd and lz4 readers. The bzip2 and
+ * gzip readers stop at data without a stream signature and the tar reader at the end of archive
+ * marker. xz readers do not accept trailing data, xz packages have no index.
+ */
+#ifndef _PACKAGEINDEX_H
+#define _PACKAGEINDEX_H
+
+#include <rps/compression.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rose
+{
+
+class PackageIndex
+{
+  public:
+    struct Block {
+        uint64_t compressedOffset;
+        uint64_t compressedSize;
+        uint64_t uncompressedOffset;
+        uint64_t uncompressedSize;
+    };
+
+    struct Entry {
+        std::string name;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+  public:
+    explicit PackageIndex(Compression::Codec codec);
+
+    void addBlock(const Block &block);
+    void addEntry(const Entry &entry);
+
+    /**
+     * @brief The index in the binary format appended to package files.
+     */
+    std::vector<uint8_t> serialize() const;
+
+    static constexpr uint32_t Version = 1;
+
+  private:
+    Compression::Codec mCodec;
+    std::vector<Block> mBlocks;
+    std::vector<Entry> mEntries;
+};
+
+/**
+ * Reads the index of a package mapped into memory, the index is not copied.
+ */
+class PackageIndexReader
+{
+  public:
+    /**
+     * @brief Locate the index at the end of a package.
+     * @return false if the package has no valid index
+     */
+    bool open(const uint8_t *package, size_t size);
+
+    Compression::Codec codec() const;
+
+    /**
+     * @brief Read the content of an entry.
+     * @param name Path of the entry in the package.
+     * @param content The data of the entry.
+     * @return false if there is no entry with this name
+     */
+    bool read(const std::string &name, std::string &content) const;
+
+  private:
+    PackageIndex::Block block(uint64_t i) const;
+    void readBlock(const PackageIndex::Block &b, uint64_t skip, uint64_t length,
+        std::string &content) const;
+
+  private:
+    const uint8_t *mPackage{nullptr};
+    Compression::Codec mCodec{Compression::Codec::None};
+    uint64_t mBlockCount{0};
+    uint64_t mEntryCount{0};
+    const uint8_t *mBlocks{nullptr};
+    const uint8_t *mEntries{nullptr};
+    const uint8_t *mNames{nullptr};
+    uint64_t mNamesSize{0};
+    uint64_t mDataSize{0};
+};
+
+} // namespace rose
+
+#endif /* _PACKAGEINDEX_H */
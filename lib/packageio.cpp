@@ -0,0 +1,121 @@
+/**
+ * @file packageio.cpp
+ */
+#include "rps/packageio.h"
+#include <rps/exception.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace rose
+{
+
+PackageSource::~PackageSource() {}
+
+PackageSink::~PackageSink() {}
+
+void PackageSink::close() {}
+
+MemorySource::MemorySource(const void *data, size_t size)
+    : mData(static_cast<const uint8_t *>(data)), mSize(size)
+{
+}
+
+size_t MemorySource::read(void *buffer, size_t size)
+{
+    size_t n = std::min(size, mSize);
+    memcpy(buffer, mData, n);
+    mData += n;
+    mSize -= n;
+    return n;
+}
+
+FdSource::FdSource(int fd) : mFd(fd) {}
+
+size_t FdSource::read(void *buffer, size_t size)
+{
+    while (true) {
+        ssize_t n = ::read(mFd, buffer, size);
+        if (n >= 0)
+            return n;
+        if (errno != EINTR)
+            throw Exception(std::string("read() failed: ") + strerror(errno));
+    }
+}
+
+FileSource::FileSource(const std::filesystem::path &path)
+    : FdSource(::open(path.c_str(), O_RDONLY | O_CLOEXEC))
+{
+    if (mFd < 0)
+        throw Exception("cannot open file: " + path.string());
+    posix_fadvise(mFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+FileSource::~FileSource()
+{
+    if (mFd >= 0)
+        ::close(mFd);
+}
+
+CallbackSource::CallbackSource(std::function<size_t(void *, size_t)> read) : mRead(std::move(read))
+{
+}
+
+size_t CallbackSource::read(void *buffer, size_t size) { return mRead(buffer, size); }
+
+void MemorySink::write(const void *data, size_t size)
+{
+    mData.append(static_cast<const char *>(data), size);
+}
+
+const std::string &MemorySink::data() const { return mData; }
+
+FdSink::FdSink(int fd) : mFd(fd) {}
+
+void FdSink::write(const void *data, size_t size)
+{
+    auto p = static_cast<const uint8_t *>(data);
+    while (size > 0) {
+        ssize_t n = ::write(mFd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw Exception(std::string("write() failed: ") + strerror(errno));
+        p += n;
+        size -= n;
+    }
+}
+
+FileSink::FileSink(const std::filesystem::path &path)
+    : FdSink(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)), mPath(path)
+{
+    if (mFd < 0)
+        throw Exception("cannot create file: " + path.string());
+}
+
+FileSink::~FileSink()
+{
+    if (mFd >= 0)
+        ::close(mFd);
+}
+
+void FileSink::close()
+{
+    if (mFd < 0)
+        return;
+    int r = ::close(mFd);
+    mFd = -1;
+    if (r != 0)
+        throw Exception("cannot write file: " + mPath.string());
+}
+
+CallbackSink::CallbackSink(std::function<void(const void *, size_t)> write)
+    : mWrite(std::move(write))
+{
+}
+
+void CallbackSink::write(const void *data, size_t size) { mWrite(data, size); }
+
+} // namespace rose
@@ -0,0 +1,263 @@
+/**
+ * @file packagestore.cpp
+ */
+#include "rps/packagestore.h"
+#include "archivefilter.h"
+#include "mappedfile.h"
+#include "packageindex.h"
+#include "sha256.h"
+#include "stringhelper.h"
+#include <rps/defines.h>
+#include <rps/exception.h>
+#include <rps/package.h>
+#include <archive.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <archive_entry.h>
+
+namespace rose
+{
+
+/** The mode of files of manifests that do not record it, that of the entries of Package. */
+static constexpr uint32_t DefaultMode = 0644;
+
+PackageStore::PackageStore(const std::filesystem::path &root) : mPath(root / MPK_PACKAGE_STORE) {}
+
+std::filesystem::path PackageStore::path() const { return mPath; }
+
+std::filesystem::path PackageStore::objectPath(const FileHash &hash, uint32_t mode) const
+{
+    char hex[2 * MPK_FILEHASH_SIZE];
+    write_hexstr(hex, hash.data(), hash.size());
+    char octal[8];
+    snprintf(octal, sizeof(octal), "%04o", mode & 07777);
+
+    return mPath / "objects" / std::string(hex, 2) /
+           (std::string(hex + 2, sizeof(hex) - 2) + "." + octal);
+}
+
+bool PackageStore::contains(const FileHash &hash, uint32_t mode) const
+{
+    struct stat st;
+    return stat(objectPath(hash, mode).c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+size_t PackageStore::install(
+    const std::string &package_path, const std::filesystem::path &destination)
+{
+    std::string manifest_buffer = Package::readEntry(package_path, "manifest.json");
+    Manifest manifest;
+    manifest.readFromBuffer(manifest_buffer);
+
+    // the names of the manifests are checked when they are read, see Manifest
+    std::map<std::string, Object> missing;
+    for (auto &f : manifest.files()) {
+        if (!f.hasHash())
+            throw Exception("package has no file hashes: " + package_path);
+        Object object{f.hash(), f.mode() ? f.mode() : DefaultMode};
+        if (!contains(object.hash, object.mode))
+            missing["data/" + std::string(f.name())] = object;
+    }
+
+    if (!missing.empty())
+        addObjects(package_path, missing);
+
+    for (auto &f : manifest.files())
+        linkObject({f.hash(), f.mode() ? f.mode() : DefaultMode}, destination / "data" / f.name());
+
+    // remove the files of a previously installed revision that are not in this one
+    std::filesystem::path manifest_path = destination / "manifest.json";
+    if (std::filesystem::exists(manifest_path)) {
+        std::set<std::string_view> names;
+        for (auto &f : manifest.files())
+            names.insert(f.name());
+
+        Manifest previous;
+        previous.readFromFile(manifest_path.string());
+        for (auto &f : previous.files())
+            if (!names.count(f.name()))
+                unlink((destination / "data" / f.name()).c_str());
+    }
+
+    std::filesystem::path tmp_path = manifest_path.string() + ".rps-tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw Exception("cannot create file: " + tmp_path.string());
+    ssize_t n = write(fd, manifest_buffer.data(), manifest_buffer.size());
+    if (::close(fd) != 0 || n != static_cast<ssize_t>(manifest_buffer.size()) ||
+        rename(tmp_path.c_str(), manifest_path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        throw Exception("cannot write file: " + manifest_path.string());
+    }
+
+    return missing.size();
+}
+
+void PackageStore::addObjects(
+    const std::string &package_path, const std::map<std::string, Object> &missing)
+{
+    // with an index only the blocks of the missing entries are decompressed
+    MappedFile package;
+    if (!package.open(package_path, false))
+        throw Exception("cannot open package: " + package_path);
+
+    PackageIndexReader index;
+    if (index.open(package.data(), package.size())) {
+        std::string content;
+        for (auto &m : missing) {
+            if (!index.read(m.first, content))
+                throw Exception("no entry '" + m.first + "' in package: " + package_path);
+            addObject(m.second, [&](const std::function<void(const uint8_t *, size_t)> &write) {
+                write(reinterpret_cast<const uint8_t *>(content.data()), content.size());
+            });
+        }
+        return;
+    }
+
+    struct archive *a = archive_read_new();
+    struct archive_entry *entry;
+    archive_read_support_filter_all(a);
+    archive_read_support_format_all(a);
+
+    if (archive_read_open_memory(a, package.data(), package.size()) != ARCHIVE_OK) {
+        archive_read_free(a);
+        throw Exception("cannot read package: " + package_path);
+    }
+
+    try {
+        int r;
+        while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+            auto it = missing.find(archive_entry_pathname(entry));
+            if (it == missing.end())
+                continue;
+
+            addObject(it->second, [&](const std::function<void(const uint8_t *, size_t)> &write) {
+                char buf[16384];
+                la_ssize_t n;
+                while ((n = archive_read_data(a, buf, sizeof(buf))) > 0)
+                    write(reinterpret_cast<const uint8_t *>(buf), n);
+                if (n < 0)
+                    throw Exception("cannot read entry '" + it->first + "' of package: " +
+                                    package_path);
+            });
+        }
+        if (r != ARCHIVE_EOF)
+            throw Exception("cannot read package: " + archiveError(a));
+    } catch (...) {
+        archive_read_free(a);
+        throw;
+    }
+    archive_read_free(a);
+
+    for (auto &m : missing)
+        if (!contains(m.second.hash, m.second.mode))
+            throw Exception("no entry '" + m.first + "' in package: " + package_path);
+}
+
+void PackageStore::addObject(const Object &object,
+    const std::function<void(const std::function<void(const uint8_t *, size_t)> &)> &produce)
+{
+    // several files of a package can have the same content
+    if (contains(object.hash, object.mode))
+        return;
+
+    std::filesystem::path object_path = objectPath(object.hash, object.mode);
+    std::filesystem::create_directories(object_path.parent_path());
+
+    std::string tmp_path = (mPath / "objects" / "tmp-XXXXXX").string();
+    int fd = mkstemp(tmp_path.data());
+    if (fd < 0)
+        throw Exception("cannot create object in " + mPath.string());
+
+    Sha256 sha;
+    try {
+        produce([&](const uint8_t *data, size_t length) {
+            sha.update(data, length);
+            while (length > 0) {
+                ssize_t n = write(fd, data, length);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    throw Exception(std::string("write() failed: ") + strerror(errno));
+                data += n;
+                length -= n;
+            }
+        });
+    } catch (...) {
+        ::close(fd);
+        unlink(tmp_path.c_str());
+        throw;
+    }
+
+    fchmod(fd, object.mode);
+    if (::close(fd) != 0 || sha.finish() != object.hash ||
+        rename(tmp_path.c_str(), object_path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        throw Exception("cannot add object " + object_path.filename().string());
+    }
+}
+
+void PackageStore::linkObject(const Object &object, const std::filesystem::path &dest) const
+{
+    std::filesystem::path object_path = objectPath(object.hash, object.mode);
+
+    // an unchanged file is not touched
+    struct stat object_st, dest_st;
+    if (stat(object_path.c_str(), &object_st) != 0)
+        throw Exception("object is missing: " + object_path.string());
+    if (stat(dest.c_str(), &dest_st) == 0 && dest_st.st_dev == object_st.st_dev &&
+        dest_st.st_ino == object_st.st_ino)
+        return;
+
+    std::filesystem::create_directories(dest.parent_path());
+    std::filesystem::path tmp_path = dest.string() + ".rps-tmp";
+    unlink(tmp_path.c_str());
+
+    if (link(object_path.c_str(), tmp_path.c_str()) != 0) {
+        // the destination is on another file system, share the extents or copy
+        int in = ::open(object_path.c_str(), O_RDONLY | O_CLOEXEC);
+        int out = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        bool copied = in >= 0 && out >= 0 && ioctl(out, FICLONE, in) == 0;
+        if (in >= 0)
+            ::close(in);
+        if (out >= 0)
+            ::close(out);
+
+        std::error_code ec;
+        if (!copied && !std::filesystem::copy_file(object_path, tmp_path,
+                           std::filesystem::copy_options::overwrite_existing, ec)) {
+            unlink(tmp_path.c_str());
+            throw Exception("cannot install file: " + dest.string());
+        }
+        chmod(tmp_path.c_str(), object.mode);
+    }
+
+    if (rename(tmp_path.c_str(), dest.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        throw Exception("cannot install file: " + dest.string());
+    }
+}
+
+size_t PackageStore::collectGarbage()
+{
+    size_t removed = 0;
+
+    std::error_code ec;
+    for (auto &e : std::filesystem::recursive_directory_iterator(mPath / "objects", ec)) {
+        if (!e.is_regular_file() || e.hard_link_count() > 1)
+            continue;
+        if (unlink(e.path().c_str()) == 0)
+            removed++;
+    }
+
+    return removed;
+}
+
+} // namespace rose
@@ -0,0 +1,51 @@
+/**
+ * @file repository.cpp
+ */
+#include "rps/repository.h"
+#include <rps/exception.h>
+#include <algorithm>
+
+namespace rose
+{
+
+void Repository::add(const std::string &name, int32_t revision,
+    std::vector<Dependency> dependencies, const std::string &source)
+{
+    if (revision <= 0)
+        throw Exception("invalid revision of package " + name);
+
+    auto &revisions = mPackages[name];
+    auto it = std::lower_bound(revisions.begin(), revisions.end(), revision,
+        [](const Revision &r, int32_t revision) { return r.revision < revision; });
+    if (it != revisions.end() && it->revision == revision)
+        *it = Revision{revision, std::move(dependencies), source};
+    else
+        revisions.insert(it, Revision{revision, std::move(dependencies), source});
+}
+
+void Repository::add(const Manifest &manifest)
+{
+    add(manifest.packageName(), manifest.packageVersion(), manifest.dependencies(),
+        manifest.source());
+}
+
+const std::vector<Repository::Revision> *Repository::revisions(std::string_view name) const
+{
+    auto it = mPackages.find(std::string(name));
+    return it == mPackages.end() ? nullptr : &it->second;
+}
+
+const Repository::Revision *Repository::revision(std::string_view name, int32_t revision) const
+{
+    auto revisions = this->revisions(name);
+    if (!revisions)
+        return nullptr;
+
+    auto it = std::lower_bound(revisions->begin(), revisions->end(), revision,
+        [](const Revision &r, int32_t revision) { return r.revision < revision; });
+    return it != revisions->end() && it->revision == revision ? &*it : nullptr;
+}
+
+size_t Repository::packageCount() const { return mPackages.size(); }
+
+} // namespace rose
@@ -0,0 +1,696 @@
+/**
+ * @file resolver.cpp
+ */
+#include "rps/resolver.h"
+#include <rps/exception.h>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace rose
+{
+
+// the literal 2 * v means variable v is true, 2 * v + 1 means it is false
+typedef uint32_t Lit;
+
+static const Lit NoLit = UINT32_MAX;
+static const Lit NoDecision = UINT32_MAX - 1;
+static const uint32_t NoVar = UINT32_MAX;
+static const uint32_t NoPackage = UINT32_MAX;
+static const uint32_t NoReason = UINT32_MAX;
+static const uint32_t ExactlyOneReason = UINT32_MAX - 1;
+
+// longer backjumps only undo one level, the undone decisions would mostly be repeated
+static const uint32_t ChronologicalBacktrackLimit = 100;
+
+static inline Lit selected(uint32_t var) { return var << 1; }
+
+static inline Lit notSelected(uint32_t var) { return (var << 1) | 1; }
+
+static inline uint32_t variable(Lit lit) { return lit >> 1; }
+
+static inline bool isNegative(Lit lit) { return lit & 1; }
+
+/** Index range [first, last) of the revisions inside an interval. */
+static std::pair<size_t, size_t> revisionRange(
+    const std::vector<Repository::Revision> &revisions, const VersionInterval &interval)
+{
+    auto first = std::lower_bound(revisions.begin(), revisions.end(), interval.start,
+        [](const Repository::Revision &r, int32_t v) { return r.revision < v; });
+    auto last = std::upper_bound(first, revisions.end(), interval.end,
+        [](int32_t v, const Repository::Revision &r) { return v < r.revision; });
+    return {first - revisions.begin(), last - revisions.begin()};
+}
+
+/**
+ * Variable firstVar + k of a package is true if the k-th revision is selected, k = 0 is the
+ * empty revision. "At least one" is a clause per package, "at most one" is propagated directly
+ * when a variable becomes true instead of adding a quadratic number of binary clauses.
+ *
+ * Packages and the dependency clauses of a revision are added when the revision is selected for
+ * the first time, so revisions and packages the search never reaches cost nothing. A clause
+ * "not r or allowed revisions" is satisfied as long as r is not selected.
+ */
+class DependencySolver
+{
+  public:
+    struct Package {
+        std::string_view name;
+        const std::vector<Repository::Revision> *revisions;
+        uint32_t firstVar;
+        uint32_t varCount;
+        uint32_t installedVar;
+        uint32_t selectedVar;
+    };
+
+    DependencySolver(const Repository &repository, const std::map<std::string, int32_t> &installed)
+        : mRepository(repository), mInstalled(installed)
+    {
+    }
+
+    void build(const std::vector<PackageRevision> &requests);
+    bool solve();
+
+    /** Package indices in dependency order, by the selected or the installed revisions. */
+    std::vector<uint32_t> postOrder(bool installed) const;
+
+    const Repository::Revision *revision(uint32_t package, bool installed) const;
+    int32_t revisionNumber(uint32_t package, bool installed) const;
+
+    const std::vector<Package> &packages() const { return mPackages; }
+    size_t conflicts() const { return mConflicts; }
+
+  private:
+    struct Clause {
+        uint32_t start;
+        uint32_t size;
+    };
+
+    uint32_t packageIndex(std::string_view name);
+    void addRequirements(uint32_t var, std::vector<Lit> &conflict);
+    bool activate(uint32_t var);
+    bool addRequirement(uint32_t var, const Dependency &dependency, std::vector<Lit> &conflict);
+    bool addClause(std::vector<Lit> &lits, std::vector<Lit> &conflict);
+    uint32_t addClause(const Lit *lits, size_t size);
+    bool addUnit(Lit lit);
+
+    int value(Lit lit) const;
+    uint32_t level() const { return mTrailLimits.size(); }
+    void enqueue(Lit lit, uint32_t reason);
+    bool propagate();
+    void reason(uint32_t var, std::vector<Lit> &lits) const;
+    uint32_t analyze(std::vector<Lit> &learnt);
+    void backtrack(uint32_t level);
+    int64_t preference(uint32_t var) const;
+    Lit prepare(Lit lit);
+    Lit decide();
+
+  private:
+    const Repository &mRepository;
+    const std::map<std::string, int32_t> &mInstalled;
+
+    std::vector<Package> mPackages;
+    std::unordered_map<std::string_view, uint32_t> mPackageIndex;
+    std::vector<uint32_t> mVarPackage;
+
+    std::vector<Lit> mLits;
+    std::vector<Clause> mClauses;
+    std::vector<std::vector<uint32_t>> mWatches;
+    bool mUnsatisfiable{false};
+
+    // first clause and number of dependency clauses of the variables that have been selected
+    std::vector<std::pair<uint32_t, uint32_t>> mRequirements;
+    std::vector<uint8_t> mActivated;
+    std::vector<uint8_t> mAllowed;
+
+    std::vector<uint8_t> mValue;
+    std::vector<uint32_t> mLevel;
+    std::vector<uint32_t> mReason;
+    std::vector<uint8_t> mSeen;
+    std::vector<Lit> mTrail;
+    std::vector<uint32_t> mTrailLimits;
+    size_t mPropagated{0};
+    std::vector<Lit> mConflict;
+
+    // dependency clauses of selected revisions, in the order the revisions were selected
+    std::vector<uint32_t> mPending;
+    std::vector<uint32_t> mPendingLimits;
+    size_t mPendingHead{0};
+    size_t mNextPackage{0};
+    // the positions of decide() when the decision of each level was made
+    std::vector<std::pair<size_t, size_t>> mDecisionPositions;
+
+    size_t mConflicts{0};
+};
+
+uint32_t DependencySolver::packageIndex(std::string_view name)
+{
+    auto it = mPackageIndex.find(name);
+    if (it != mPackageIndex.end())
+        return it->second;
+
+    // packages without revisions are never installed and need no variables
+    auto revisions = mRepository.revisions(name);
+    if (!revisions || revisions->empty())
+        return NoPackage;
+
+    uint32_t index = mPackages.size();
+    uint32_t first_var = mValue.size();
+    uint32_t var_count = revisions->size() + 1;
+    mPackages.push_back({name, revisions, first_var, var_count, first_var, NoVar});
+    mPackageIndex.emplace(name, index);
+
+    auto installed = mInstalled.find(std::string(name));
+    if (installed != mInstalled.end()) {
+        auto range = revisionRange(*revisions, {installed->second, installed->second});
+        if (range.first != range.second)
+            mPackages.back().installedVar = first_var + 1 + range.first;
+    }
+
+    uint32_t vars = first_var + var_count;
+    mVarPackage.resize(vars, index);
+    mWatches.resize(2 * size_t(vars));
+    mValue.resize(vars, 0);
+    mLevel.resize(vars, 0);
+    mReason.resize(vars, NoReason);
+    mSeen.resize(vars, 0);
+    mRequirements.resize(vars, {0, 0});
+    mActivated.resize(vars, 0);
+    // the empty revision has no dependencies
+    mActivated[first_var] = 1;
+
+    // at least one revision of the package
+    std::vector<Lit> lits;
+    for (uint32_t v = first_var; v < vars; v++)
+        lits.push_back(selected(v));
+    addClause(lits.data(), lits.size());
+
+    return index;
+}
+
+void DependencySolver::build(const std::vector<PackageRevision> &requests)
+{
+    // the installed revisions are likely kept, their dependencies are known from the start to
+    // avoid a conflict for each installed revision that has to be updated
+    for (auto &i : mInstalled)
+        packageIndex(i.first);
+    std::vector<Lit> no_conflict_before_search;
+    for (size_t i = 0, count = mPackages.size(); i < count; i++)
+        if (mPackages[i].installedVar != mPackages[i].firstVar)
+            addRequirements(mPackages[i].installedVar, no_conflict_before_search);
+
+    for (auto &r : requests) {
+        uint32_t index = packageIndex(r.name);
+        if (r.revision == 0) {
+            // unknown packages are never installed
+            if (index != NoPackage && !addUnit(selected(mPackages[index].firstVar)))
+                mUnsatisfiable = true;
+            continue;
+        }
+
+        std::pair<size_t, size_t> range{0, 0};
+        if (index != NoPackage)
+            range = revisionRange(*mPackages[index].revisions, {r.revision, r.revision});
+        if (range.first == range.second)
+            throw Exception("unknown revision " + std::to_string(r.revision) + " of package " +
+                            r.name);
+
+        if (!addUnit(selected(mPackages[index].firstVar + 1 + range.first)))
+            mUnsatisfiable = true;
+    }
+}
+
+void DependencySolver::addRequirements(uint32_t var, std::vector<Lit> &conflict)
+{
+    if (mActivated[var])
+        return;
+    mActivated[var] = 1;
+
+    const Package &p = mPackages[mVarPackage[var]];
+    auto &dependencies = (*p.revisions)[var - p.firstVar - 1].dependencies;
+
+    // all clauses are added even after a conflict, the revision may be selected again
+    uint32_t first = mClauses.size();
+    for (auto &d : dependencies)
+        addRequirement(var, d, conflict);
+    mRequirements[var] = {first, static_cast<uint32_t>(mClauses.size()) - first};
+}
+
+bool DependencySolver::activate(uint32_t var)
+{
+    std::vector<Lit> conflict;
+    addRequirements(var, conflict);
+
+    for (uint32_t c = 0; c < mRequirements[var].second; c++)
+        mPending.push_back(mRequirements[var].first + c);
+
+    if (conflict.empty())
+        return true;
+    mConflict.swap(conflict);
+    return false;
+}
+
+bool DependencySolver::addRequirement(
+    uint32_t var, const Dependency &dependency, std::vector<Lit> &conflict)
+{
+    uint32_t index = packageIndex(dependency.name);
+    uint32_t var_count = index == NoPackage ? 1 : mPackages[index].varCount;
+    auto revisions = index == NoPackage ? nullptr : mPackages[index].revisions;
+
+    // mark the allowed revisions by index, each interval is found with a binary search
+    mAllowed.assign(var_count, dependency.requires.empty());
+    mAllowed[0] = dependency.requires.empty() || dependency.requires.contains(0);
+    for (auto i : dependency.requires) {
+        if (revisions) {
+            auto range = revisionRange(*revisions, i);
+            std::fill(mAllowed.begin() + 1 + range.first, mAllowed.begin() + 1 + range.second, 1);
+        }
+    }
+    if (revisions) {
+        for (auto i : dependency.conflicts) {
+            auto range = revisionRange(*revisions, i);
+            std::fill(mAllowed.begin() + 1 + range.first, mAllowed.begin() + 1 + range.second, 0);
+        }
+    }
+
+    if (std::find(mAllowed.begin(), mAllowed.end(), 0) == mAllowed.end())
+        return true;
+
+    std::vector<Lit> lits{notSelected(var)};
+    for (uint32_t k = 0; k < var_count; k++)
+        if (mAllowed[k])
+            lits.push_back(selected(mPackages[index].firstVar + k));
+
+    // a revision that can never be selected, the literal is repeated to have two watches
+    if (lits.size() == 1)
+        lits.push_back(lits[0]);
+
+    return addClause(lits, conflict);
+}
+
+/** Add a clause during the search and propagate it if it is unit. */
+bool DependencySolver::addClause(std::vector<Lit> &lits, std::vector<Lit> &conflict)
+{
+    // watch the literals that become false last: true, unassigned, then false literals of the
+    // highest levels
+    auto rank = [this](Lit lit) -> int64_t {
+        int v = value(lit);
+        return v == 1 ? INT64_MAX : v == 0 ? INT64_MAX - 1 : mLevel[variable(lit)];
+    };
+    for (size_t w = 0; w < 2; w++)
+        for (size_t k = w + 1; k < lits.size(); k++)
+            if (rank(lits[k]) > rank(lits[w]))
+                std::swap(lits[w], lits[k]);
+
+    uint32_t clause = addClause(lits.data(), lits.size());
+    int first = value(lits[0]);
+    int second = lits[1] == lits[0] ? -1 : value(lits[1]);
+    if (first == 1 || second != -1)
+        return true;
+    if (first == 0) {
+        enqueue(lits[0], clause);
+        return true;
+    }
+
+    if (conflict.empty())
+        conflict = lits;
+    return false;
+}
+
+uint32_t DependencySolver::addClause(const Lit *lits, size_t size)
+{
+    uint32_t index = mClauses.size();
+    mClauses.push_back({static_cast<uint32_t>(mLits.size()), static_cast<uint32_t>(size)});
+    mLits.insert(mLits.end(), lits, lits + size);
+    mWatches[lits[0]].push_back(index);
+    mWatches[lits[1]].push_back(index);
+    return index;
+}
+
+bool DependencySolver::addUnit(Lit lit)
+{
+    int v = value(lit);
+    if (v == 0)
+        enqueue(lit, NoReason);
+    return v >= 0;
+}
+
+int DependencySolver::value(Lit lit) const
+{
+    uint8_t v = mValue[variable(lit)];
+    if (v == 0)
+        return 0;
+    return (v == 1) != isNegative(lit) ? 1 : -1;
+}
+
+void DependencySolver::enqueue(Lit lit, uint32_t reason)
+{
+    uint32_t var = variable(lit);
+    mValue[var] = isNegative(lit) ? 2 : 1;
+    mLevel[var] = level();
+    mReason[var] = reason;
+    mTrail.push_back(lit);
+
+    if (!isNegative(lit))
+        mPackages[mVarPackage[var]].selectedVar = var;
+}
+
+bool DependencySolver::propagate()
+{
+    while (mPropagated < mTrail.size()) {
+        Lit lit = mTrail[mPropagated++];
+        uint32_t var = variable(lit);
+
+        if (!isNegative(lit)) {
+            // at most one revision of the package
+            const Package &p = mPackages[mVarPackage[var]];
+            for (uint32_t v = p.firstVar; v < p.firstVar + p.varCount; v++) {
+                if (v == var || mValue[v] == 2)
+                    continue;
+                if (mValue[v] == 1) {
+                    mConflict = {notSelected(var), notSelected(v)};
+                    return false;
+                }
+                enqueue(notSelected(v), ExactlyOneReason);
+            }
+
+            // may add packages and clauses, so it is done before the watches are referenced
+            if (!activate(var))
+                return false;
+        }
+
+        // the clauses watching the literal that became false
+        Lit false_lit = lit ^ 1;
+        std::vector<uint32_t> &watches = mWatches[false_lit];
+        size_t i = 0, j = 0;
+        while (i < watches.size()) {
+            uint32_t index = watches[i++];
+            const Clause &c = mClauses[index];
+            Lit *lits = &mLits[c.start];
+            if (lits[0] == false_lit)
+                std::swap(lits[0], lits[1]);
+
+            if (value(lits[0]) == 1) {
+                watches[j++] = index;
+                continue;
+            }
+
+            bool moved = false;
+            for (uint32_t k = 2; k < c.size; k++) {
+                if (value(lits[k]) != -1) {
+                    std::swap(lits[1], lits[k]);
+                    mWatches[lits[1]].push_back(index);
+                    moved = true;
+                    break;
+                }
+            }
+            if (moved)
+                continue;
+
+            watches[j++] = index;
+            if (value(lits[0]) == -1) {
+                mConflict.assign(lits, lits + c.size);
+                while (i < watches.size())
+                    watches[j++] = watches[i++];
+                watches.resize(j);
+                return false;
+            }
+            enqueue(lits[0], index);
+        }
+        watches.resize(j);
+    }
+
+    return true;
+}
+
+void DependencySolver::reason(uint32_t var, std::vector<Lit> &lits) const
+{
+    if (mReason[var] == ExactlyOneReason) {
+        lits = {notSelected(var), notSelected(mPackages[mVarPackage[var]].selectedVar)};
+        return;
+    }
+
+    // the implied literal is the first literal of the clause
+    const Clause &c = mClauses[mReason[var]];
+    lits.assign(mLits.begin() + c.start, mLits.begin() + c.start + c.size);
+}
+
+uint32_t DependencySolver::analyze(std::vector<Lit> &learnt)
+{
+    // first unique implication point
+    learnt.assign(1, NoLit);
+    std::vector<Lit> lits = mConflict;
+    size_t index = mTrail.size();
+    int counter = 0;
+    Lit lit = NoLit;
+
+    for (;;) {
+        for (Lit q : lits) {
+            uint32_t v = variable(q);
+            if ((lit != NoLit && v == variable(lit)) || mSeen[v] || mLevel[v] == 0)
+                continue;
+            mSeen[v] = 1;
+            if (mLevel[v] == level())
+                counter++;
+            else
+                learnt.push_back(q);
+        }
+
+        do {
+            lit = mTrail[--index];
+        } while (!mSeen[variable(lit)]);
+        mSeen[variable(lit)] = 0;
+
+        if (--counter == 0)
+            break;
+        reason(variable(lit), lits);
+    }
+    learnt[0] = lit ^ 1;
+
+    // the literal of the highest remaining level is watched with the asserting literal
+    uint32_t backtrack_level = 0;
+    for (size_t i = 1; i < learnt.size(); i++) {
+        mSeen[variable(learnt[i])] = 0;
+        if (mLevel[variable(learnt[i])] > backtrack_level) {
+            backtrack_level = mLevel[variable(learnt[i])];
+            std::swap(learnt[1], learnt[i]);
+        }
+    }
+
+    return backtrack_level;
+}
+
+void DependencySolver::backtrack(uint32_t level)
+{
+    if (this->level() <= level)
+        return;
+
+    for (size_t i = mTrail.size(); i-- > mTrailLimits[level];) {
+        uint32_t var = variable(mTrail[i]);
+        if (!isNegative(mTrail[i]))
+            mPackages[mVarPackage[var]].selectedVar = NoVar;
+        mValue[var] = 0;
+    }
+    mTrail.resize(mTrailLimits[level]);
+    mPending.resize(mPendingLimits[level]);
+    mPropagated = mTrail.size();
+
+    // everything before these positions was satisfied by the assignments that are kept
+    mPendingHead = mDecisionPositions[level].first;
+    mNextPackage = mDecisionPositions[level].second;
+
+    mTrailLimits.resize(level);
+    mPendingLimits.resize(level);
+    mDecisionPositions.resize(level);
+}
+
+int64_t DependencySolver::preference(uint32_t var) const
+{
+    const Package &p = mPackages[mVarPackage[var]];
+    bool is_installed = p.installedVar != p.firstVar;
+
+    // keep installed revisions, update installed packages, do not install other packages
+    if (var == p.installedVar)
+        return INT64_MAX;
+    if (var == p.firstVar)
+        return is_installed ? -1 : INT64_MAX;
+    return var - p.firstVar;
+}
+
+Lit DependencySolver::prepare(Lit lit)
+{
+    // the dependencies of a revision may rule it out by propagation before it is selected
+    size_t trail = mTrail.size();
+    std::vector<Lit> conflict;
+    addRequirements(variable(lit), conflict);
+    return mTrail.size() == trail ? lit : NoDecision;
+}
+
+Lit DependencySolver::decide()
+{
+    // the requirements of the selected revisions first
+    for (; mPendingHead < mPending.size(); mPendingHead++) {
+        const Clause &c = mClauses[mPending[mPendingHead]];
+        const Lit *lits = &mLits[c.start];
+
+        Lit best = NoLit;
+        int64_t best_preference = INT64_MIN;
+        bool satisfied = false;
+        for (uint32_t k = 0; k < c.size && !satisfied; k++) {
+            int v = value(lits[k]);
+            satisfied = v == 1;
+            if (v == 0 && !isNegative(lits[k]) && preference(variable(lits[k])) > best_preference) {
+                best = lits[k];
+                best_preference = preference(variable(lits[k]));
+            }
+        }
+        if (!satisfied && best != NoLit)
+            return prepare(best);
+    }
+
+    // then the packages nobody requires
+    for (; mNextPackage < mPackages.size(); mNextPackage++) {
+        const Package &p = mPackages[mNextPackage];
+        if (p.selectedVar != NoVar)
+            continue;
+
+        uint32_t best = NoVar;
+        for (uint32_t v = p.firstVar; v < p.firstVar + p.varCount; v++)
+            if (mValue[v] == 0 && (best == NoVar || preference(v) > preference(best)))
+                best = v;
+        return prepare(selected(best));
+    }
+
+    return NoLit;
+}
+
+bool DependencySolver::solve()
+{
+    if (mUnsatisfiable)
+        return false;
+
+    std::vector<Lit> learnt;
+    for (;;) {
+        if (!propagate()) {
+            mConflicts++;
+            if (level() == 0)
+                return false;
+
+            uint32_t backtrack_level = analyze(learnt);
+            if (learnt.size() > 1 && level() - backtrack_level > ChronologicalBacktrackLimit)
+                backtrack_level = level() - 1;
+            backtrack(backtrack_level);
+            if (learnt.size() == 1)
+                enqueue(learnt[0], NoReason);
+            else
+                enqueue(learnt[0], addClause(learnt.data(), learnt.size()));
+            continue;
+        }
+
+        Lit lit = decide();
+        if (lit == NoLit)
+            return true;
+        if (lit == NoDecision)
+            continue;
+
+        mTrailLimits.push_back(mTrail.size());
+        mPendingLimits.push_back(mPending.size());
+        mDecisionPositions.push_back({mPendingHead, mNextPackage});
+        enqueue(lit, NoReason);
+    }
+}
+
+const Repository::Revision *DependencySolver::revision(uint32_t package, bool installed) const
+{
+    const Package &p = mPackages[package];
+    uint32_t var = installed ? p.installedVar : p.selectedVar;
+    if (var == NoVar || var == p.firstVar)
+        return nullptr;
+    return &(*p.revisions)[var - p.firstVar - 1];
+}
+
+int32_t DependencySolver::revisionNumber(uint32_t package, bool installed) const
+{
+    auto r = revision(package, installed);
+    return r ? r->revision : 0;
+}
+
+std::vector<uint32_t> DependencySolver::postOrder(bool installed) const
+{
+    std::vector<uint32_t> order;
+    std::vector<uint8_t> visited(mPackages.size(), 0);
+    std::vector<std::pair<uint32_t, size_t>> stack;
+
+    for (uint32_t start = 0; start < mPackages.size(); start++) {
+        if (visited[start] || !revision(start, installed))
+            continue;
+        visited[start] = 1;
+        stack.push_back({start, 0});
+
+        while (!stack.empty()) {
+            uint32_t p = stack.back().first;
+            auto &dependencies = revision(p, installed)->dependencies;
+            if (stack.back().second == dependencies.size()) {
+                order.push_back(p);
+                stack.pop_back();
+                continue;
+            }
+
+            const Dependency &d = dependencies[stack.back().second++];
+            auto it = mPackageIndex.find(d.name);
+            if (d.requires.empty() || it == mPackageIndex.end())
+                continue;
+            uint32_t q = it->second;
+            if (visited[q] || !revision(q, installed))
+                continue;
+            visited[q] = 1;
+            stack.push_back({q, 0});
+        }
+    }
+
+    return order;
+}
+
+Resolver::Resolver(const Repository &repository) : mRepository(repository) {}
+
+void Resolver::setInstalled(const std::string &name, int32_t revision)
+{
+    if (revision == 0)
+        mInstalled.erase(name);
+    else
+        mInstalled[name] = revision;
+}
+
+std::vector<PackageRevision> Resolver::resolve(const std::vector<PackageRevision> &requests)
+{
+    DependencySolver solver(mRepository, mInstalled);
+    solver.build(requests);
+    bool satisfiable = solver.solve();
+    mConflicts = solver.conflicts();
+    if (!satisfiable)
+        throw Exception("the requested revisions cannot be installed, the dependencies conflict");
+
+    std::vector<PackageRevision> result;
+    auto &packages = solver.packages();
+
+    // removals must not break installed dependents, and conflicting packages must be gone before
+    // the new revisions are installed
+    auto order = solver.postOrder(true);
+    for (auto it = order.rbegin(); it != order.rend(); ++it)
+        if (solver.revisionNumber(*it, false) == 0)
+            result.push_back({std::string(packages[*it].name), 0, ""});
+
+    for (uint32_t p : solver.postOrder(false)) {
+        if (solver.revisionNumber(p, false) == solver.revisionNumber(p, true))
+            continue;
+        auto r = solver.revision(p, false);
+        result.push_back({std::string(packages[p].name), r->revision, r->source});
+    }
+
+    return result;
+}
+
+size_t Resolver::conflicts() const { return mConflicts; }
+
+} // namespace rose
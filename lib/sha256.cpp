@@ -0,0 +1,41 @@
+/**
+ * @file sha256.cpp
+ */
+#include "sha256.h"
+#include <rps/exception.h>
+#include <rps/file.h>
+
+namespace rose
+{
+
+Sha256::Sha256() : mContext(EVP_MD_CTX_new())
+{
+    if (!mContext || EVP_DigestInit_ex(mContext, EVP_sha256(), nullptr) != 1) {
+        EVP_MD_CTX_free(mContext);
+        throw Exception("cannot initialize SHA-256 context");
+    }
+}
+
+Sha256::~Sha256() { EVP_MD_CTX_free(mContext); }
+
+void Sha256::update(const void *data, size_t length)
+{
+    if (EVP_DigestUpdate(mContext, data, length) != 1)
+        throw Exception("EVP_DigestUpdate() failed");
+}
+
+FileHash Sha256::finish()
+{
+    FileHash digest;
+    unsigned int length = 0;
+
+    if (EVP_DigestFinal_ex(mContext, digest.data(), &length) != 1 || length != digest.size())
+        throw Exception("EVP_DigestFinal_ex() failed");
+
+    if (EVP_DigestInit_ex(mContext, EVP_sha256(), nullptr) != 1)
+        throw Exception("EVP_DigestInit_ex() failed");
+
+    return digest;
+}
+
+} // namespace rose
@@ -0,0 +1,43 @@
+/**
+ * @file sha256.h
+ * @brief Incremental SHA-256 calculation.
+ */
+#ifndef _SHA256_H
+#define _SHA256_H
+
+#include <rps/file.h>
+#include <openssl/evp.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace rose
+{
+
+/**
+ * Uses the EVP interface of libcrypto, which selects the SHA extensions of x86 (SHA-NI) or the
+ * ARMv8 crypto extensions at runtime if the CPU provides them.
+ */
+class Sha256
+{
+  public:
+    Sha256();
+    ~Sha256();
+
+    Sha256(const Sha256 &) = delete;
+    Sha256 &operator=(const Sha256 &) = delete;
+
+    void update(const void *data, size_t length);
+
+    /**
+     * @brief Finish the calculation and reset the context for the next hash.
+     * @return the digest of MPK_FILEHASH_SIZE bytes
+     */
+    FileHash finish();
+
+  private:
+    EVP_MD_CTX *mContext;
+};
+
+} // namespace rose
+
+#endif /* _SHA256_H */
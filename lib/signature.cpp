@@ -0,0 +1,120 @@
+/**
+ * @file signature.cpp
+ */
+#include "signature.h"
+#include "sha256.h"
+#include <rps/exception.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <cstdio>
+#include <vector>
+
+namespace rose
+{
+
+enum MerklePrefix : uint8_t { Leaf = 0, Node = 1 };
+
+static FileHash leafHash(const std::string &data)
+{
+    Sha256 sha;
+    uint8_t prefix = Leaf;
+    sha.update(&prefix, 1);
+    sha.update(data.data(), data.size());
+    return sha.finish();
+}
+
+FileHash Signature::merkleRoot(const Manifest &manifest)
+{
+    std::vector<FileHash> level;
+
+    // the metadata is covered as well, e.g. the dependencies
+    Manifest metadata(manifest);
+    std::vector<File> files;
+    files.swap(metadata.files());
+    level.push_back(leafHash(metadata.toBinary()));
+
+    for (auto &f : files) {
+        if (!f.hasHash())
+            throw Exception("cannot sign file without hash: " + std::string(f.name()));
+        std::string leaf(f.name());
+        leaf.push_back('\0');
+        leaf.append(std::to_string(f.mode()));
+        leaf.push_back('\0');
+        leaf.append(reinterpret_cast<const char *>(f.hash().data()), f.hash().size());
+        level.push_back(leafHash(leaf));
+    }
+
+    Sha256 sha;
+    while (level.size() > 1) {
+        std::vector<FileHash> next;
+        for (size_t i = 0; i + 1 < level.size(); i += 2) {
+            uint8_t prefix = Node;
+            sha.update(&prefix, 1);
+            sha.update(level[i].data(), level[i].size());
+            sha.update(level[i + 1].data(), level[i + 1].size());
+            next.push_back(sha.finish());
+        }
+        if (level.size() % 2)
+            next.push_back(level.back());
+        level.swap(next);
+    }
+    return level.front();
+}
+
+/** The digest used with a key, Ed25519 signs the message itself. */
+static const EVP_MD *digestOf(EVP_PKEY *key)
+{
+    return EVP_PKEY_id(key) == EVP_PKEY_ED25519 ? nullptr : EVP_sha256();
+}
+
+std::string Signature::sign(const FileHash &root, const std::string &private_key)
+{
+    FILE *file = fopen(private_key.c_str(), "r");
+    if (!file)
+        throw Exception("cannot open private key: " + private_key);
+    EVP_PKEY *key = PEM_read_PrivateKey(file, nullptr, nullptr, nullptr);
+    fclose(file);
+    if (!key)
+        throw Exception("cannot read private key: " + private_key);
+
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    size_t length = 0;
+    std::string signature;
+    bool ok = ctx && EVP_DigestSignInit(ctx, nullptr, digestOf(key), nullptr, key) == 1 &&
+              EVP_DigestSign(ctx, nullptr, &length, root.data(), root.size()) == 1;
+    if (ok) {
+        signature.resize(length);
+        ok = EVP_DigestSign(ctx, reinterpret_cast<unsigned char *>(signature.data()), &length,
+                 root.data(), root.size()) == 1;
+        signature.resize(length);
+    }
+    EVP_MD_CTX_free(ctx);
+    EVP_PKEY_free(key);
+
+    if (!ok)
+        throw Exception("cannot sign with key: " + private_key);
+    return signature;
+}
+
+bool Signature::verify(
+    const FileHash &root, const std::string &signature, const std::string &public_key)
+{
+    FILE *file = fopen(public_key.c_str(), "r");
+    if (!file)
+        throw Exception("cannot open public key: " + public_key);
+    EVP_PKEY *key = PEM_read_PUBKEY(file, nullptr, nullptr, nullptr);
+    fclose(file);
+    if (!key)
+        throw Exception("cannot read public key: " + public_key);
+
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    bool ok = ctx && EVP_DigestVerifyInit(ctx, nullptr, digestOf(key), nullptr, key) == 1 &&
+              EVP_DigestVerify(ctx, reinterpret_cast<const unsigned char *>(signature.data()),
+                  signature.size(), root.data(), root.size()) == 1;
+    EVP_MD_CTX_free(ctx);
+    EVP_PKEY_free(key);
+
+    return ok;
+}
+
+} // namespace rose
@@ -0,0 +1,49 @@
+/**
+ * @file signature.h
+ * @brief Package signatures over a Merkle tree of the file hashes.
+ */
+#ifndef _SIGNATURE_H
+#define _SIGNATURE_H
+
+#include <rps/file.h>
+#include <rps/manifest.h>
+#include <string>
+
+namespace rose
+{
+
+/**
+ * The leaves of the tree are the manifest without its file list, followed by the name, mode and
+ * hash of each file in the order of the manifest. An inner node hashes its two children, an odd
+ * node is carried up to the next level. Leaves and inner nodes are hashed with different prefixes,
+ * so one cannot be passed off as the other.
+ *
+ * Only the root is signed, so a signature is checked without reading the package data, and each
+ * file is checked against the hash of the manifest while it is extracted. Ed25519 keys sign the
+ * root directly, RSA and ECDSA keys sign its SHA-256 digest.
+ */
+class Signature
+{
+  public:
+    /**
+     * @throws Exception if a file has no hash
+     */
+    static FileHash merkleRoot(const Manifest &manifest);
+
+    /**
+     * @param private_key Path of the private key in PEM format.
+     * @return the signature
+     */
+    static std::string sign(const FileHash &root, const std::string &private_key);
+
+    /**
+     * @param public_key Path of the public key in PEM format.
+     * @return false if the signature does not match
+     */
+    static bool verify(
+        const FileHash &root, const std::string &signature, const std::string &public_key);
+};
+
+} // namespace rose
+
+#endif /* _SIGNATURE_H */
@@ -0,0 +1,61 @@
+/**
+ * @file stringarena.cpp
+ */
+#include "rps/stringarena.h"
+#include <algorithm>
+#include <cstring>
+
+namespace rose
+{
+
+StringArena::StringArena(StringArena &&other) noexcept
+    : mBlocks(std::move(other.mBlocks)), mCapacity(other.mCapacity), mPos(other.mPos),
+      mAvailable(other.mAvailable)
+{
+    other.clear();
+}
+
+StringArena &StringArena::operator=(StringArena &&other) noexcept
+{
+    if (this != &other) {
+        mBlocks = std::move(other.mBlocks);
+        mCapacity = other.mCapacity;
+        mPos = other.mPos;
+        mAvailable = other.mAvailable;
+        other.clear();
+    }
+    return *this;
+}
+
+std::string_view StringArena::add(std::string_view s)
+{
+    size_t length = s.size() + 1;
+    if (length > mAvailable) {
+        // strings larger than a block get a block of their own
+        size_t size = std::max(length, BlockSize);
+        mBlocks.emplace_back(new char[size]);
+        mCapacity += size;
+        mPos = mBlocks.back().get();
+        mAvailable = size;
+    }
+
+    char *p = mPos;
+    memcpy(p, s.data(), s.size());
+    p[s.size()] = '\0';
+    mPos += length;
+    mAvailable -= length;
+
+    return std::string_view(p, s.size());
+}
+
+void StringArena::clear()
+{
+    mBlocks.clear();
+    mCapacity = 0;
+    mPos = nullptr;
+    mAvailable = 0;
+}
+
+size_t StringArena::capacity() const { return mCapacity; }
+
+} // namespace rose
@@ -47,7 +47,7 @@ int hex2byte(const char *str)
 
 int read_hexstr(unsigned char barray[], int blen, const char *hexstr)
 {
-    int i;
+    int i = 0;
 
     while ((i < blen) && *hexstr && *(hexstr + 1)) {
         if (!isxdigit(*hexstr) || !isxdigit(*(hexstr + 1))) {
@@ -66,11 +66,11 @@ int read_hexstr(unsigned char barray[], int blen, const char *hexstr)
     return MPK_SUCCESS;
 }
 
-void write_hexstr(char *hexstr, unsigned char barray[], int blen)
+void write_hexstr(char *hexstr, const unsigned char barray[], int blen)
 {
     int i;
     char *dst = hexstr;
-    unsigned char *byte = barray;
+    const unsigned char *byte = barray;
 
     for (i = 0; i < blen; i++) {
         byte2hex(dst, *byte);
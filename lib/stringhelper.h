@@ -18,6 +18,6 @@ int hex2byte(const char *str);
  */
 int read_hexstr(unsigned char barray[], int blen, const char *hexstr);
 
-void write_hexstr(char *hexstr, unsigned char barray[], int blen);
+void write_hexstr(char *hexstr, const unsigned char barray[], int blen);
 
 #endif /* _STRING_H */
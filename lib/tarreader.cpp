@@ -0,0 +1,234 @@
+/**
+ * @file tarreader.cpp
+ */
+#include "tarreader.h"
+#include <rps/exception.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#define TAR_BLOCKSIZE 512
+
+namespace rose
+{
+
+/** Numeric header fields are octal or, if the first bit is set, base-256 encoded. */
+static uint64_t readNumber(const uint8_t *field, size_t length)
+{
+    uint64_t value = 0;
+
+    if (field[0] & 0x80) {
+        value = field[0] & 0x3f;
+        for (size_t i = 1; i < length; i++)
+            value = (value << 8) | field[i];
+        return value;
+    }
+
+    for (size_t i = 0; i < length && field[i]; i++) {
+        if (field[i] == ' ')
+            continue;
+        if (field[i] < '0' || field[i] > '7')
+            throw Exception("invalid number in tar header");
+        value = (value << 3) | (field[i] - '0');
+    }
+
+    return value;
+}
+
+static std::string readString(const uint8_t *field, size_t length)
+{
+    auto end = std::find(field, field + length, 0);
+    return std::string(reinterpret_cast<const char *>(field), end - field);
+}
+
+static bool checksumValid(const uint8_t *header)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < TAR_BLOCKSIZE; i++)
+        sum += (i >= 148 && i < 156) ? ' ' : header[i];
+
+    return sum == readNumber(header + 148, 8);
+}
+
+/** The size of entry data rounded up to whole blocks, data beyond the archive is rejected. */
+static uint64_t paddedSize(uint64_t entry_size, uint64_t available)
+{
+    if (entry_size > available)
+        throw Exception("truncated tar archive");
+    return (entry_size + TAR_BLOCKSIZE - 1) / TAR_BLOCKSIZE * TAR_BLOCKSIZE;
+}
+
+static bool hasDotDot(std::string_view path)
+{
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos)
+            end = path.size();
+        if (path.compare(start, end - start, "..") == 0 && end - start == 2)
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+bool isSafePath(std::string_view path)
+{
+    return !path.empty() && path[0] != '/' && !hasDotDot(path);
+}
+
+void checkEntryPath(const std::string &path)
+{
+    if (!isSafePath(path))
+        throw Exception("invalid path in package: " + path);
+}
+
+void checkLinkTarget(const std::string &target)
+{
+    if (!isSafePath(target))
+        throw Exception("invalid symlink target in package: " + target);
+}
+
+/** Pax values are decimal numbers, mtime may have a fraction that is ignored. */
+static uint64_t readPaxNumber(const std::string &value, bool fraction = false)
+{
+    errno = 0;
+    char *end;
+    unsigned long long number = strtoull(value.c_str(), &end, 10);
+    if (value.empty() || value[0] < '0' || value[0] > '9' || errno != 0 ||
+        (*end && !(fraction && *end == '.')))
+        throw Exception("invalid number in pax header: " + value);
+    return number;
+}
+
+/** Records of pax extended headers have the form "<length> <key>=<value>\n". */
+static void readPaxHeader(const uint8_t *data, uint64_t size, TarEntry &entry)
+{
+    const char *p = reinterpret_cast<const char *>(data);
+    const char *end = p + size;
+
+    while (p < end && *p) {
+        char *next;
+        unsigned long length = strtoul(p, &next, 10);
+        if (length == 0 || length > static_cast<size_t>(end - p) || *next != ' ')
+            throw Exception("invalid pax header");
+
+        std::string record(static_cast<const char *>(next) + 1, p + length - 1);
+        auto eq = record.find('=');
+        if (eq != std::string::npos) {
+            std::string key = record.substr(0, eq);
+            std::string value = record.substr(eq + 1);
+            if (key == "path")
+                entry.path = value;
+            else if (key == "linkpath")
+                entry.linkPath = value;
+            else if (key == "size")
+                entry.size = readPaxNumber(value);
+            else if (key == "mtime")
+                entry.mtime = static_cast<int64_t>(readPaxNumber(value, true));
+        }
+
+        p += length;
+    }
+}
+
+bool isTarArchive(const uint8_t *data, size_t size)
+{
+    return size >= TAR_BLOCKSIZE && memcmp(data + 257, "ustar", 5) == 0;
+}
+
+bool readTarEntries(const uint8_t *data, size_t size, std::vector<TarEntry> &entries)
+{
+    // values of pax or GNU long name headers that apply to the next entry
+    TarEntry ext{};
+    bool have_ext = false;
+
+    uint64_t pos = 0;
+    while (pos + TAR_BLOCKSIZE <= size) {
+        const uint8_t *header = data + pos;
+
+        if (std::all_of(header, header + TAR_BLOCKSIZE, [](uint8_t b) { return b == 0; }))
+            return true;
+
+        if (!checksumValid(header))
+            throw Exception("invalid tar header checksum");
+
+        uint64_t entry_size = readNumber(header + 124, 12);
+        uint64_t data_offset = pos + TAR_BLOCKSIZE;
+        uint64_t padded = paddedSize(entry_size, size - data_offset);
+
+        char typeflag = header[156];
+        pos = data_offset + padded;
+
+        if (typeflag == 'x') {
+            readPaxHeader(data + data_offset, entry_size, ext);
+            have_ext = true;
+            continue;
+        }
+        if (typeflag == 'L') {
+            ext.path = readString(data + data_offset, entry_size);
+            have_ext = true;
+            continue;
+        }
+        if (typeflag == 'g')
+            continue;
+
+        TarEntry entry;
+        std::string prefix = readString(header + 345, 155);
+        entry.path = readString(header, 100);
+        if (!prefix.empty())
+            entry.path = prefix + "/" + entry.path;
+        entry.linkPath = readString(header + 157, 100);
+        entry.mode = readNumber(header + 100, 8) & 07777;
+        entry.mtime = readNumber(header + 136, 12);
+        entry.size = entry_size;
+        entry.offset = data_offset;
+
+        if (have_ext) {
+            if (!ext.path.empty())
+                entry.path = ext.path;
+            if (!ext.linkPath.empty())
+                entry.linkPath = ext.linkPath;
+            if (ext.mtime)
+                entry.mtime = ext.mtime;
+            if (ext.size) {
+                entry.size = ext.size;
+                pos = data_offset + paddedSize(ext.size, size - data_offset);
+            }
+            ext = TarEntry{};
+            have_ext = false;
+        }
+
+        switch (typeflag) {
+        case '0':
+        case '\0':
+        case '7':
+            entry.type = TarEntry::Type::File;
+            break;
+        case '5':
+            entry.type = TarEntry::Type::Directory;
+            break;
+        case '2':
+            entry.type = TarEntry::Type::Symlink;
+            break;
+        default:
+            return false;
+        }
+
+        while (entry.path.size() > 1 && entry.path.back() == '/')
+            entry.path.pop_back();
+        checkEntryPath(entry.path);
+        if (entry.type == TarEntry::Type::Symlink)
+            checkLinkTarget(entry.linkPath);
+
+        entries.push_back(entry);
+    }
+
+    if (pos < size)
+        throw Exception("truncated tar archive");
+
+    return true;
+}
+
+} // namespace rose
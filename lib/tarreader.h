@@ -0,0 +1,66 @@
+/**
+ * @file tarreader.h
+ * @brief Reading the entry table of an uncompressed tar archive in place.
+ */
+#ifndef _TARREADER_H
+#define _TARREADER_H
+
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rose
+{
+
+struct TarEntry {
+    enum class Type { File, Directory, Symlink };
+
+    std::string path;
+    std::string linkPath;
+    Type type;
+    mode_t mode;
+    int64_t mtime;
+    uint64_t offset; // offset of the data in the archive
+    uint64_t size;
+};
+
+/**
+ * @brief A relative path without ".." components, which stays inside the directory it is
+ * joined to.
+ */
+bool isSafePath(std::string_view path);
+
+/**
+ * @brief Check that the path of an entry stays inside the destination directory.
+ * @throws Exception if the path is empty, absolute or has a ".." component
+ */
+void checkEntryPath(const std::string &path);
+
+/**
+ * @brief Check that a symlink target cannot lead out of the destination directory.
+ *
+ * Absolute targets and targets with ".." components are rejected, so later entries cannot be
+ * written through a symlink to a place outside the destination.
+ * @throws Exception if the target is not safe
+ */
+void checkLinkTarget(const std::string &target);
+
+/**
+ * @brief Check for the ustar magic of a tar archive.
+ */
+bool isTarArchive(const uint8_t *data, size_t size);
+
+/**
+ * @brief Read the headers of a ustar/pax archive without copying any file data.
+ * @param data The archive, typically mapped into memory.
+ * @param entries The entries of the archive.
+ * @return false if the archive contains entries of an unsupported type
+ */
+bool readTarEntries(const uint8_t *data, size_t size, std::vector<TarEntry> &entries);
+
+} // namespace rose
+
+#endif /* _TARREADER_H */
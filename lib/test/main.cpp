@@ -1,9 +1,93 @@
+#include <rps/exception.h>
+#include <rps/installer.h>
 #include <rps/manifest.h>
+#include <rps/manifestview.h>
+#include <rps/operation.h>
+#include <rps/package.h>
+#include <rps/packagedatabase.h>
+#include <rps/packagestore.h>
+#include <rps/resolver.h>
+#include <rps/stringarena.h>
+#include <rps/trace.h>
 #include <gtest/gtest.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <list>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
+
+static std::string readFile(const std::filesystem::path &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+/** Update the checksum of a ustar header at an offset of an archive. */
+static void setTarChecksum(std::string &tar, size_t header)
+{
+    unsigned int checksum = 0;
+    std::fill_n(&tar[header + 148], 8, ' ');
+    for (size_t i = header; i < header + 512; i++)
+        checksum += static_cast<unsigned char>(tar[i]);
+    snprintf(&tar[header + 148], 8, "%06o", checksum);
+}
+
+/** Append an entry to a ustar archive, type '0' is a file, '2' a symlink and 'x' pax data. */
+static void addTarEntry(std::string &tar, const std::string &name, char type,
+    const std::string &content = std::string(), const std::string &link = std::string())
+{
+    std::string header(512, '\0');
+    name.copy(&header[0], 100);
+    snprintf(&header[100], 8, "%07o", 0644u);
+    snprintf(&header[108], 8, "%07o", 0u);
+    snprintf(&header[116], 8, "%07o", 0u);
+    snprintf(&header[124], 12, "%011o", static_cast<unsigned int>(content.size()));
+    snprintf(&header[136], 12, "%011o", 0u);
+    header[156] = type;
+    link.copy(&header[157], 100);
+    memcpy(&header[257], "ustar\0" "00", 8);
+    setTarChecksum(header, 0);
+
+    tar += header + content;
+    tar.append((512 - content.size() % 512) % 512, '\0');
+}
+
+/** Creates a package source dir with a few files below prefix that span several blocks. */
+static rose::Manifest createPackageDir(
+    const std::filesystem::path &dir, const std::string &prefix = "usr/bin/")
+{
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "data" / prefix);
+
+    rose::Manifest m;
+    m.setPackageName("roundtrip");
+    m.setPackageVersion(3);
+    m.setTargetArch("armv7hf");
+
+    uint32_t seed = 42;
+    for (int i = 0; i < 3; i++) {
+        std::string name = prefix + "file" + std::to_string(i);
+        std::ofstream out(dir / "data" / name, std::ios::binary);
+        for (int j = 0; j < 1500000; j++) {
+            seed = seed * 1103515245 + 12345;
+            out.put('a' + (seed >> 16) % 8);
+        }
+        m.addFile(name);
+    }
+    m.writeManifestFile((dir / "manifest.json").string());
+
+    return m;
+}
 
 TEST(Manifest, ReadManifestFile)
 {
@@ -18,11 +102,1139 @@ TEST(Manifest, ReadManifestFile)
     EXPECT_EQ(m.apiTarget(), 27);
     EXPECT_EQ(m.apiMax(), 4096);
 
-    std::list<std::string> locales({"de:de", "en:us", "en:gb"});
+    std::vector<std::string> locales({"de:de", "en:us", "en:gb"});
     EXPECT_EQ(locales, m.locales());
 
-    // TODO
-    // EXPECT_EQ(m.dependencies().front().name, std::string("testb"));
+    ASSERT_EQ(m.dependencies().size(), 4);
+    EXPECT_EQ(m.dependencies().front().name, std::string("testb"));
+    EXPECT_EQ(m.dependencies().front().requires.size(), 3);
+    EXPECT_EQ(m.dependencies().back().conflicts.back().end, 5000);
+
+    ASSERT_EQ(m.files().size(), 5);
+    EXPECT_EQ(m.files().back().name(), "usr/lib/testlib");
+    EXPECT_FALSE(m.files().back().hasHash());
+
+    // the files can be replaced by themselves or a filtered copy of them
+    m.setFiles(m.files());
+    ASSERT_EQ(m.files().size(), 5);
+    EXPECT_EQ(m.files().back().name(), "usr/lib/testlib");
+    std::vector<rose::File> filtered(m.files().begin() + 3, m.files().end());
+    m.setFiles(filtered);
+    ASSERT_EQ(m.files().size(), 2);
+    EXPECT_EQ(m.files().back().name(), "usr/lib/testlib");
+
+    // the dependencies are written back
+    auto path = std::filesystem::temp_directory_path() / "rps-test-manifest.json";
+    m.writeManifestFile(path.string());
+    rose::Manifest written;
+    written.readFromFile(path.string());
+    std::filesystem::remove(path);
+    ASSERT_EQ(written.dependencies().size(), 4);
+    EXPECT_EQ(written.dependencies().front().requires.back().start, 146);
+    EXPECT_EQ(written.dependencies().back().conflicts.back().end, 5000);
+}
+
+TEST(Manifest, ReadFromBuffer)
+{
+    rose::Manifest m;
+    m.readFromBuffer(R"({"name": "esc\"aped", "version": -3, "files": [
+        {"type": "x", "name": "a\u00e9\ud83d\ude00\/b", "extra": [1.5e3, {"x": null}]}]})");
+    EXPECT_EQ(m.packageName(), "esc\"aped");
+    EXPECT_EQ(m.packageVersion(), -3);
+    ASSERT_EQ(m.files().size(), 1);
+    EXPECT_EQ(m.files().front().name(), "a\xc3\xa9\xf0\x9f\x98\x80/b");
+
+    for (auto invalid : {R"({"name": "a",})", R"({"name": "a" "version": 1})", R"({"name": "a"} x)",
+             R"({"unknown": 1})", R"({"version": 1.5})", R"({"name": "a)", R"([])",
+             R"({"files": [{"name": "../etc/passwd"}]})", R"({"files": [{"name": "/etc"}]})",
+             R"({"files": [{"name": "a", "mode": 65536}]})"}) {
+        rose::Manifest bad;
+        EXPECT_THROW(bad.readFromBuffer(invalid), const char *) << invalid;
+    }
+}
+
+TEST(Manifest, BinaryRoundtrip)
+{
+    rose::Manifest m;
+    m.readFromFile(TESTDATA_DIR "/testpackage/manifest.json");
+    m.files().front().setHash(rose::FileHash{1, 2, 3});
+    m.files().front().setMode(0755);
+    const std::string binary = m.toBinary();
+
+    rose::ManifestView view;
+    ASSERT_TRUE(view.open(binary.data(), binary.size()));
+    EXPECT_EQ(view.packageName(), "testpackage");
+    EXPECT_EQ(view.apiMax(), 4096);
+    ASSERT_EQ(view.localeCount(), 3);
+    EXPECT_EQ(view.locale(2), "en:gb");
+    ASSERT_EQ(view.dependencyCount(), 4);
+    EXPECT_EQ(view.dependencyName(0), "testb");
+    EXPECT_EQ(view.requiresCount(0), 3);
+    EXPECT_EQ(view.conflictsInterval(3, view.conflictsCount(3) - 1).end, 5000);
+
+    ASSERT_EQ(view.fileCount(), 5);
+    size_t i;
+    ASSERT_TRUE(view.findFile("usr/lib/testlib", i));
+    EXPECT_EQ(view.file(i).name(), "usr/lib/testlib");
+    EXPECT_FALSE(view.file(i).hasHash());
+    ASSERT_TRUE(view.findFile(m.files().front().name(), i));
+    EXPECT_EQ(view.file(i).hash(), m.files().front().hash());
+    EXPECT_EQ(view.file(i).mode(), 0755);
+    EXPECT_FALSE(view.findFile("usr/lib/missing", i));
+
+    // readFromBuffer() detects the format
+    rose::Manifest copy;
+    copy.readFromBuffer(binary);
+    EXPECT_EQ(copy.toBinary(), binary);
+    EXPECT_EQ(copy.dependencies().back().conflicts.back().end, 5000);
+    rose::Manifest from_json;
+    from_json.readFromBuffer(m.toJson());
+    EXPECT_EQ(from_json.files().front().mode(), 0755);
+
+    EXPECT_FALSE(view.open(binary.data(), binary.size() - 1));
+    std::string corrupt = binary;
+    corrupt[8] = 2;
+    EXPECT_FALSE(view.open(corrupt.data(), corrupt.size()));
+}
+
+TEST(StringArena, Move)
+{
+    rose::StringArena arena;
+    std::string_view first = arena.add("first");
+
+    // the moved arena keeps the views, the moved-from one allocates new blocks
+    rose::StringArena moved(std::move(arena));
+    std::string_view second = arena.add("second");
+    std::string_view third = moved.add("third");
+    EXPECT_EQ(first, "first");
+    EXPECT_EQ(second, "second");
+    EXPECT_EQ(third, "third");
+    EXPECT_EQ(arena.capacity(), rose::StringArena::BlockSize);
+    EXPECT_EQ(moved.capacity(), rose::StringArena::BlockSize);
+
+    rose::StringArena assigned;
+    assigned.add("assigned");
+    assigned = std::move(moved);
+    std::string_view fourth = moved.add("fourth");
+    std::string_view fifth = assigned.add("fifth");
+    arena.clear();
+    EXPECT_EQ(first, "first");
+    EXPECT_EQ(third, "third");
+    EXPECT_EQ(fourth, "fourth");
+    EXPECT_EQ(fifth, "fifth");
+    EXPECT_EQ(moved.capacity(), rose::StringArena::BlockSize);
+    EXPECT_EQ(assigned.capacity(), rose::StringArena::BlockSize);
+}
+
+TEST(Version, IntervalSet)
+{
+    rose::IntervalSet set{{10, 20}, {1, 3}, {4, 5}, {30, 29}, {18, 25}};
+    ASSERT_EQ(set.size(), 2);
+    EXPECT_EQ(set.front().end, 5);
+    EXPECT_EQ(set.back().start, 10);
+    EXPECT_EQ(set.back().end, 25);
+    EXPECT_TRUE(set.contains(4));
+    EXPECT_FALSE(set.contains(9));
+
+    EXPECT_EQ(set.complement().complement(), set);
+    EXPECT_EQ(set.complement().front().end, 0);
+    EXPECT_TRUE(set.intersect(set.complement()).empty());
+    EXPECT_EQ(set.unite(set.complement()), rose::IntervalSet({{INT32_MIN, INT32_MAX}}));
+
+    // compare with a bitmap, the sets are large enough for the SIMD and binary search paths
+    uint32_t seed = 1;
+    for (int round = 0; round < 50; round++) {
+        rose::IntervalSet a, b;
+        std::vector<bool> in_a(1000), in_b(1000);
+        for (int i = 0; i < round * 2; i++) {
+            seed = seed * 1103515245 + 12345;
+            int32_t start = (seed >> 8) % 1000, end = std::min(999, start + int32_t(seed % 7));
+            auto &set = i % 2 ? a : b;
+            auto &bits = i % 2 ? in_a : in_b;
+            set.add({start, end});
+            for (int32_t r = start; r <= end; r++)
+                bits[r] = true;
+        }
+        auto united = a.unite(b), intersected = a.intersect(b), complement = a.complement();
+        for (int32_t r = 0; r < 1000; r++) {
+            ASSERT_EQ(a.contains(r), in_a[r]) << r;
+            ASSERT_EQ(united.contains(r), in_a[r] || in_b[r]) << r;
+            ASSERT_EQ(intersected.contains(r), in_a[r] && in_b[r]) << r;
+            ASSERT_EQ(complement.contains(r), !in_a[r]) << r;
+        }
+    }
+}
+
+TEST(Package, ParallelPackRoundtrip)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-parallel";
+    auto m = createPackageDir(tmp / "src");
+    std::filesystem::create_directories(tmp / "out");
+
+    rose::Package pkg;
+    pkg.readPackageDir((tmp / "src").string());
+    pkg.setCompressionThreads(4);
+    pkg.writePackge(tmp / "out");
+
+    // writing again replaces the package and leaves no temporary files
+    ASSERT_NO_THROW(pkg.writePackge(tmp / "out"));
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(tmp / "out"),
+                  std::filesystem::directory_iterator()),
+        1);
+
+    rose::Package extracted;
+    extracted.extract((tmp / "out" / pkg.filename()).string(), tmp / "extracted");
+
+    for (auto &f : m.files())
+        EXPECT_EQ(
+            readFile(tmp / "src/data" / f.name()), readFile(tmp / "extracted/data" / f.name()));
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, CompressionCodecs)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-codecs";
+    auto m = createPackageDir(tmp / "src");
+
+    for (auto codec : {"none", "gzip", "xz", "zstd:19", "lz4"}) {
+        for (unsigned int threads : {1, 2}) {
+            std::filesystem::remove_all(tmp / "out");
+            std::filesystem::create_directories(tmp / "out");
+
+            rose::Package pkg;
+            pkg.readPackageDir((tmp / "src").string());
+            pkg.setCompression(rose::Compression::fromString(codec));
+            pkg.setCompressionThreads(threads);
+            pkg.writePackge(tmp / "out");
+
+            rose::Package extracted;
+            extracted.extract((tmp / "out" / pkg.filename()).string(), tmp / "out/extracted");
+
+            rose::Manifest em;
+            em.readFromFile((tmp / "out/extracted/manifest.json").string());
+            EXPECT_EQ(em.compression().toString(), codec);
+
+            for (auto &f : m.files())
+                EXPECT_EQ(readFile(tmp / "src/data" / f.name()),
+                    readFile(tmp / "out/extracted/data" / f.name()));
+        }
+    }
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, FileHashes)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-hashes";
+    std::filesystem::remove_all(tmp);
+    std::filesystem::create_directories(tmp / "src/data/etc");
+    std::filesystem::create_directories(tmp / "out");
+    std::filesystem::copy_file(
+        TESTDATA_DIR "/testpackage/data/etc/test.conf", tmp / "src/data/etc/test.conf");
+
+    rose::Manifest m;
+    m.setPackageName("hashes");
+    m.addFile("etc/test.conf");
+    m.writeManifestFile((tmp / "src/manifest.json").string());
+
+    rose::Package pkg;
+    pkg.readPackageDir((tmp / "src").string());
+    pkg.writePackge(tmp / "out");
+
+    rose::Package extracted;
+    extracted.extract((tmp / "out" / pkg.filename()).string(), tmp / "extracted");
+
+    rose::Manifest em;
+    em.readFromFile((tmp / "extracted/manifest.json").string());
+    ASSERT_EQ(em.files().size(), 1);
+    rose::FileHash expected{0x85, 0x44, 0xb1, 0x1a, 0x10, 0xa9, 0x7a, 0x05, 0xb8, 0x84,
+        0xc5, 0x47, 0x21, 0x79, 0x9e, 0x8d, 0x6b, 0xe1, 0x4c, 0x83, 0x4e, 0x10, 0x82, 0xf3, 0x22,
+        0xdd, 0xc8, 0x2b, 0xfe, 0x27, 0x28, 0x9c};
+    EXPECT_EQ(em.files().front().hash(), expected);
+
+    // a file of the manifest that cannot be read fails the package
+    m.addFile("etc/missing.conf");
+    m.writeManifestFile((tmp / "src/manifest.json").string());
+    rose::Package missing;
+    missing.readPackageDir((tmp / "src").string());
+    std::filesystem::create_directories(tmp / "missing");
+    EXPECT_THROW(missing.writePackge(tmp / "missing"), rose::Exception);
+    EXPECT_FALSE(std::filesystem::exists(tmp / "missing" / missing.filename()));
+
+    // a directory in place of the package file fails the rename
+    std::filesystem::create_directories(tmp / "busy" / pkg.filename() / "file");
+    EXPECT_THROW(pkg.writePackge(tmp / "busy"), rose::Exception);
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, VerifyingExtract)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-verify";
+    std::filesystem::remove_all(tmp);
+    std::filesystem::create_directories(tmp / "src/data/etc");
+    std::filesystem::create_directories(tmp / "src/data/usr/bin");
+    std::filesystem::create_directories(tmp / "out");
+    std::filesystem::copy_file(
+        TESTDATA_DIR "/testpackage/data/etc/test.conf", tmp / "src/data/etc/test.conf");
+    std::filesystem::copy_file(
+        TESTDATA_DIR "/testpackage/data/usr/bin/test-bin0", tmp / "src/data/usr/bin/test-bin0");
+
+    rose::Manifest m;
+    m.setPackageName("verify");
+    m.addFile("etc/test.conf");
+    m.addFile("usr/bin/test-bin0");
+    m.writeManifestFile((tmp / "src/manifest.json").string());
+
+    rose::Package pkg;
+    pkg.readPackageDir((tmp / "src").string());
+    pkg.setCompression(rose::Compression::fromString("none"));
+    pkg.writePackge(tmp / "out");
+    auto package_path = tmp / "out" / pkg.filename();
+
+    rose::Package good;
+    good.setVerifyHashes(true);
+    EXPECT_NO_THROW(good.extract(package_path.string(), tmp / "good"));
+    EXPECT_EQ(readFile(tmp / "good/data/etc/test.conf"), readFile(tmp / "src/data/etc/test.conf"));
+
+    // modify the content of test.conf inside the uncompressed package
+    std::string content = readFile(package_path);
+    auto pos = content.find("some configuration");
+    ASSERT_NE(pos, std::string::npos);
+    content[pos] = 'S';
+    std::ofstream(package_path, std::ios::binary | std::ios::trunc) << content;
+
+    rose::Package bad;
+    bad.setVerifyHashes(true);
+    EXPECT_THROW(bad.extract(package_path.string(), tmp / "bad"), rose::Exception);
+    EXPECT_FALSE(std::filesystem::exists(tmp / "bad/data/etc/test.conf"));
+    EXPECT_FALSE(std::filesystem::exists(tmp / "bad/data/etc/test.conf.rps-tmp"));
+    EXPECT_TRUE(std::filesystem::exists(tmp / "bad/data/usr/bin/test-bin0"));
+
+    // move test-bin0 out of data/ and update the checksum of its tar header
+    pkg.writePackge(tmp / "out");
+    content = readFile(package_path);
+    pos = content.find("data/usr/bin/test-bin0");
+    ASSERT_NE(pos, std::string::npos);
+    ASSERT_EQ(pos % 512, 0);
+    content[pos] = 'x';
+    std::fill_n(&content[pos + 148], 8, ' ');
+    unsigned int checksum = 0;
+    for (size_t i = pos; i < pos + 512; i++)
+        checksum += static_cast<unsigned char>(content[i]);
+    snprintf(&content[pos + 148], 8, "%06o", checksum);
+    std::ofstream(package_path, std::ios::binary | std::ios::trunc) << content;
+
+    rose::Package incomplete;
+    incomplete.setVerifyHashes(true);
+    EXPECT_THROW(incomplete.extract(package_path.string(), tmp / "incomplete"), rose::Exception);
+    EXPECT_FALSE(std::filesystem::exists(tmp / "incomplete/data/etc/test.conf"));
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, Signature)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-signature";
+    createPackageDir(tmp / "src");
+    std::filesystem::create_directories(tmp / "signed");
+    std::filesystem::create_directories(tmp / "unsigned");
+
+    rose::Package pkg;
+    pkg.readPackageDir((tmp / "src").string());
+    pkg.setCompression(rose::Compression::fromString("none"));
+    pkg.writePackge(tmp / "unsigned");
+    pkg.signPackage(TESTDATA_DIR "/ed25519-privkey.pem");
+    pkg.writePackge(tmp / "signed");
+    auto package_path = tmp / "signed" / pkg.filename();
+
+    rose::Package good;
+    good.readManifest(package_path.string());
+    EXPECT_NO_THROW(good.verify(TESTDATA_DIR "/ed25519-pubkey.pem"));
+    EXPECT_NO_THROW(good.extract(package_path.string(), tmp / "good"));
+    EXPECT_EQ(readFile(tmp / "good/data/usr/bin/file1"), readFile(tmp / "src/data/usr/bin/file1"));
+
+    // entries that are not in the signed manifest are rejected, the manifest of the package is
+    // replaced with the signed one
+    std::string entries;
+    for (auto name : {"manifest.bin", "signature", "data/usr/bin/file0", "data/usr/bin/file1",
+             "data/usr/bin/file2"})
+        addTarEntry(entries, name, '0', readFile(tmp / "good" / name));
+    std::vector<std::string> archives(3, entries);
+    addTarEntry(archives[0], "manifest.json", '0', "{}");
+    addTarEntry(archives[1], "data/usr/bin/link", '2', "", "file0");
+    addTarEntry(archives[2], "extra", '0', "content");
+    for (size_t i = 0; i < archives.size(); i++) {
+        archives[i].append(1024, '\0');
+        std::ofstream(tmp / "repacked.rps", std::ios::binary | std::ios::trunc) << archives[i];
+        for (bool stream : {false, true}) {
+            auto dest = tmp / ("repacked" + std::to_string(i) + (stream ? "s" : ""));
+            rose::Package repacked;
+            repacked.readManifest((tmp / "repacked.rps").string());
+            EXPECT_NO_THROW(repacked.verify(TESTDATA_DIR "/ed25519-pubkey.pem"));
+            rose::MemorySource source(archives[i].data(), archives[i].size());
+            auto extract = [&]() {
+                if (stream)
+                    repacked.extract(source, dest);
+                else
+                    repacked.extract((tmp / "repacked.rps").string(), dest);
+            };
+            if (i == 0) {
+                EXPECT_NO_THROW(extract());
+                rose::Manifest m;
+                EXPECT_NO_THROW(m.readFromFile((dest / "manifest.json").string()));
+                EXPECT_EQ(m.packageName(), "roundtrip");
+            } else {
+                EXPECT_THROW(extract(), rose::Exception);
+                EXPECT_FALSE(std::filesystem::exists(dest / "data/usr/bin/link"));
+                EXPECT_FALSE(std::filesystem::exists(dest / "extra"));
+            }
+        }
+    }
+
+    // the mode of the tar header is replaced with the signed one
+    std::string setuid = readFile(package_path);
+    size_t header = 0;
+    while (header < setuid.size() && setuid.compare(header, 19, "data/usr/bin/file1\0", 19) != 0)
+        header += 512;
+    ASSERT_LT(header, setuid.size());
+    snprintf(&setuid[header + 100], 8, "%07o", 04755u);
+    setTarChecksum(setuid, header);
+    std::ofstream(tmp / "setuid.rps", std::ios::binary | std::ios::trunc) << setuid;
+    for (bool stream : {false, true}) {
+        auto dest = tmp / (stream ? "setuid-stream" : "setuid");
+        rose::Package setuid_package;
+        setuid_package.readManifest((tmp / "setuid.rps").string());
+        EXPECT_NO_THROW(setuid_package.verify(TESTDATA_DIR "/ed25519-pubkey.pem"));
+        rose::MemorySource source(setuid.data(), setuid.size());
+        if (stream)
+            EXPECT_NO_THROW(setuid_package.extract(source, dest));
+        else
+            EXPECT_NO_THROW(setuid_package.extract((tmp / "setuid.rps").string(), dest));
+        EXPECT_EQ(std::filesystem::status(dest / "data/usr/bin/file1").permissions(),
+            std::filesystem::status(tmp / "src/data/usr/bin/file1").permissions());
+    }
+
+    rose::Package unsigned_package;
+    unsigned_package.readManifest((tmp / "unsigned" / pkg.filename()).string());
+    EXPECT_THROW(unsigned_package.verify(TESTDATA_DIR "/ed25519-pubkey.pem"), rose::Exception);
+
+    // a package signed with another key
+    pkg.signPackage(TESTDATA_DIR "/privkey.pem");
+    pkg.writePackge(tmp / "unsigned");
+    rose::Package other_key;
+    other_key.readManifest((tmp / "unsigned" / pkg.filename()).string());
+    EXPECT_THROW(other_key.verify(TESTDATA_DIR "/ed25519-pubkey.pem"), rose::Exception);
+
+    // modify file1 inside the uncompressed package, the signature still matches the manifest
+    std::string content = readFile(package_path);
+    auto pos = content.find(readFile(tmp / "src/data/usr/bin/file1").substr(1000, 64));
+    ASSERT_NE(pos, std::string::npos);
+    content[pos] = content[pos] == 'a' ? 'b' : 'a';
+    std::ofstream(package_path, std::ios::binary | std::ios::trunc) << content;
+
+    rose::Package bad;
+    bad.readManifest(package_path.string());
+    EXPECT_NO_THROW(bad.verify(TESTDATA_DIR "/ed25519-pubkey.pem"));
+    EXPECT_THROW(bad.extract(package_path.string(), tmp / "bad"), rose::Exception);
+    EXPECT_FALSE(std::filesystem::exists(tmp / "bad/data/usr/bin/file1"));
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, ParallelExtract)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-extract";
+    std::filesystem::remove_all(tmp);
+    std::filesystem::create_directories(tmp / "out");
+
+    // many small files in several directories
+    rose::Manifest m;
+    m.setPackageName("small");
+    for (int i = 0; i < 500; i++) {
+        std::string name = "usr/share/dir" + std::to_string(i % 7) + "/file" + std::to_string(i);
+        std::filesystem::create_directories((tmp / "src/data" / name).parent_path());
+        std::ofstream(tmp / "src/data" / name) << "content of " << name << std::string(i, 'x');
+        m.addFile(name);
+    }
+    m.writeManifestFile((tmp / "src/manifest.json").string());
+
+    for (auto codec : {"none", "zstd"}) {
+        rose::Package pkg;
+        pkg.readPackageDir((tmp / "src").string());
+        pkg.setCompression(rose::Compression::fromString(codec));
+        pkg.writePackge(tmp / "out");
+        auto package_path = (tmp / "out" / pkg.filename()).string();
+
+        for (unsigned int threads : {1u, 4u}) {
+            auto dest = tmp / (std::string(codec) + std::to_string(threads));
+            rose::Package extracted;
+            extracted.setExtractThreads(threads);
+            extracted.setVerifyHashes(true);
+            ASSERT_NO_THROW(extracted.extract(package_path, dest));
+            for (auto &f : m.files()) {
+                std::string name(f.name());
+                EXPECT_EQ(readFile(dest / "data" / name), readFile(tmp / "src/data" / name));
+            }
+        }
+    }
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, AsyncOperations)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-async";
+    createPackageDir(tmp / "src");
+    std::filesystem::create_directories(tmp / "out");
+
+    // each job runs on its own thread, joined at the end
+    std::vector<std::thread> threads;
+    rose::Executor executor = [&threads](std::function<void()> job) {
+        threads.emplace_back(std::move(job));
+    };
+
+    rose::Package pkg;
+    pkg.readPackageDir((tmp / "src").string());
+    pkg.setCompression(rose::Compression::fromString("zstd"));
+    std::vector<rose::Progress> reports;
+    auto packing = pkg.writePackageAsync(
+        tmp / "out", executor, [&reports](const rose::Progress &p) { reports.push_back(p); });
+    ASSERT_NO_THROW(packing->wait());
+    ASSERT_FALSE(reports.empty());
+    EXPECT_EQ(reports.back().entriesDone, 3);
+    EXPECT_EQ(reports.back().bytesDone, 3 * 1500000);
+    EXPECT_EQ(reports.back().bytesTotal, 3 * 1500000);
+    auto package_path = (tmp / "out" / pkg.filename()).string();
+
+    rose::Package extracted;
+    auto extracting = extracted.extractAsync(package_path, tmp / "extracted", executor);
+    extracting->future().wait();
+    ASSERT_NO_THROW(extracting->wait());
+    EXPECT_EQ(extracting->progress().bytesDone, std::filesystem::file_size(package_path));
+    EXPECT_EQ(readFile(tmp / "extracted/data/usr/bin/file2"),
+        readFile(tmp / "src/data/usr/bin/file2"));
+
+    // the second report, after the first file, cancels and the extracted files are removed
+    rose::Package cancelled;
+    std::promise<std::shared_ptr<rose::Operation>> handle;
+    auto operation_future = handle.get_future().share();
+    auto callback = [operation_future](const rose::Progress &p) {
+        if (p.entriesDone == 0)
+            std::this_thread::sleep_for(2 * rose::Operation::ProgressInterval);
+        else
+            operation_future.get()->cancel();
+    };
+    handle.set_value(
+        cancelled.extractAsync(package_path, tmp / "new/cancelled", executor, callback));
+    auto operation = operation_future.get();
+    EXPECT_THROW(operation->wait(), rose::OperationCancelled);
+    EXPECT_GE(operation->progress().entriesDone, 1);
+    EXPECT_FALSE(std::filesystem::exists(tmp / "new"));
+
+    for (auto &t : threads)
+        t.join();
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, StreamIO)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-stream";
+    createPackageDir(tmp / "src");
+
+    // a single thread writes through libarchive, more threads through the block compressor
+    for (unsigned int threads : {1u, 2u}) {
+        rose::Package pkg;
+        pkg.readPackageDir((tmp / "src").string());
+        pkg.setCompression(rose::Compression::fromString("zstd"));
+        pkg.setCompressionThreads(threads);
+        rose::MemorySink sink;
+        ASSERT_NO_THROW(pkg.writePackage(sink));
+
+        rose::MemorySource source(sink.data().data(), sink.data().size());
+        auto dest = tmp / ("memory" + std::to_string(threads));
+        rose::Package extracted;
+        extracted.setVerifyHashes(true);
+        ASSERT_NO_THROW(extracted.extract(source, dest));
+        EXPECT_EQ(readFile(dest / "data/usr/bin/file1"), readFile(tmp / "src/data/usr/bin/file1"));
+    }
+
+    // the package is extracted while it is written to a pipe
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    rose::Package pkg;
+    pkg.readPackageDir((tmp / "src").string());
+    std::thread writer([&pkg, &fds]() {
+        rose::FdSink sink(fds[1]);
+        pkg.writePackage(sink);
+        close(fds[1]);
+    });
+    rose::FdSource source(fds[0]);
+    rose::Package extracted;
+    extracted.setVerifyHashes(true);
+    EXPECT_NO_THROW(extracted.extract(source, tmp / "pipe"));
+    writer.join();
+    close(fds[0]);
+    EXPECT_EQ(readFile(tmp / "pipe/data/usr/bin/file2"), readFile(tmp / "src/data/usr/bin/file2"));
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, UnsafeEntries)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-unsafe";
+    std::filesystem::remove_all(tmp);
+    std::filesystem::create_directories(tmp / "outside");
+
+    // each archive tries to write to tmp/outside through its last entry
+    std::vector<std::string> archives(6);
+    addTarEntry(archives[0], "data/x", '2', "", (tmp / "outside").string());
+    addTarEntry(archives[0], "data/x/file", '0', "content");
+    addTarEntry(archives[1], "data/x", '2', "", "../../outside");
+    addTarEntry(archives[1], "data/x/file", '0', "content");
+    addTarEntry(archives[2], "data/../../outside/file", '0', "content");
+    addTarEntry(archives[3], "data/file", 'x', "14 size=12abc\n");
+    addTarEntry(archives[3], "data/file", '0', "content");
+
+    // sizes that wrap around past the end of the mapping
+    addTarEntry(archives[4], "data/file", '0', "content");
+    archives[4].replace(124, 12, "\x80\0\0\0\xff\xff\xff\xff\xff\xff\xfe\0", 12);
+    setTarChecksum(archives[4], 0);
+    addTarEntry(archives[5], "data/file", 'x', "29 size=18446744073709551104\n");
+    addTarEntry(archives[5], "data/file", '0', "content");
+
+    for (size_t i = 0; i < archives.size(); i++) {
+        std::string &tar = archives[i];
+        tar.append(1024, '\0');
+        auto package_path = tmp / ("unsafe" + std::to_string(i) + ".rps");
+        std::ofstream(package_path, std::ios::binary) << tar;
+
+        // the mapped and the streamed extraction check the entries, pax headers of the stream
+        // are parsed by libarchive
+        SCOPED_TRACE(i);
+        rose::Package mapped;
+        mapped.setVerifyHashes(i >= 4);
+        EXPECT_THROW(mapped.extract(package_path.string(), tmp / "dest/mapped"), rose::Exception);
+        rose::MemorySource source(tar.data(), tar.size());
+        rose::Package streamed;
+        if (i < 3) {
+            EXPECT_THROW(streamed.extract(source, tmp / "dest/streamed"), rose::Exception);
+        }
+        EXPECT_FALSE(std::filesystem::exists(tmp / "outside/file"));
+    }
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, ReadEntry)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-readentry";
+    auto m = createPackageDir(tmp / "src");
+
+    for (auto codec : {"none", "bzip2", "zstd", "xz"}) {
+        std::filesystem::remove_all(tmp / "out");
+        std::filesystem::create_directories(tmp / "out");
+
+        rose::Package pkg;
+        pkg.readPackageDir((tmp / "src").string());
+        pkg.setCompression(rose::Compression::fromString(codec));
+        pkg.writePackge(tmp / "out");
+        auto package_path = (tmp / "out" / pkg.filename()).string();
+
+        rose::Package p;
+        p.readManifest(package_path);
+        EXPECT_EQ(p.manifest().packageName(), "roundtrip");
+        EXPECT_EQ(p.manifest().files().size(), 3);
+
+        // file1 spans the boundary of the first and second block
+        EXPECT_EQ(rose::Package::readEntry(package_path, "data/usr/bin/file1"),
+            readFile(tmp / "src/data/usr/bin/file1"));
+        EXPECT_THROW(rose::Package::readEntry(package_path, "data/missing"), rose::Exception);
+
+        // entry sizes beyond the package in a corrupt index are rejected
+        if (std::string(codec) != "xz") {
+            std::string corrupt = readFile(package_path);
+            uint64_t index_size, block_count, entry_count;
+            memcpy(&index_size, &corrupt[corrupt.size() - 16], 8);
+            size_t header = corrupt.size() - 16 - index_size;
+            memcpy(&block_count, &corrupt[header + 16], 8);
+            memcpy(&entry_count, &corrupt[header + 24], 8);
+            for (uint64_t i = 0; i < entry_count; i++)
+                memset(&corrupt[header + 32 + block_count * 32 + i * 24 + 8], 0xff, 8);
+            std::ofstream(tmp / "out/corrupt.rps", std::ios::binary) << corrupt;
+            EXPECT_THROW(rose::Package::readEntry((tmp / "out/corrupt.rps").string(),
+                             "data/usr/bin/file1"),
+                rose::Exception);
+        }
+
+        rose::Package extracted;
+        extracted.extract(package_path, tmp / "out/extracted");
+        EXPECT_EQ(readFile(tmp / "out/extracted/data/usr/bin/file2"),
+            readFile(tmp / "src/data/usr/bin/file2"));
+    }
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, DeltaRoundtrip)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-delta";
+    std::filesystem::remove_all(tmp);
+    createPackageDir(tmp / "v3");
+    std::filesystem::create_directories(tmp / "out");
+    for (auto name : {"usr/bin/file0", "usr/bin/file1"})
+        std::filesystem::permissions(tmp / "v3/data" / name, std::filesystem::perms(0755));
+
+    // revision 4 renames file0, changes file1, removes file2 and adds file3
+    std::filesystem::copy(tmp / "v3", tmp / "v4", std::filesystem::copy_options::recursive);
+    std::filesystem::create_directories(tmp / "v4/data/usr/lib");
+    std::filesystem::rename(tmp / "v4/data/usr/bin/file0", tmp / "v4/data/usr/lib/file0");
+    std::filesystem::rename(tmp / "v4/data/usr/bin/file2", tmp / "v4/data/usr/bin/file3");
+    std::string file1 = readFile(tmp / "v4/data/usr/bin/file1");
+    file1.replace(1000, 10, "changed");
+    file1.insert(700000, "inserted");
+    std::ofstream(tmp / "v4/data/usr/bin/file1", std::ios::binary | std::ios::trunc) << file1;
+    std::string file3 = readFile(tmp / "v4/data/usr/bin/file3");
+    std::reverse(file3.begin(), file3.end());
+    std::ofstream(tmp / "v4/data/usr/bin/file3", std::ios::binary | std::ios::trunc) << file3;
+
+    rose::Manifest m;
+    m.readFromFile((tmp / "v4/manifest.json").string());
+    m.setPackageVersion(4);
+    m.files().clear();
+    for (auto name : {"usr/lib/file0", "usr/bin/file1", "usr/bin/file3"})
+        m.addFile(name);
+    m.writeManifestFile((tmp / "v4/manifest.json").string());
+
+    rose::Package v3, v4;
+    v3.readPackageDir((tmp / "v3").string());
+    v3.writePackge(tmp / "out");
+    v4.readPackageDir((tmp / "v4").string());
+    v4.writePackge(tmp / "out");
+
+    rose::Package base;
+    base.extract((tmp / "out" / v3.filename()).string(), tmp / "base");
+
+    rose::Package pkg;
+    pkg.readManifest((tmp / "out" / v4.filename()).string());
+    auto delta_path = pkg.writeDelta((tmp / "out" / v3.filename()).string(), tmp / "out");
+    EXPECT_EQ(delta_path.filename(), "roundtrip-4-armv7hf-from-3.rps");
+    EXPECT_LT(std::filesystem::file_size(delta_path),
+        std::filesystem::file_size(tmp / "out" / v4.filename()) / 2);
+    EXPECT_NO_THROW(rose::Package::readEntry(delta_path.string(), "delta/usr/bin/file1"));
+
+    rose::Package updated;
+    updated.applyDelta(delta_path.string(), tmp / "base", tmp / "updated");
+    EXPECT_EQ(updated.manifest().packageVersion(), 4);
+    for (auto &f : m.files()) {
+        EXPECT_EQ(readFile(tmp / "v4/data" / f.name()), readFile(tmp / "updated/data" / f.name()));
+        EXPECT_EQ(std::filesystem::status(tmp / "updated/data" / f.name()).permissions(),
+            std::filesystem::status(tmp / "v4/data" / f.name()).permissions());
+    }
+    EXPECT_FALSE(std::filesystem::exists(tmp / "updated/data/usr/bin/file2"));
+
+    // a modified base revision is detected
+    std::fstream base_file(
+        tmp / "base/data/usr/bin/file1", std::ios::binary | std::ios::in | std::ios::out);
+    base_file.seekp(500000);
+    base_file.put('X');
+    base_file.close();
+    rose::Package broken;
+    EXPECT_THROW(
+        broken.applyDelta(delta_path.string(), tmp / "base", tmp / "broken"), rose::Exception);
+    EXPECT_FALSE(std::filesystem::exists(tmp / "broken/data/usr/bin/file1"));
+
+    // names that lead out of the destination are rejected before anything is written
+    std::string evil;
+    addTarEntry(evil, "delta.json", '0', R"({"base-name": "roundtrip", "base-version": 3})");
+    addTarEntry(evil, "manifest.json", '0', readFile(tmp / "v4/manifest.json"));
+    addTarEntry(evil, "data/../../escape/file", '0', "content");
+    evil.append(1024, '\0');
+    std::ofstream(tmp / "evil.rps", std::ios::binary) << evil;
+    rose::Package escaping;
+    EXPECT_THROW(escaping.applyDelta((tmp / "evil.rps").string(), tmp / "base", tmp / "evil"),
+        rose::Exception);
+    EXPECT_FALSE(std::filesystem::exists(tmp / "escape"));
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Package, Upgrade)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-upgrade";
+    std::filesystem::remove_all(tmp);
+    createPackageDir(tmp / "v3");
+    std::filesystem::create_directories(tmp / "out");
+
+    // revision 4 changes file1 and moves file2 to file3
+    std::filesystem::copy(tmp / "v3", tmp / "v4", std::filesystem::copy_options::recursive);
+    std::ofstream(tmp / "v4/data/usr/bin/file1", std::ios::binary | std::ios::app) << "v4";
+    std::filesystem::rename(tmp / "v4/data/usr/bin/file2", tmp / "v4/data/usr/bin/file3");
+    rose::Manifest m;
+    m.readFromFile((tmp / "v4/manifest.json").string());
+    m.setPackageVersion(4);
+    m.files().pop_back();
+    m.addFile("usr/bin/file3");
+    m.writeManifestFile((tmp / "v4/manifest.json").string());
+
+    rose::Package v3, v4;
+    v3.readPackageDir((tmp / "v3").string());
+    v3.writePackge(tmp / "out");
+    v4.readPackageDir((tmp / "v4").string());
+    v4.writePackge(tmp / "out");
+
+    rose::Package installed;
+    installed.setVerifyHashes(true);
+    installed.extract((tmp / "out" / v3.filename()).string(), tmp / "installed");
+
+    rose::Package upgrade;
+    upgrade.setVerifyHashes(true);
+    EXPECT_EQ(upgrade.upgrade((tmp / "out" / v4.filename()).string(), tmp / "installed",
+                  tmp / "staged"),
+        1);
+    for (auto name : {"usr/bin/file0", "usr/bin/file1", "usr/bin/file3"})
+        EXPECT_EQ(readFile(tmp / "staged/data" / name), readFile(tmp / "v4/data" / name));
+    EXPECT_TRUE(std::filesystem::equivalent(
+        tmp / "staged/data/usr/bin/file0", tmp / "installed/data/usr/bin/file0"));
+    EXPECT_TRUE(std::filesystem::equivalent(
+        tmp / "staged/data/usr/bin/file3", tmp / "installed/data/usr/bin/file2"));
+    EXPECT_EQ(readFile(tmp / "installed/data/usr/bin/file1"),
+        readFile(tmp / "v3/data/usr/bin/file1"));
+    EXPECT_FALSE(std::filesystem::exists(tmp / "staged/data/usr/bin/file2"));
+
+    // revision 5 only changes the mode of file0, which is extracted instead of linked
+    std::filesystem::copy(tmp / "v4", tmp / "v5", std::filesystem::copy_options::recursive);
+    std::filesystem::permissions(tmp / "v5/data/usr/bin/file0",
+        std::filesystem::perms::owner_exec, std::filesystem::perm_options::add);
+    rose::Manifest m5;
+    m5.readFromFile((tmp / "v5/manifest.json").string());
+    m5.setPackageVersion(5);
+    m5.writeManifestFile((tmp / "v5/manifest.json").string());
+    rose::Package v5;
+    v5.readPackageDir((tmp / "v5").string());
+    v5.writePackge(tmp / "out");
+    std::filesystem::remove_all(tmp / "staged");
+    EXPECT_EQ(upgrade.upgrade((tmp / "out" / v5.filename()).string(), tmp / "installed",
+                  tmp / "staged"),
+        2);
+    EXPECT_FALSE(std::filesystem::equivalent(
+        tmp / "staged/data/usr/bin/file0", tmp / "installed/data/usr/bin/file0"));
+    EXPECT_EQ(std::filesystem::status(tmp / "staged/data/usr/bin/file0").permissions(),
+        std::filesystem::status(tmp / "v5/data/usr/bin/file0").permissions());
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Trace, ExtractPhases)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-trace";
+    createPackageDir(tmp / "src");
+    std::filesystem::create_directories(tmp / "out");
+
+    rose::Package pkg;
+    pkg.readPackageDir((tmp / "src").string());
+    pkg.setCompression(rose::Compression::fromString("zstd"));
+    pkg.writePackge(tmp / "out");
+
+    // nothing is recorded while tracing is disabled
+    rose::Trace::clear();
+    rose::Package().extract((tmp / "out" / pkg.filename()).string(), tmp / "untraced");
+    rose::Trace::write((tmp / "empty.json").string(), rose::Trace::Format::Json);
+    EXPECT_EQ(readFile(tmp / "empty.json").find("\"extract\""), std::string::npos);
+
+    rose::Trace::setEnabled(true);
+    rose::Package extracted;
+    extracted.setVerifyHashes(true);
+    extracted.extract((tmp / "out" / pkg.filename()).string(), tmp / "traced");
+    rose::Trace::setEnabled(false);
+
+    rose::Trace::write((tmp / "totals.json").string(), rose::Trace::Format::Json);
+    std::string totals = readFile(tmp / "totals.json");
+    for (auto phase : {"\"open\"", "\"header\"", "\"decompress\"", "\"write\"", "\"hash\""})
+        EXPECT_NE(totals.find(phase), std::string::npos) << phase;
+    EXPECT_NE(totals.find("\"bytes_per_second\""), std::string::npos);
+
+    rose::Trace::write((tmp / "trace.json").string(), rose::Trace::Format::Chrome);
+    std::string chrome = readFile(tmp / "trace.json");
+    EXPECT_EQ(chrome.compare(0, 15, "{\"traceEvents\":"), 0);
+    EXPECT_NE(chrome.find("\"ph\": \"X\""), std::string::npos);
+
+    rose::Trace::clear();
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(PackageStore, InstallRevisions)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-store";
+    std::filesystem::remove_all(tmp);
+    createPackageDir(tmp / "v3");
+    std::filesystem::create_directories(tmp / "out");
+
+    // revision 4 changes file1 and removes file2
+    std::filesystem::copy(tmp / "v3", tmp / "v4", std::filesystem::copy_options::recursive);
+    std::ofstream(tmp / "v4/data/usr/bin/file1", std::ios::binary | std::ios::app) << "v4";
+    rose::Manifest m;
+    m.readFromFile((tmp / "v4/manifest.json").string());
+    m.setPackageVersion(4);
+    m.files().pop_back();
+    m.writeManifestFile((tmp / "v4/manifest.json").string());
+
+    // file0 is executable in both revisions
+    for (auto dir : {"v3", "v4"})
+        std::filesystem::permissions(tmp / dir / "data/usr/bin/file0",
+            std::filesystem::perms::owner_exec, std::filesystem::perm_options::add);
+
+    rose::Package v3, v4;
+    v3.readPackageDir((tmp / "v3").string());
+    v3.setCompression(rose::Compression::fromString("xz"));
+    v3.writePackge(tmp / "out");
+    v4.readPackageDir((tmp / "v4").string());
+    v4.writePackge(tmp / "out");
+
+    rose::PackageStore store(tmp / "root");
+    auto dest = tmp / "root/opt/roundtrip";
+    EXPECT_EQ(store.install((tmp / "out" / v3.filename()).string(), dest), 3);
+    EXPECT_EQ(readFile(dest / "data/usr/bin/file2"), readFile(tmp / "v3/data/usr/bin/file2"));
+
+    // only the changed file is added
+    EXPECT_EQ(store.install((tmp / "out" / v4.filename()).string(), dest), 1);
+    for (auto name : {"usr/bin/file0", "usr/bin/file1"})
+        EXPECT_EQ(readFile(dest / "data" / name), readFile(tmp / "v4/data" / name));
+    EXPECT_FALSE(std::filesystem::exists(dest / "data/usr/bin/file2"));
+
+    rose::Manifest installed;
+    installed.readFromFile((dest / "manifest.json").string());
+    EXPECT_EQ(installed.packageVersion(), 4);
+    auto &file0 = installed.files().front();
+    auto source_perms = std::filesystem::status(tmp / "v4/data/usr/bin/file0").permissions();
+    EXPECT_EQ(file0.mode(), static_cast<uint32_t>(source_perms));
+    EXPECT_EQ(std::filesystem::status(dest / "data/usr/bin/file0").permissions(), source_perms);
+    EXPECT_TRUE(store.contains(file0.hash(), file0.mode()));
+    EXPECT_TRUE(std::filesystem::equivalent(
+        dest / "data" / file0.name(), store.objectPath(file0.hash(), file0.mode())));
+
+    // the objects of file1 and file2 of revision 3 are no longer used
+    EXPECT_EQ(store.collectGarbage(), 2);
+    EXPECT_EQ(store.install((tmp / "out" / v4.filename()).string(), dest), 0);
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Installer, Transactions)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-installer";
+    std::filesystem::remove_all(tmp);
+    createPackageDir(tmp / "v3");
+    std::filesystem::create_directories(tmp / "out");
+
+    std::filesystem::copy(tmp / "v3", tmp / "v4", std::filesystem::copy_options::recursive);
+    std::ofstream(tmp / "v4/data/usr/bin/file1", std::ios::binary | std::ios::app) << "v4";
+    rose::Manifest m;
+    m.readFromFile((tmp / "v4/manifest.json").string());
+    m.setPackageVersion(4);
+    m.files().pop_back();
+    m.writeManifestFile((tmp / "v4/manifest.json").string());
+
+    rose::Package v3, v4;
+    v3.readPackageDir((tmp / "v3").string());
+    v3.writePackge(tmp / "out");
+    v4.readPackageDir((tmp / "v4").string());
+    v4.writePackge(tmp / "out");
+    std::string v3_path = (tmp / "out" / v3.filename()).string();
+    std::string v4_path = (tmp / "out" / v4.filename()).string();
+
+    rose::Installer installer(tmp / "root");
+    auto dest = installer.path() / "roundtrip";
+    EXPECT_EQ(installer.install({v3_path}), 1);
+    EXPECT_EQ(installer.syncCount(), 2);
+    EXPECT_EQ(installer.installedRevision("roundtrip"), 3);
+    EXPECT_EQ(readFile(dest / "data/usr/bin/file2"), readFile(tmp / "v3/data/usr/bin/file2"));
+    EXPECT_EQ(installer.install({v3_path}), 0);
+
+    // a power loss after the commit leaves the switch to the recovery
+    installer.setCommitCallback([] { throw rose::Exception("power loss"); });
+    EXPECT_THROW(installer.install({v4_path}), rose::Exception);
+    EXPECT_EQ(installer.installedRevision("roundtrip"), 3);
+    installer.setCommitCallback(nullptr);
+    EXPECT_TRUE(installer.recover());
+    EXPECT_FALSE(installer.recover());
+    EXPECT_EQ(installer.installedRevision("roundtrip"), 4);
+    EXPECT_EQ(readFile(dest / "data/usr/bin/file1"), readFile(tmp / "v4/data/usr/bin/file1"));
+    EXPECT_FALSE(std::filesystem::exists(dest / "data/usr/bin/file2"));
+
+    // a failing package aborts the whole transaction
+    EXPECT_THROW(installer.install({v3_path, (tmp / "missing.rps").string()}), rose::Exception);
+    EXPECT_EQ(installer.installedRevision("roundtrip"), 4);
+
+    // a torn journal is discarded
+    std::ofstream(installer.path() / ".journal", std::ios::binary) << "rps-journal 1\ninst";
+    std::filesystem::create_directories(installer.path() / ".staging/1/roundtrip");
+    EXPECT_FALSE(installer.recover());
+    EXPECT_FALSE(std::filesystem::exists(installer.path() / ".staging"));
+
+    EXPECT_EQ(installer.remove({"roundtrip"}), 1);
+    EXPECT_EQ(installer.installedRevision("roundtrip"), 0);
+    EXPECT_FALSE(std::filesystem::exists(dest));
+    EXPECT_THROW(installer.remove({"roundtrip"}), rose::Exception);
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Installer, Pipeline)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-pipeline";
+    std::filesystem::remove_all(tmp);
+    std::filesystem::create_directories(tmp / "out");
+
+    std::vector<std::string> sources;
+    for (std::string name : {"a", "b", "c", "d"}) {
+        rose::Manifest m = createPackageDir(tmp / "src" / name, "usr/" + name + "/");
+        m.setPackageName(name);
+        m.writeManifestFile((tmp / "src" / name / "manifest.json").string());
+
+        rose::Package package;
+        package.readPackageDir((tmp / "src" / name).string());
+        package.writePackge(tmp / "out");
+        sources.push_back("file://" + (tmp / "out" / package.filename()).string());
+    }
+
+    // all packages are committed with the same two syncs
+    rose::Installer installer(tmp / "root");
+    EXPECT_EQ(installer.install({sources[0], sources[1], sources[2]}), 3);
+    EXPECT_EQ(installer.syncCount(), 2);
+    for (std::string name : {"a", "b", "c"})
+        EXPECT_EQ(readFile(installer.path() / name / "data/usr" / name / "file0"),
+            readFile(tmp / "src" / name / "data/usr" / name / "file0"));
+
+    rose::PackageDatabase database;
+    size_t i;
+    ASSERT_TRUE(database.open(installer.databasePath()));
+    EXPECT_EQ(database.packageCount(), 3);
+    ASSERT_TRUE(database.find("b", i));
+    EXPECT_EQ(database.package(i).revision, 3);
+    EXPECT_EQ(database.package(i).source, sources[1]);
+    EXPECT_EQ(database.package(i).manifest.fileCount(), 3);
+    EXPECT_FALSE(database.find("d", i));
+
+    EXPECT_THROW(installer.apply({{"d", 4, sources[3]}}), rose::Exception);
+    EXPECT_THROW(installer.install({sources[3], "http://packages/e-3.rps"}), rose::Exception);
+    EXPECT_EQ(installer.installedRevision("d"), 0);
+
+    EXPECT_EQ(installer.apply({{"a", 0, ""}, {"b", 0, ""}, {"d", 3, sources[3]}}), 3);
+    EXPECT_EQ(installer.installedRevision("a"), 0);
+    EXPECT_EQ(installer.installedRevision("b"), 0);
+    EXPECT_EQ(installer.installedRevision("c"), 3);
+    EXPECT_EQ(installer.installedRevision("d"), 3);
+
+    // packages installed without database are added to the first database
+    std::filesystem::remove(installer.databasePath());
+    EXPECT_EQ(installer.remove({"c"}), 1);
+    ASSERT_TRUE(database.open(installer.databasePath()));
+    ASSERT_EQ(database.packageCount(), 1);
+    EXPECT_EQ(database.package(0).name, "d");
+    EXPECT_EQ(database.package(0).manifest.packageVersion(), 3);
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(PackageDatabase, FileOwners)
+{
+    auto tmp = std::filesystem::temp_directory_path() / "rps-test-owners";
+    std::filesystem::remove_all(tmp);
+    std::filesystem::create_directories(tmp / "out");
+
+    // each package has its own files, except c which has the files of b
+    std::vector<std::string> sources;
+    for (std::string name : {"a", "b", "c"}) {
+        std::string prefix = "usr/" + (name == "c" ? std::string("b") : name) + "/";
+        rose::Manifest m = createPackageDir(tmp / "src" / name, prefix);
+        m.setPackageName(name);
+        m.writeManifestFile((tmp / "src" / name / "manifest.json").string());
+
+        rose::Package package;
+        package.readPackageDir((tmp / "src" / name).string());
+        package.writePackge(tmp / "out");
+        sources.push_back("file://" + (tmp / "out" / package.filename()).string());
+    }
+
+    rose::Installer installer(tmp / "root");
+    EXPECT_EQ(installer.install({sources[0], sources[1]}), 2);
+    rose::PackageDatabase database;
+    size_t i;
+    ASSERT_TRUE(database.open(installer.databasePath()));
+    ASSERT_TRUE(database.findOwner("usr/a/file2", i));
+    EXPECT_EQ(database.package(i).name, "a");
+    ASSERT_TRUE(database.findOwner("usr/b/file0", i));
+    EXPECT_EQ(database.package(i).name, "b");
+    EXPECT_FALSE(database.findOwner("usr/c/file0", i));
+
+    // a file belongs to one package, unless its owner is removed in the same transaction
+    EXPECT_THROW(installer.install({sources[2]}), rose::Exception);
+    EXPECT_EQ(installer.installedRevision("c"), 0);
+
+    // packages installed without database are checked as well
+    std::filesystem::remove(installer.databasePath());
+    EXPECT_THROW(installer.install({sources[2]}), rose::Exception);
+    EXPECT_EQ(installer.installedRevision("c"), 0);
+
+    EXPECT_EQ(installer.apply({{"b", 0, ""}, {"c", 3, sources[2]}}), 2);
+    ASSERT_TRUE(database.open(installer.databasePath()));
+    EXPECT_EQ(database.packageCount(), 2);
+    ASSERT_TRUE(database.findOwner("usr/b/file0", i));
+    EXPECT_EQ(database.package(i).name, "c");
+    ASSERT_TRUE(database.findOwner("usr/a/file0", i));
+    EXPECT_EQ(database.package(i).name, "a");
+
+    std::filesystem::remove_all(tmp);
+}
+
+TEST(Resolver, InstallOrder)
+{
+    rose::Repository repo;
+    repo.add("a", 1, {{"b", {{1, 1}}, {}}});
+    repo.add("a", 2, {{"b", {{2, 3}}, {}}, {"x", {}, {{1, 10}}}});
+    repo.add("b", 1, {});
+    repo.add("b", 2, {{"c", {{1, 100}}, {}}});
+    repo.add("b", 3, {{"c", {{1, 100}}, {}}, {"a", {}, {{2, 2}}}});
+    repo.add("c", 1, {}, "http://packages/c-1.rps");
+    repo.add("c", 2, {});
+    repo.add("x", 1, {});
+    repo.add("y", 1, {{"x", {{1, 1}}, {}}});
+
+    rose::Resolver resolver(repo);
+    resolver.setInstalled("c", 1);
+    resolver.setInstalled("x", 1);
+    resolver.setInstalled("y", 1);
+
+    // b 3 conflicts with a 2, x conflicts with a 2 and y depends on x
+    auto result = resolver.resolve({{"a", 2, ""}});
+    ASSERT_EQ(result.size(), 4);
+    EXPECT_EQ(result[0].name, "y");
+    EXPECT_EQ(result[0].revision, 0);
+    EXPECT_EQ(result[1].name, "x");
+    EXPECT_EQ(result[1].revision, 0);
+    EXPECT_EQ(result[2].name, "b");
+    EXPECT_EQ(result[2].revision, 2);
+    EXPECT_EQ(result[3].name, "a");
+    EXPECT_EQ(result[3].revision, 2);
+
+    // without c installed, a 1 only needs b 1 and b 2 pulls in c at its highest revision
+    resolver.setInstalled("c", 0);
+    result = resolver.resolve({{"a", 1, ""}});
+    ASSERT_EQ(result.size(), 2);
+    EXPECT_EQ(result[0].name, "b");
+    EXPECT_EQ(result[1].name, "a");
+
+    result = resolver.resolve({{"b", 2, ""}});
+    ASSERT_EQ(result.size(), 2);
+    EXPECT_EQ(result[0].name, "c");
+    EXPECT_EQ(result[0].revision, 2);
+    EXPECT_EQ(result[1].name, "b");
+
+    EXPECT_THROW(resolver.resolve({{"a", 2, ""}, {"b", 1, ""}}), rose::Exception);
+    EXPECT_THROW(resolver.resolve({{"a", 3, ""}}), rose::Exception);
+    EXPECT_THROW(resolver.resolve({{"a", 1, ""}, {"b", 0, ""}}), rose::Exception);
 }
 
 int main(int argc, char *argv[])
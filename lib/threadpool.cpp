@@ -0,0 +1,49 @@
+/**
+ * @file threadpool.cpp
+ */
+#include "threadpool.h"
+#include <algorithm>
+
+namespace rose
+{
+
+ThreadPool::ThreadPool(unsigned int threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < threads; i++)
+        mThreads.emplace_back(&ThreadPool::run, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+
+    for (auto &t : mThreads)
+        t.join();
+}
+
+unsigned int ThreadPool::size() const { return mThreads.size(); }
+
+void ThreadPool::run()
+{
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [this]() { return mStopping || !mQueue.empty(); });
+            if (mQueue.empty())
+                return;
+            job = std::move(mQueue.front());
+            mQueue.pop_front();
+        }
+        job();
+    }
+}
+
+} // namespace rose
@@ -0,0 +1,64 @@
+/**
+ * @file threadpool.h
+ * @brief A fixed size pool of worker threads.
+ */
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rose
+{
+
+class ThreadPool
+{
+  public:
+    /**
+     * @brief Start the worker threads.
+     * @param threads Number of workers, 0 selects one worker per hardware thread.
+     */
+    explicit ThreadPool(unsigned int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Queue a job for execution on one of the workers.
+     * @return A future for the result of the job.
+     */
+    template <typename F> auto submit(F &&job) -> std::future<decltype(job())>
+    {
+        auto task = std::make_shared<std::packaged_task<decltype(job())()>>(std::forward<F>(job));
+        auto result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQueue.emplace_back([task]() { (*task)(); });
+        }
+        mCondition.notify_one();
+        return result;
+    }
+
+    unsigned int size() const;
+
+  private:
+    void run();
+
+  private:
+    std::vector<std::thread> mThreads;
+    std::deque<std::function<void()>> mQueue;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping{false};
+};
+
+} // namespace rose
+
+#endif /* _THREADPOOL_H */
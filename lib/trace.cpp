@@ -0,0 +1,141 @@
+/**
+ * @file trace.cpp
+ */
+#include "tracespan.h"
+#include <rps/exception.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rose
+{
+
+namespace
+{
+
+struct TraceEvent {
+    const char *name;
+    int64_t start;
+    int64_t duration;
+    uint32_t thread;
+    uint64_t bytes;
+    uint64_t entries;
+};
+
+std::atomic<bool> gEnabled{false};
+std::atomic<int> gVerbosity{0};
+std::mutex gMutex;
+std::vector<TraceEvent> gEvents;
+const auto gEpoch = std::chrono::steady_clock::now();
+
+int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - gEpoch)
+        .count();
+}
+
+/** Small numbers for the threads in the order they record their first span. */
+uint32_t threadNumber()
+{
+    static std::atomic<uint32_t> next{0};
+    thread_local uint32_t number = next++;
+    return number;
+}
+
+void writeChrome(std::ofstream &out, const std::vector<TraceEvent> &events)
+{
+    out << "{\"traceEvents\": [";
+    for (size_t i = 0; i < events.size(); i++) {
+        auto &e = events[i];
+        out << (i ? ",\n" : "\n") << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1"
+            << ", \"tid\": " << e.thread << ", \"ts\": " << e.start / 1e3
+            << ", \"dur\": " << e.duration / 1e3 << ", \"args\": {\"bytes\": " << e.bytes
+            << ", \"entries\": " << e.entries << "}}";
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+void writeTotals(std::ofstream &out, const std::vector<TraceEvent> &events)
+{
+    struct Total {
+        uint64_t count = 0, bytes = 0, entries = 0;
+        int64_t duration = 0;
+    };
+    std::map<std::string, Total> totals;
+    for (auto &e : events) {
+        auto &t = totals[e.name];
+        t.count++;
+        t.duration += e.duration;
+        t.bytes += e.bytes;
+        t.entries += e.entries;
+    }
+
+    // the rates refer to the summed time of the spans, not to the wall clock time
+    out << "{\"phases\": {";
+    bool first = true;
+    for (auto &[name, t] : totals) {
+        double seconds = t.duration / 1e9;
+        out << (first ? "\n" : ",\n") << "    \"" << name << "\": {\"count\": " << t.count
+            << ", \"seconds\": " << seconds << ", \"bytes\": " << t.bytes
+            << ", \"entries\": " << t.entries
+            << ", \"bytes_per_second\": " << (seconds > 0 ? t.bytes / seconds : 0)
+            << ", \"entries_per_second\": " << (seconds > 0 ? t.entries / seconds : 0) << "}";
+        first = false;
+    }
+    out << "\n}}\n";
+}
+
+} // namespace
+
+void Trace::setEnabled(bool enabled) { gEnabled.store(enabled, std::memory_order_relaxed); }
+
+bool Trace::enabled() { return gEnabled.load(std::memory_order_relaxed); }
+
+void Trace::write(const std::string &path, Format format)
+{
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        events = gEvents;
+    }
+
+    std::ofstream out(path, std::ios::trunc);
+    out << std::fixed << std::setprecision(3);
+    if (format == Format::Chrome)
+        writeChrome(out, events);
+    else
+        writeTotals(out, events);
+    out.close();
+    if (!out)
+        throw Exception("cannot write trace: " + path);
+}
+
+void Trace::clear()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    gEvents.clear();
+}
+
+void Trace::setVerbosity(int level) { gVerbosity.store(level, std::memory_order_relaxed); }
+
+int Trace::verbosity() { return gVerbosity.load(std::memory_order_relaxed); }
+
+TraceSpan::TraceSpan(const char *name) : mName(name), mStart(Trace::enabled() ? now() : -1) {}
+
+TraceSpan::~TraceSpan()
+{
+    if (mStart < 0)
+        return;
+
+    TraceEvent event{mName, mStart, now() - mStart, threadNumber(), mBytes, mEntries};
+    std::lock_guard<std::mutex> lock(gMutex);
+    gEvents.push_back(event);
+}
+
+} // namespace rose
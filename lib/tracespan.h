@@ -0,0 +1,42 @@
+/**
+ * @file tracespan.h
+ * @brief Recording of the spans of Trace.
+ */
+#ifndef _TRACESPAN_H
+#define _TRACESPAN_H
+
+#include <rps/trace.h>
+#include <cstdint>
+
+namespace rose
+{
+
+/**
+ * A phase that is recorded from its construction to its destruction if Trace is enabled.
+ */
+class TraceSpan
+{
+  public:
+    /**
+     * @param name A string literal, it is kept until the trace is written.
+     */
+    explicit TraceSpan(const char *name);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    void addBytes(uint64_t bytes) { mBytes += bytes; }
+    void addEntries(uint64_t entries = 1) { mEntries += entries; }
+
+  private:
+    const char *mName;
+    /** Nanoseconds since the trace started, negative if the span is not recorded. */
+    int64_t mStart;
+    uint64_t mBytes{0};
+    uint64_t mEntries{0};
+};
+
+} // namespace rose
+
+#endif /* _TRACESPAN_H */
@@ -3,5 +3,152 @@
  */
 #include "rps/version.h"
 #include "rps/defines.h"
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// sets with more intervals use a binary search instead of comparing all intervals
+#define INTERVALSET_LINEAR_SEARCH_MAX 32
+
+namespace rose
+{
+
+IntervalSet::IntervalSet(std::initializer_list<VersionInterval> intervals)
+{
+    for (auto &i : intervals)
+        add(i);
+}
+
+void IntervalSet::add(const VersionInterval &interval)
+{
+    if (interval.start > interval.end)
+        return;
+
+    // the intervals overlapping or touching [start, end] are merged into one
+    int64_t start = interval.start, end = interval.end;
+    size_t first = std::lower_bound(mEnds.begin(), mEnds.end(), start - 1,
+                       [](int32_t e, int64_t v) { return e < v; }) -
+                   mEnds.begin();
+    size_t last = std::upper_bound(mStarts.begin(), mStarts.end(), end + 1,
+                      [](int64_t v, int32_t s) { return v < s; }) -
+                  mStarts.begin();
+    if (first < last) {
+        start = std::min<int64_t>(start, mStarts[first]);
+        end = std::max<int64_t>(end, mEnds[last - 1]);
+    }
+
+    mStarts.erase(mStarts.begin() + first, mStarts.begin() + last);
+    mEnds.erase(mEnds.begin() + first, mEnds.begin() + last);
+    mStarts.insert(mStarts.begin() + first, start);
+    mEnds.insert(mEnds.begin() + first, end);
+}
+
+void IntervalSet::append(int32_t start, int32_t end)
+{
+    if (!mEnds.empty() && int64_t(start) <= int64_t(mEnds.back()) + 1) {
+        mEnds.back() = std::max(mEnds.back(), end);
+        return;
+    }
+    mStarts.push_back(start);
+    mEnds.push_back(end);
+}
+
+bool IntervalSet::contains(int32_t revision) const
+{
+    const size_t count = mStarts.size();
+    if (count > INTERVALSET_LINEAR_SEARCH_MAX) {
+        auto it = std::upper_bound(mStarts.begin(), mStarts.end(), revision);
+        return it != mStarts.begin() && revision <= mEnds[it - mStarts.begin() - 1];
+    }
+
+    size_t i = 0;
+#ifdef __SSE2__
+    // four intervals per step, a lane is outside if start > revision or revision > end
+    const __m128i r = _mm_set1_epi32(revision);
+    for (; i + 4 <= count; i += 4) {
+        __m128i starts = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&mStarts[i]));
+        __m128i ends = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&mEnds[i]));
+        __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(starts, r), _mm_cmpgt_epi32(r, ends));
+        if (_mm_movemask_epi8(outside) != 0xffff)
+            return true;
+    }
+#endif
+    for (; i < count; i++)
+        if (mStarts[i] <= revision && revision <= mEnds[i])
+            return true;
+
+    return false;
+}
+
+bool IntervalSet::empty() const { return mStarts.empty(); }
+
+size_t IntervalSet::size() const { return mStarts.size(); }
+
+VersionInterval IntervalSet::operator[](size_t i) const { return {mStarts[i], mEnds[i]}; }
+
+VersionInterval IntervalSet::front() const { return (*this)[0]; }
+
+VersionInterval IntervalSet::back() const { return (*this)[size() - 1]; }
+
+IntervalSet::const_iterator IntervalSet::begin() const { return const_iterator(this, 0); }
+
+IntervalSet::const_iterator IntervalSet::end() const { return const_iterator(this, size()); }
+
+IntervalSet IntervalSet::unite(const IntervalSet &other) const
+{
+    IntervalSet result;
+    size_t i = 0, j = 0;
+    while (i < size() || j < other.size()) {
+        if (j == other.size() || (i < size() && mStarts[i] < other.mStarts[j])) {
+            result.append(mStarts[i], mEnds[i]);
+            i++;
+        } else {
+            result.append(other.mStarts[j], other.mEnds[j]);
+            j++;
+        }
+    }
+    return result;
+}
+
+IntervalSet IntervalSet::intersect(const IntervalSet &other) const
+{
+    IntervalSet result;
+    size_t i = 0, j = 0;
+    while (i < size() && j < other.size()) {
+        int32_t start = std::max(mStarts[i], other.mStarts[j]);
+        int32_t end = std::min(mEnds[i], other.mEnds[j]);
+        if (start <= end)
+            result.append(start, end);
+        if (mEnds[i] < other.mEnds[j])
+            i++;
+        else
+            j++;
+    }
+    return result;
+}
+
+IntervalSet IntervalSet::complement() const
+{
+    IntervalSet result;
+    int64_t next = INT32_MIN;
+    for (size_t i = 0; i < size(); i++) {
+        if (mStarts[i] > next)
+            result.append(next, mStarts[i] - 1);
+        next = int64_t(mEnds[i]) + 1;
+    }
+    if (next <= INT32_MAX)
+        result.append(next, INT32_MAX);
+    return result;
+}
+
+bool IntervalSet::operator==(const IntervalSet &other) const
+{
+    return mStarts == other.mStarts && mEnds == other.mEnds;
+}
+
+bool IntervalSet::operator!=(const IntervalSet &other) const { return !(*this == other); }
+
+} // namespace rose
@@ -1,11 +1,60 @@
 #include "command.h"
+#include <rps/trace.h>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 
 namespace rose
 {
 namespace Tools
 {
 
+static std::string gTracePath;
+static Trace::Format gTraceFormat = Trace::Format::Chrome;
+
 Command::Command() {}
 
+void Command::parseGlobalOptions(std::vector<std::string> &arguments)
+{
+    while (arguments.size() > 1 && arguments[1].compare(0, 1, "-") == 0) {
+        std::string option = arguments[1];
+        arguments.erase(arguments.begin() + 1);
+
+        if (option == "-v" || option == "-vv") {
+            Trace::setVerbosity(option.size() - 1);
+        } else if (option == "--trace" && arguments.size() > 1) {
+            gTracePath = arguments[1];
+            arguments.erase(arguments.begin() + 1);
+            Trace::setEnabled(true);
+        } else if (option == "--trace-format" && arguments.size() > 1) {
+            if (arguments[1] == "json")
+                gTraceFormat = Trace::Format::Json;
+            else if (arguments[1] == "chrome")
+                gTraceFormat = Trace::Format::Chrome;
+            else
+                throw "unknown trace format";
+            arguments.erase(arguments.begin() + 1);
+        } else {
+            throw "unknown option";
+        }
+    }
+}
+
+unsigned int Command::parseNumber(const std::string &value)
+{
+    char *end;
+    errno = 0;
+    unsigned long number = strtoul(value.c_str(), &end, 10);
+    if (value.empty() || value[0] == '-' || *end != '\0' || errno != 0 || number > UINT_MAX)
+        throw "invalid number";
+    return static_cast<unsigned int>(number);
+}
+
+void Command::writeTrace()
+{
+    if (!gTracePath.empty())
+        Trace::write(gTracePath, gTraceFormat);
+}
+
 } // namespace Tools
 } // namespace rose
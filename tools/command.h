@@ -27,6 +27,27 @@ class Command
     };
 
     virtual void execute(std::vector<std::string> &arguments) = 0;
+
+    /**
+     * @brief Apply and remove the options in front of the command.
+     *
+     * -v prints a message per operation, -vv also one per entry. --trace FILE records the phases
+     * of the command, see rose::Trace, --trace-format chrome|json selects the format of FILE.
+     * @param arguments The arguments of main() including the program name.
+     */
+    static void parseGlobalOptions(std::vector<std::string> &arguments);
+
+    /**
+     * @brief Write the trace requested with --trace.
+     */
+    static void writeTrace();
+
+  protected:
+    /**
+     * @brief Parse the value of a numeric option like -j.
+     * @throws const char* if the value is not a non-negative number
+     */
+    static unsigned int parseNumber(const std::string &value);
 };
 
 } // namespace Tools
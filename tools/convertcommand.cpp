@@ -0,0 +1,61 @@
+#include "convertcommand.h"
+#include <rps/manifest.h>
+#include <iostream>
+#include <string>
+
+namespace rose
+{
+namespace Tools
+{
+
+ConvertCommand::ConvertCommand() {}
+
+void ConvertCommand::execute(std::vector<std::string> &arguments)
+{
+    // parse command line
+
+    std::string in_path, out_path, type = "binary";
+
+    for (std::vector<std::string>::iterator it = arguments.begin(); arguments.end() - it >= 1;
+         it += 2) {
+        // each option is followed by its value
+        if (arguments.end() - it < 2)
+            throw "option without value";
+        if (*it == std::string("-f")) {
+            in_path = *(it + 1);
+            continue;
+        }
+
+        if (*it == std::string("-o")) {
+            out_path = *(it + 1);
+            continue;
+        }
+
+        if (*it == std::string("-t")) {
+            type = *(it + 1);
+            continue;
+        }
+    }
+
+    if (in_path.empty() || out_path.empty())
+        throw "input or output manifest is not set";
+
+    Manifest::Format format;
+    if (type == "json")
+        format = Manifest::Format::Json;
+    else if (type == "binary")
+        format = Manifest::Format::Binary;
+    else
+        throw "unknown manifest type";
+
+    // the input format is detected from the content
+
+    rose::Manifest manifest;
+    manifest.readFromFile(in_path);
+    manifest.writeManifestFile(out_path, format);
+
+    std::cout << "created " << out_path << std::endl;
+}
+
+} // namespace Tools
+} // namespace rose
@@ -0,0 +1,22 @@
+#ifndef RPS_TOOLS_CONVERTCOMMAND_H
+#define RPS_TOOLS_CONVERTCOMMAND_H
+
+#include "command.h"
+
+namespace rose
+{
+namespace Tools
+{
+
+class ConvertCommand : public Command
+{
+  public:
+    ConvertCommand();
+
+    virtual void execute(std::vector<std::string> &arguments);
+};
+
+} // namespace Tools
+} // namespace rose
+
+#endif // RPS_TOOLS_CONVERTCOMMAND_H
@@ -19,9 +19,14 @@ void CreateCommand::execute(std::vector<std::string> &arguments)
     // parse command line
 
     std::string package_name, source_dir, out_dir;
+    unsigned int threads = 1;
+    std::string compression, key;
 
     for (std::vector<std::string>::iterator it = arguments.begin(); arguments.end() - it >= 1;
          it += 2) {
+        // each option is followed by its value
+        if (arguments.end() - it < 2)
+            throw "option without value";
         if (*it == std::string("-d")) {
             std::string path(*(it + 1));
 
@@ -35,6 +40,21 @@ void CreateCommand::execute(std::vector<std::string> &arguments)
             out_dir = *(it + 1);
             continue;
         }
+
+        if (*it == std::string("-c")) {
+            compression = *(it + 1);
+            continue;
+        }
+
+        if (*it == std::string("-k")) {
+            key = *(it + 1);
+            continue;
+        }
+
+        if (*it == std::string("-j")) {
+            threads = parseNumber(*(it + 1));
+            continue;
+        }
     }
 
     if (source_dir.empty() || package_name.empty())
@@ -50,8 +70,12 @@ void CreateCommand::execute(std::vector<std::string> &arguments)
 
     rose::Package pkg;
     pkg.readPackageDir(source_dir + "/" + package_name);
+    pkg.setCompressionThreads(threads);
+    if (!compression.empty())
+        pkg.setCompression(Compression::fromString(compression));
 
-    //    pkg.signPackage();
+    if (!key.empty())
+        pkg.signPackage(key);
 
     pkg.writePackge(out_dir);
 }
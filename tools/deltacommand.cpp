@@ -0,0 +1,62 @@
+#include "deltacommand.h"
+#include <rps/package.h>
+#include <iostream>
+#include <string>
+
+namespace rose
+{
+namespace Tools
+{
+
+DeltaCommand::DeltaCommand() {}
+
+void DeltaCommand::execute(std::vector<std::string> &arguments)
+{
+    // parse command line
+
+    std::string base_path, package_path, out_dir;
+    unsigned int threads = 1;
+
+    for (std::vector<std::string>::iterator it = arguments.begin(); arguments.end() - it >= 1;
+         it += 2) {
+        // each option is followed by its value
+        if (arguments.end() - it < 2)
+            throw "option without value";
+        if (*it == std::string("-b")) {
+            base_path = *(it + 1);
+            continue;
+        }
+
+        if (*it == std::string("-f")) {
+            package_path = *(it + 1);
+            continue;
+        }
+
+        if (*it == std::string("-o")) {
+            out_dir = *(it + 1);
+            continue;
+        }
+
+        if (*it == std::string("-j")) {
+            threads = parseNumber(*(it + 1));
+            continue;
+        }
+    }
+
+    if (base_path.empty() || package_path.empty())
+        throw "base or package is not set";
+
+    if (out_dir.empty())
+        out_dir = ".";
+
+    // write the delta package
+
+    rose::Package pkg;
+    pkg.readManifest(package_path);
+    pkg.setCompressionThreads(threads);
+
+    std::cout << "created " << pkg.writeDelta(base_path, out_dir).string() << std::endl;
+}
+
+} // namespace Tools
+} // namespace rose
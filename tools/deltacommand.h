@@ -0,0 +1,22 @@
+#ifndef RPS_TOOLS_DELTACOMMAND_H
+#define RPS_TOOLS_DELTACOMMAND_H
+
+#include "command.h"
+
+namespace rose
+{
+namespace Tools
+{
+
+class DeltaCommand : public Command
+{
+  public:
+    DeltaCommand();
+
+    virtual void execute(std::vector<std::string> &arguments);
+};
+
+} // namespace Tools
+} // namespace rose
+
+#endif // RPS_TOOLS_DELTACOMMAND_H
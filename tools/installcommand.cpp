@@ -1,4 +1,7 @@
 #include "installcommand.h"
+#include <rps/installer.h>
+#include <iostream>
+#include <string>
 
 namespace rose
 {
@@ -7,7 +10,40 @@ namespace Tools
 
 InstallCommand::InstallCommand() {}
 
-void InstallCommand::execute(std::vector<std::string> &arguments) {}
+void InstallCommand::execute(std::vector<std::string> &arguments)
+{
+    // parse command line
+
+    std::string root = "/", key;
+    std::vector<std::string> package_paths;
+
+    for (std::vector<std::string>::iterator it = arguments.begin(); it != arguments.end(); it++) {
+
+        if (*it == std::string("-r") && arguments.end() - it >= 2) {
+            root = *(++it);
+            continue;
+        }
+
+        if (*it == std::string("-k") && arguments.end() - it >= 2) {
+            key = *(++it);
+            continue;
+        }
+
+        package_paths.push_back(*it);
+    }
+
+    // without packages only an interrupted transaction is completed
+    Installer installer(root);
+    installer.setPublicKey(key);
+    if (package_paths.empty()) {
+        if (installer.recover())
+            std::cout << "completed interrupted transaction" << std::endl;
+        return;
+    }
+
+    size_t installed = installer.install(package_paths);
+    std::cout << "installed " << installed << " packages" << std::endl;
+}
 
 } // namespace Tools
 } // namespace rose
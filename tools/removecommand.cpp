@@ -0,0 +1,39 @@
+#include "removecommand.h"
+#include <rps/installer.h>
+#include <iostream>
+#include <string>
+
+namespace rose
+{
+namespace Tools
+{
+
+RemoveCommand::RemoveCommand() {}
+
+void RemoveCommand::execute(std::vector<std::string> &arguments)
+{
+    // parse command line
+
+    std::string root = "/";
+    std::vector<std::string> names;
+
+    for (std::vector<std::string>::iterator it = arguments.begin(); it != arguments.end(); it++) {
+
+        if (*it == std::string("-r") && arguments.end() - it >= 2) {
+            root = *(++it);
+            continue;
+        }
+
+        names.push_back(*it);
+    }
+
+    if (names.empty())
+        throw "no package to remove";
+
+    Installer installer(root);
+    size_t removed = installer.remove(names);
+    std::cout << "removed " << removed << " packages" << std::endl;
+}
+
+} // namespace Tools
+} // namespace rose
@@ -0,0 +1,22 @@
+#ifndef RPS_TOOLS_REMOVECOMMAND_H
+#define RPS_TOOLS_REMOVECOMMAND_H
+
+#include "command.h"
+
+namespace rose
+{
+namespace Tools
+{
+
+class RemoveCommand : public rose::Tools::Command
+{
+  public:
+    RemoveCommand();
+
+    virtual void execute(std::vector<std::string> &arguments);
+};
+
+} // namespace Tools
+} // namespace rose
+
+#endif // RPS_TOOLS_REMOVECOMMAND_H
@@ -1,5 +1,8 @@
 #include "command.h"
 #include "installcommand.h"
+#include "removecommand.h"
+#include "statuscommand.h"
+#include <rps/exception.h>
 #include <algorithm>
 #include <cstdlib>
 #include <iostream>
@@ -10,10 +13,11 @@
 void show_usage()
 {
     fprintf(stderr, "usage: \n"
-                    "  rps-client status\n"
-                    "  rps-client install [PACKAGE ...]\n"
-                    "  rps-client remove [PACKAGE ...]\n"
-                    "  rps-client get-release RELEASE\n"
+                    "  rps-client [-v|-vv] [--trace FILE [--trace-format chrome|json]]\n"
+                    "             COMMAND ...\n"
+                    "  rps-client status [-r ROOT] [PACKAGE ...]\n"
+                    "  rps-client install [-r ROOT] [-k PUBLIC_KEY] [PACKAGE ...]\n"
+                    "  rps-client remove [-r ROOT] PACKAGE ...\n"
                     "  rps-client help\n"
                     "  rps-client version\n");
 }
@@ -36,14 +40,18 @@ int main(int argc, char *argv[])
     std::unique_ptr<rose::Tools::Command> cmd;
 
     try {
+        rose::Tools::Command::parseGlobalOptions(arguments);
+        if (arguments.size() < 2) {
+            show_usage();
+            return EXIT_FAILURE;
+        }
+
         if (arguments[1] == std::string("status")) {
-            // cmd = std::make_unique<RPS::Tools::StatusCommand>();
+            cmd = std::make_unique<rose::Tools::StatusCommand>();
         } else if (arguments[1] == std::string("install")) {
             cmd = std::make_unique<rose::Tools::InstallCommand>();
         } else if (arguments[1] == std::string("remove")) {
-            // cmd = std::make_unique<RPS::Tools::StatusCommand>();
-        } else if (arguments[1] == std::string("get-release")) {
-            // cmd = std::make_unique<RPS::Tools::GetReleaseCommand>();
+            cmd = std::make_unique<rose::Tools::RemoveCommand>();
         } else if (arguments[1] == std::string("help")) {
             show_usage();
             return 0;
@@ -60,9 +68,14 @@ int main(int argc, char *argv[])
         arguments.erase(arguments.begin());
 
         cmd->execute(arguments);
+        rose::Tools::Command::writeTrace();
     } catch (const char *str) {
         std::cerr << "Error: " << str << std::endl;
         return 1;
+    } catch (const std::exception &e) {
+        // rose::Exception and errors of the standard library, e.g. std::filesystem
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
 
     return 0;
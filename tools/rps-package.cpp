@@ -1,5 +1,7 @@
 #include "command.h"
+#include "convertcommand.h"
 #include "createcommand.h"
+#include "deltacommand.h"
 #include "unpackcommand.h"
 #include <rps/exception.h>
 #include <iostream>
@@ -7,8 +9,15 @@
 void show_usage()
 {
     fprintf(stderr, "usage: \n"
-                    "  rps-package create -d DIRECTORY [-o OUTPUT]\n"
+                    "  rps-package [-v|-vv] [--trace FILE [--trace-format chrome|json]]\n"
+                    "              COMMAND ...\n"
+                    "  rps-package create -d DIRECTORY [-o OUTPUT] [-c CODEC[:LEVEL]]\n"
+                    "                     [-j THREADS] [-k PRIVATE_KEY]\n"
+                    "    CODEC: none, bzip2, gzip, xz, zstd, lz4\n"
+                    "  rps-package convert -f MANIFEST -o OUTPUT [-t json|binary]\n"
+                    "  rps-package delta -b BASE_PACKAGE -f PACKAGE [-o OUTPUT] [-j THREADS]\n"
                     "  rps-package unpack -f PACKAGE\n"
+                    "  rps-package unpack -f DELTA_PACKAGE -b BASE_DIRECTORY -o OUTPUT\n"
                     "  rps-package help\n"
                     "  rps-package version\n");
 }
@@ -34,8 +43,18 @@ int main(int argc, char *argv[])
     std::unique_ptr<rose::Tools::Command> cmd;
 
     try {
+        rose::Tools::Command::parseGlobalOptions(arguments);
+        if (arguments.size() < 2) {
+            show_usage();
+            return EXIT_FAILURE;
+        }
+
         if (arguments[1] == std::string("create")) {
             cmd = std::make_unique<rose::Tools::CreateCommand>();
+        } else if (arguments[1] == std::string("convert")) {
+            cmd = std::make_unique<rose::Tools::ConvertCommand>();
+        } else if (arguments[1] == std::string("delta")) {
+            cmd = std::make_unique<rose::Tools::DeltaCommand>();
         } else if (arguments[1] == std::string("unpack")) {
             cmd = std::make_unique<rose::Tools::UnpackCommand>();
         } else if (arguments[1] == std::string("help")) {
@@ -54,11 +73,14 @@ int main(int argc, char *argv[])
         arguments.erase(arguments.begin());
 
         cmd->execute(arguments);
+        rose::Tools::Command::writeTrace();
     } catch (const char *str) {
         std::cerr << "Error: " << str << std::endl;
         return EXIT_FAILURE;
-    } catch (rose::Exception e) {
+    } catch (const std::exception &e) {
+        // rose::Exception and errors of the standard library, e.g. std::filesystem
         std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
     }
 
     return 0;
@@ -0,0 +1,67 @@
+#include "statuscommand.h"
+#include <rps/installer.h>
+#include <rps/packagedatabase.h>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+namespace rose
+{
+namespace Tools
+{
+
+StatusCommand::StatusCommand() {}
+
+void StatusCommand::execute(std::vector<std::string> &arguments)
+{
+    // parse command line
+
+    std::string root = "/";
+    std::vector<std::string> names;
+
+    for (std::vector<std::string>::iterator it = arguments.begin(); it != arguments.end(); it++) {
+
+        if (*it == std::string("-r") && arguments.end() - it >= 2) {
+            root = *(++it);
+            continue;
+        }
+
+        names.push_back(*it);
+    }
+
+    Installer installer(root);
+    PackageDatabase database;
+    if (!database.open(installer.databasePath())) {
+        std::cout << "no packages installed" << std::endl;
+        return;
+    }
+
+    // without names all packages are listed
+    if (names.empty()) {
+        for (size_t i = 0; i < database.packageCount(); i++) {
+            InstalledPackage p = database.package(i);
+            std::cout << p.name << " " << p.revision << std::endl;
+        }
+        return;
+    }
+
+    for (auto &name : names) {
+        size_t i;
+        if (!database.find(name, i))
+            throw "package is not installed";
+
+        InstalledPackage p = database.package(i);
+        time_t time = p.installTime;
+        char installed[32];
+        strftime(installed, sizeof(installed), "%Y-%m-%d %H:%M:%S", gmtime(&time));
+
+        std::cout << "name:      " << p.name << std::endl
+                  << "revision:  " << p.revision << std::endl
+                  << "source:    " << p.source << std::endl
+                  << "installed: " << installed << std::endl
+                  << "files:     " << p.manifest.fileCount() << std::endl;
+    }
+}
+
+} // namespace Tools
+} // namespace rose
@@ -0,0 +1,22 @@
+#ifndef RPS_TOOLS_STATUSCOMMAND_H
+#define RPS_TOOLS_STATUSCOMMAND_H
+
+#include "command.h"
+
+namespace rose
+{
+namespace Tools
+{
+
+class StatusCommand : public rose::Tools::Command
+{
+  public:
+    StatusCommand();
+
+    virtual void execute(std::vector<std::string> &arguments);
+};
+
+} // namespace Tools
+} // namespace rose
+
+#endif // RPS_TOOLS_STATUSCOMMAND_H
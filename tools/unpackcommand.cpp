@@ -13,10 +13,13 @@ void UnpackCommand::execute(std::vector<std::string> &arguments)
 {
     // parse command line
 
-    std::string package_path, out_dir;
+    std::string package_path, out_dir, base_dir;
 
     for (std::vector<std::string>::iterator it = arguments.begin(); arguments.end() - it >= 1;
          it += 2) {
+        // each option is followed by its value
+        if (arguments.end() - it < 2)
+            throw "option without value";
 
         if (*it == std::string("-f")) {
             package_path = *(it + 1);
@@ -27,6 +30,21 @@ void UnpackCommand::execute(std::vector<std::string> &arguments)
             out_dir = *(it + 1);
             continue;
         }
+
+        if (*it == std::string("-b")) {
+            base_dir = *(it + 1);
+            continue;
+        }
+    }
+
+    // a delta package is applied to the extracted base revision
+    if (!base_dir.empty()) {
+        if (out_dir.empty())
+            throw "output directory is not set";
+
+        Package pkg;
+        pkg.applyDelta(package_path, base_dir, out_dir);
+        return;
     }
 
     // unpack the package